@@ -1,22 +1,161 @@
 #pragma once
 #include "tensor.hpp"
+#include <cstddef>
 #include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <functional>
-#include <unordered_set>
-
 
+// Reverse-mode autodiff on a per-thread tape. Every op that has an input
+// requiring grad appends one record (output node + backward closure) to the
+// calling thread's tape; closures live in a bump arena. backward() walks the
+// tape in reverse from the root, so no graph traversal is needed, and
+// clear_tape() drops the whole step at once.
 struct ADTensor {
     Tensor val;
+    // Allocated zeroed the first time backward or an optimizer reaches the
+    // node, for leaves and op results alike, so a model that only runs
+    // inference never holds a second copy of its weights; constants never
+    // get one.
     Tensor grad;
-    std::vector<std::pair<std::shared_ptr<ADTensor>, std::function<void()>>> deps;
+    // Extra gradient buffers for data-parallel workers (parameters only);
+    // see allocate_grad_shards()
+    std::vector<Tensor> grad_shards;
+    bool requires_grad = true;
+    // Record that produced this node, valid while tape_epoch matches the tape
+    int tape_pos = -1;
+    unsigned tape_epoch = 0;
+
+    // Leaf (parameter, input)
     ADTensor(int rows, int cols);
     ADTensor(const Tensor& t);
     ADTensor(const std::vector<int>& shape);
+    // Op result or constant: gradient left unallocated
+    ADTensor(Tensor&& t, bool requires_grad);
     void backward();
+    // Zeroed gradient of val's shape, allocated on first use
+    Tensor& ensure_grad();
 };
 
 std::shared_ptr<ADTensor> make_ad(const Tensor& t);
+// Value that never needs a gradient (masks, ones-vectors, targets)
+std::shared_ptr<ADTensor> make_const(const Tensor& t);
+// Output node for a custom op; attach its backward with record_backward()
+std::shared_ptr<ADTensor> make_op_result(Tensor&& t);
+
+// Release every record and closure on this thread's tape. Nodes still held
+// elsewhere survive as leaves. Call once per training/generation step.
+void clear_tape();
+// Number of records currently on this thread's tape
+std::size_t tape_size();
+
+namespace tape {
+inline thread_local bool grad_mode = true;
+// 0: accumulate into ADTensor::grad; k > 0: into grad_shards[k - 1]
+inline thread_local int grad_shard = 0;
+using Thunk = void (*)(void*);
+void* alloc(std::size_t size, std::size_t align);
+// Keep an input alive until the tape is cleared (no-op for nodes on the tape)
+void retain(const std::shared_ptr<ADTensor>& x);
+void push(const std::shared_ptr<ADTensor>& out, Thunk run, Thunk destroy, void* ctx);
+
+// Recording state a thread-pool task inherits from the thread that spawned
+// it, so ops run inside a parallel region land on the spawner's tape
+struct Context {
+    void* tape = nullptr;  // nullptr: the running thread's own tape
+    bool grad_mode = true;
+    int grad_shard = 0;
+};
+// The calling thread's current state
+Context capture();
+// Record this thread's ops onto another thread's tape (nullptr: its own);
+// returns the previous binding. Records from several threads may share a
+// tape; backward() must still run on one thread at a time.
+void* bind(void* tape);
+
+// Installs a captured context on the calling thread while alive
+class ContextScope {
+public:
+    explicit ContextScope(const Context& ctx)
+        : prev_{bind(ctx.tape), grad_mode, grad_shard} {
+        grad_mode = ctx.grad_mode;
+        grad_shard = ctx.grad_shard;
+    }
+    ~ContextScope() {
+        bind(prev_.tape);
+        grad_mode = prev_.grad_mode;
+        grad_shard = prev_.grad_shard;
+    }
+    ContextScope(const ContextScope&) = delete;
+    ContextScope& operator=(const ContextScope&) = delete;
+
+private:
+    Context prev_;
+};
+} // namespace tape
+
+// Scoped inference mode for the calling thread: ops record nothing and return
+// constants, so intermediates are freed as soon as their handles drop and no
+// gradient buffers are allocated. Guards nest.
+class NoGradGuard {
+public:
+    NoGradGuard() : prev_(tape::grad_mode) { tape::grad_mode = false; }
+    ~NoGradGuard() { tape::grad_mode = prev_; }
+    NoGradGuard(const NoGradGuard&) = delete;
+    NoGradGuard& operator=(const NoGradGuard&) = delete;
+
+private:
+    bool prev_;
+};
+
+// False while a NoGradGuard is alive on this thread
+inline bool grad_enabled() { return tape::grad_mode; }
+
+// Routes this thread's parameter gradients into shard k (1-based) while
+// alive, so data-parallel workers never write the same buffer. Shard 0 is
+// the parameter's own grad.
+class GradShardScope {
+public:
+    explicit GradShardScope(int k) : prev_(tape::grad_shard) { tape::grad_shard = k; }
+    ~GradShardScope() { tape::grad_shard = prev_; }
+    GradShardScope(const GradShardScope&) = delete;
+    GradShardScope& operator=(const GradShardScope&) = delete;
+
+private:
+    int prev_;
+};
+
+// Gradient buffer to accumulate into during backward, or nullptr for inputs
+// that do not require grad
+inline Tensor* grad_of(ADTensor* x) {
+    if (!x->requires_grad) return nullptr;
+    int k = tape::grad_shard;
+    if (k > 0 && k <= static_cast<int>(x->grad_shards.size())) return &x->grad_shards[k - 1];
+    return &x->ensure_grad();
+}
+
+// Attach fn as the backward step of out, computed from inputs. fn runs once,
+// after out->grad is populated, and should accumulate through grad_of(). It
+// should capture nodes as raw pointers: the tape keeps them alive. If no
+// input requires grad, or under NoGradGuard, out becomes a constant and
+// nothing is recorded.
+template <typename Fn, typename... Inputs>
+void record_backward(const std::shared_ptr<ADTensor>& out, Fn&& fn,
+                     const Inputs&... inputs) {
+    if (!grad_enabled() || !(inputs->requires_grad || ...)) {
+        out->requires_grad = false;
+        return;
+    }
+    (tape::retain(inputs), ...);
+    using F = std::decay_t<Fn>;
+    void* ctx = new (tape::alloc(sizeof(F), alignof(F))) F(std::forward<Fn>(fn));
+    tape::push(out,
+               [](void* p) { (*static_cast<F*>(p))(); },
+               [](void* p) { static_cast<F*>(p)->~F(); },
+               ctx);
+}
 
 std::shared_ptr<ADTensor> add(const std::shared_ptr<ADTensor>& a,
                               const std::shared_ptr<ADTensor>& b);
@@ -26,6 +165,10 @@ std::shared_ptr<ADTensor> scalar_mul(const std::shared_ptr<ADTensor>& a,
                                      float s);
 std::shared_ptr<ADTensor> matmul(const std::shared_ptr<ADTensor>& a,
                                  const std::shared_ptr<ADTensor>& b);
+// op(a) * op(b), op(x) = x or x^T; no transposed copies in forward or backward
+std::shared_ptr<ADTensor> matmul(const std::shared_ptr<ADTensor>& a,
+                                 const std::shared_ptr<ADTensor>& b,
+                                 bool trans_a, bool trans_b);
 std::shared_ptr<ADTensor> tanh_ad(const std::shared_ptr<ADTensor>& a);
 std::shared_ptr<ADTensor> exp_ad(const std::shared_ptr<ADTensor>& a);
 std::shared_ptr<ADTensor> log_ad(const std::shared_ptr<ADTensor>& a);
@@ -34,13 +177,105 @@ std::shared_ptr<ADTensor> reciprocal(const std::shared_ptr<ADTensor>& a);
 std::shared_ptr<ADTensor> sub(const std::shared_ptr<ADTensor>& a,
                               const std::shared_ptr<ADTensor>& b);
 std::shared_ptr<ADTensor> sum(const std::shared_ptr<ADTensor>& a);
-void register_parameter(const std::shared_ptr<ADTensor>& p);
+// Register p for the optimizer and checkpoints under name, prefixed by the
+// enclosing ParameterScopes ("block0.norm1.gamma"). Unnamed parameters are
+// numbered, and a repeated name gets a ".1", ".2", ... suffix, so every name
+// is unique.
+void register_parameter(const std::shared_ptr<ADTensor>& p, const std::string& name = "");
 std::vector<std::shared_ptr<ADTensor>>& get_parameters();
+// Names of get_parameters(), index for index
+const std::vector<std::string>& parameter_names();
 void clear_parameters();
+// Prefixes the names of parameters this thread registers while it is alive;
+// scopes nest
+class ParameterScope {
+public:
+    explicit ParameterScope(const std::string& name);
+    ~ParameterScope();
+    ParameterScope(const ParameterScope&) = delete;
+    ParameterScope& operator=(const ParameterScope&) = delete;
+
+private:
+    std::size_t outer_len_;  // length of the enclosing prefix
+};
+// Give every registered parameter n - 1 zeroed gradient shards, one per
+// extra data-parallel worker (n <= 1 releases them)
+void allocate_grad_shards(int n);
+// Add every shard into its parameter's grad and zero the shards
+void reduce_grad_shards();
 std::shared_ptr<ADTensor> transpose(const std::shared_ptr<ADTensor>& a);
 std::shared_ptr<ADTensor> slice(const std::shared_ptr<ADTensor>& a,
                                  int row_offset, int row_count);
 std::shared_ptr<ADTensor> concat(const std::vector<std::shared_ptr<ADTensor>>& parts);
+// Columns [col_offset, col_offset + col_count) of a
+std::shared_ptr<ADTensor> slice_cols(const std::shared_ptr<ADTensor>& a,
+                                     int col_offset, int col_count);
+// Concatenate parts horizontally (column-wise); all parts share a row count
+std::shared_ptr<ADTensor> concat_cols(const std::vector<std::shared_ptr<ADTensor>>& parts);
+// Broadcasts and reductions along one axis, replacing ones-vector matmuls.
+// For activations laid out [features x seq_len], a column is one token.
+// x [R x C] + b [R x 1] added to every column
+std::shared_ptr<ADTensor> add_bias_broadcast(const std::shared_ptr<ADTensor>& x,
+                                             const std::shared_ptr<ADTensor>& b);
+// Sum across each row: [R x C] -> [R x 1]
+std::shared_ptr<ADTensor> sum_rows(const std::shared_ptr<ADTensor>& x);
+// Sum down each column: [R x C] -> [1 x C]
+std::shared_ptr<ADTensor> sum_cols(const std::shared_ptr<ADTensor>& x);
+// Mean down each column: [R x C] -> [1 x C]
+std::shared_ptr<ADTensor> mean_cols(const std::shared_ptr<ADTensor>& x);
+// Repeat a column [R x 1] n times: -> [R x n]
+std::shared_ptr<ADTensor> broadcast_col(const std::shared_ptr<ADTensor>& v, int n);
+// Repeat a row [1 x C] n times: -> [n x C]
+std::shared_ptr<ADTensor> broadcast_row(const std::shared_ptr<ADTensor>& v, int n);
+// Numerically stable softmax of each row of (scale * x + bias). bias, if
+// given, is a constant of x's shape. causal masks key j for query row i when
+// j > i + (cols - rows), i.e. queries are the last rows of the key range.
+// Backward uses only the saved output.
+std::shared_ptr<ADTensor> softmax_ad(const std::shared_ptr<ADTensor>& x,
+                                     bool causal = false,
+                                     const Tensor* bias = nullptr,
+                                     float scale = 1.0f);
+// Softmax down each column (e.g. MoE gate over experts per token)
+std::shared_ptr<ADTensor> softmax_cols_ad(const std::shared_ptr<ADTensor>& x);
+// Multi-head attention in one node. q is [num_heads * head_dim x B * T]
+// with head h in rows [h * head_dim, (h + 1) * head_dim) and sequence b in
+// columns [b * T, (b + 1) * T); k and v hold kv_heads = k.rows / head_dim
+// heads, each shared by num_heads / kv_heads query heads (GQA). Every
+// (sequence, head) pair reads its Q/K/V blocks in place, computes
+// softmax(scale * Q_h^T K_h - alibi[h] * |i - j|) with the optional causal
+// mask, and writes V_h * P^T straight into its block of the
+// [q.rows x B * T] output. The ALiBi term and the mask are applied on the
+// fly (no T x T bias), and under the mask row blocks skip the keys none of
+// their rows can see. Pairs run in parallel on the shared pool; backward
+// keeps only the attention probabilities. seq_len <= 0 means one sequence.
+std::shared_ptr<ADTensor> attention_ad(const std::shared_ptr<ADTensor>& q,
+                                       const std::shared_ptr<ADTensor>& k,
+                                       const std::shared_ptr<ADTensor>& v,
+                                       int num_heads, int seq_len, bool causal,
+                                       float scale,
+                                       const std::vector<float>* alibi = nullptr);
+// Same layout and result as attention_ad, computed FlashAttention-style in
+// tile x tile blocks with an online softmax, so memory stays O(T) per head:
+// the forward saves only each query row's log-sum-exp and backward
+// recomputes the probabilities tile by tile. alibi, if given, holds one
+// slope per query head and adds -slope * |i - j| on the fly; with causal,
+// key tiles entirely above the diagonal are skipped in both passes.
+std::shared_ptr<ADTensor> flash_attention_ad(const std::shared_ptr<ADTensor>& q,
+                                             const std::shared_ptr<ADTensor>& k,
+                                             const std::shared_ptr<ADTensor>& v,
+                                             int num_heads, int seq_len, bool causal,
+                                             float scale, int tile,
+                                             const std::vector<float>* alibi = nullptr);
+// Summed cross-entropy of logits [V x T] against targets[t] for each column
+// t, as a [1 x 1] loss. Targets outside [0, V) (or missing) skip their
+// column. Streams over the logits once per pass and keeps only the per-column
+// log-sum-exp; backward writes softmax - onehot straight into logits' grad.
+std::shared_ptr<ADTensor> cross_entropy_ad(const std::shared_ptr<ADTensor>& logits,
+                                           const std::vector<int>& targets);
+// Columns ids[0..n) of a as an [a.rows x n] tensor; backward scatter-adds
+// into just those columns (repeated ids accumulate)
+std::shared_ptr<ADTensor> gather_cols(const std::shared_ptr<ADTensor>& a,
+                                      const std::vector<int>& ids);
 
 // N-dim operations
 std::shared_ptr<ADTensor> relu_ad(const std::shared_ptr<ADTensor>& a);
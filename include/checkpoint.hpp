@@ -0,0 +1,165 @@
+#pragma once
+#include "optimizer.hpp"
+#include "tensor.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Self-describing checkpoint format. All integers are little-endian:
+//   "DSCK", u32 version, u32 tensor count, u32 metadata count
+//   per metadata entry: u32 key length, key, u32 value length, value
+//   per tensor: u32 name length, name, u32 dtype (0: f32), u32 ndim,
+//               i64 dims[ndim], u64 data offset, u64 data bytes
+//   tensor data, each starting at a 64-byte-aligned file offset
+// Tensors are looked up by name, so loading does not depend on the order
+// parameters were registered in, and any rank is stored (conv weights
+// included). Files from the older layout (u32 count, then rows, cols and
+// floats per parameter, matched by position) are still read, as are
+// version 1 files, which have no metadata.
+namespace ckpt {
+
+// String key/value pairs stored next to the tensors (training progress)
+using Metadata = std::map<std::string, std::string>;
+
+struct Entry {
+    std::string name;
+    std::vector<int> shape;
+    std::uint64_t offset;  // from the start of the file
+    std::uint64_t bytes;
+};
+
+// A checkpoint mapped into memory (private, copy-on-write). Opening it reads
+// only the index; tensor pages are faulted in on first touch and shared with
+// every other process mapping the same file. Throws std::runtime_error if the
+// file cannot be mapped or is not in this format.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    const std::vector<Entry>& entries() const { return entries_; }
+    const Metadata& metadata() const { return metadata_; }
+    // nullptr if there is no tensor called name
+    const Entry* find(const std::string& name) const;
+    const float* data(const Entry& e) const;
+    // Tensor over e's mapped data, without a copy; it keeps the mapping
+    // alive after this object is gone
+    Tensor tensor(const Entry& e) const;
+
+private:
+    std::shared_ptr<void> base_;  // unmaps once the last user lets go
+    std::size_t size_ = 0;
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string, std::size_t> index_;
+    Metadata metadata_;
+};
+
+// Write tensors[i] under names[i]. The file is written as path + ".tmp",
+// fsynced and renamed over path, so a crash leaves either the old or the new
+// checkpoint, never a torn one. Throws std::runtime_error on I/O failure.
+void write(const std::string& path, const std::vector<std::string>& names,
+           const std::vector<const Tensor*>& tensors, const Metadata& metadata = {});
+
+// Every registered parameter under its parameter_names() entry
+void save_parameters(const std::string& path);
+
+// Fill the registered parameters from path, matching by name (by position
+// for the older layout). With map, parameters adopt the mapped pages instead
+// of copying them: use it for inference, where weights are only read. A
+// parameter missing from the file, or stored with another shape, keeps its
+// current value with a warning; more than three shape mismatches, or a file
+// that cannot be read, throw std::runtime_error. Returns the number of
+// parameters loaded.
+int load_parameters(const std::string& path, bool map);
+
+// Writes checkpoints on a background thread, so training only pays for a
+// memory copy. save() snapshots the tensors into one of two buffers and
+// returns; the writer thread writes the other. A save() issued while a
+// snapshot is still queued replaces it, so a slow disk skips checkpoints
+// instead of stalling the caller. save() is meant for one thread.
+class AsyncWriter {
+public:
+    AsyncWriter();
+    // Finishes queued writes
+    ~AsyncWriter();
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    // Queue a write(path, names, tensors, metadata) of the tensors' current
+    // values. Throws the error of an earlier write that failed, if any, after
+    // queueing this one.
+    void save(const std::string& path, const std::vector<std::string>& names,
+              const std::vector<const Tensor*>& tensors, const Metadata& metadata = {});
+    // Every registered parameter, as save_parameters() would write them
+    void save_parameters(const std::string& path);
+    // Block until every queued checkpoint is on disk; throws the error of a
+    // write that failed since the last save() or wait()
+    void wait();
+    // Checkpoints written so far, and snapshots replaced before being written
+    int written() const;
+    int skipped() const;
+
+private:
+    struct Snapshot {
+        std::string path;
+        std::vector<std::string> names;
+        std::vector<Tensor> tensors;
+        Metadata metadata;
+    };
+    void run();
+    void rethrow_error();  // with mu_ held
+
+    Snapshot buffers_[2];
+    mutable std::mutex mu_;  // guards the fields below
+    std::condition_variable cv_;
+    int pending_ = -1;  // buffer queued for writing
+    int writing_ = -1;  // buffer the writer thread is on
+    int written_ = 0;
+    int skipped_ = 0;
+    bool stop_ = false;
+    std::exception_ptr error_;
+    std::thread thread_;
+};
+
+// Where training stands at an optimizer-step boundary: everything besides the
+// weights and AdamW state needed to carry on as if never stopped
+struct TrainingState {
+    int epoch = 1;               // epoch to continue in
+    long long batches_done = 0;  // batches of that epoch already trained on
+    int global_step = 0;
+    int scheduler_step = 0;
+    std::mt19937 rng{1234};      // data-order RNG as it was when epoch began
+    float loss_sum = 0.0f;       // running loss of the epoch so far
+    int loss_count = 0;
+    float best_val_loss = std::numeric_limits<float>::infinity();
+    int no_improve = 0;
+
+    // Nothing left to train: every epoch is done, or validation had already
+    // run out of patience
+    bool finished(int epochs, int patience, bool validating) const {
+        return epoch > epochs || (validating && no_improve >= patience);
+    }
+};
+
+// Queue a checkpoint of the parameters plus opt's moments (as
+// "adam.m.<name>" and "adam.v.<name>") and state, as metadata. The file still
+// loads with load_parameters() for inference.
+void save_training(AsyncWriter& writer, const std::string& path, const AdamW& opt,
+                   const TrainingState& state);
+
+// Restore opt and state from a checkpoint written by save_training(); the
+// parameters themselves come from load_parameters(). Returns false, leaving
+// both untouched, for a weights-only checkpoint. Moments missing from the
+// file or shaped differently from their parameter restart AdamW from
+// scratch with a warning. Throws std::runtime_error if path cannot be read.
+bool load_training(const std::string& path, AdamW& opt, TrainingState& state);
+
+}  // namespace ckpt
@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+
+// Packed, register-tiled single-precision GEMM engine used by Tensor::matmul.
+// Operands are row-major with explicit leading dimensions. A and B are packed
+// into cache-sized panels and multiplied by a microkernel chosen at runtime
+// (AVX-512, AVX2/FMA or portable C++); large problems are split across the
+// shared thread pool (thread_pool.hpp).
+namespace gemm {
+
+// C[M x N] = alpha * op(A)[M x K] * op(B)[K x N] + beta * C, where op(X) is
+// X, or X^T when the matching trans flag is set (A is then stored K x M, B
+// N x K). When beta == 0, C is write-only and may hold uninitialized values.
+void sgemm(bool trans_a, bool trans_b, int M, int N, int K,
+           float alpha, const float* A, int lda,
+           const float* B, int ldb,
+           float beta, float* C, int ldc);
+
+// Name of the active microkernel: "avx512", "avx2" or "generic"
+const char* kernel_name();
+
+// Force a microkernel by name; returns false if this CPU cannot run it
+bool set_kernel(const std::string& name);
+
+// Number of threads (including the caller) used for large products; these
+// forward to parallel::num_threads() / set_num_threads()
+int num_threads();
+void set_num_threads(int n);
+
+} // namespace gemm
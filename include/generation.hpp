@@ -0,0 +1,124 @@
+#pragma once
+#include "tensor.hpp"
+#include "inference_model.hpp"
+#include "layers/paged_kv_cache.hpp"
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+struct GenerateConfig {
+    int max_new_tokens;
+    int seq_len;
+    int top_k;
+    float top_p;
+    float temperature;
+    int eos_id;
+    int beam_width;
+};
+
+// Sample a token id from logits: top-k when top_k > 0, else nucleus when
+// top_p > 0, else greedy
+int sample_next_token(const std::vector<float>& logits,
+                      int top_k, float top_p, float temperature,
+                      std::mt19937& rng);
+
+// The normalized distribution sample_next_token draws from (one-hot at the
+// argmax when greedy)
+std::vector<float> token_distribution(const std::vector<float>& logits,
+                                      int top_k, float top_p, float temperature);
+
+// Beam search over a forkable paged KV cache. Beams share the prompt's
+// blocks, all live beams advance in one batched decode step, and pruning
+// reorders caches by forking survivors (copy-on-write) rather than
+// recomputing them. Returns the prompt followed by the best beam.
+std::vector<int> beam_search(const InferenceModel& model,
+                             const std::vector<int>& prompt,
+                             const GenerateConfig& cfg, int block_size = 16);
+
+struct SpeculativeStats {
+    int rounds = 0;
+    int proposed = 0;  // draft tokens offered to the target
+    int accepted = 0;  // of those, kept
+};
+
+// Speculative decoding: the draft model proposes k tokens one at a time,
+// the target scores all of them in one multi-token cached forward, and
+// each proposal is kept with probability min(1, p/q) under the sampling
+// distributions of sample_next_token (p target, q draft). The first
+// rejection is resampled from max(0, p - q), so the output follows the
+// target's distribution exactly; greedy decoding reproduces the target's
+// greedy output. Both models must share the vocabulary. Rejected positions
+// are truncated from both caches.
+std::vector<int> speculative_generate(const InferenceModel& target,
+                                      const InferenceModel& draft,
+                                      const std::vector<int>& prompt,
+                                      const GenerateConfig& cfg, int k,
+                                      std::mt19937& rng,
+                                      SpeculativeStats* stats = nullptr,
+                                      int block_size = 16);
+
+// Continuous-batching decoder over the paged InferenceModel.
+// Requests queue with submit() and join the running batch at the next token
+// boundary. Each step() feeds the new prompts plus the last token of every
+// running sequence through the model as one batch, so the projections, FFNs
+// and output layer are single GEMMs over all active sequences. A finished
+// sequence leaves the batch and returns its KV blocks to the pool at once.
+class BatchScheduler {
+public:
+    // The pool holds num_blocks blocks of block_size positions (0: enough
+    // for max_batch sequences of max_length() positions). kv_window > 0
+    // limits attention to the last kv_window positions.
+    BatchScheduler(const InferenceModel& model, int max_batch = 8,
+                   int block_size = 16, int num_blocks = 0, int kv_window = 0);
+
+    // Queue a prompt; safe to call while another thread runs step().
+    // Returns the request id.
+    int submit(const std::vector<int>& prompt, const GenerateConfig& cfg,
+               unsigned seed);
+    // Admit waiting requests and advance every running sequence by one
+    // token. Returns false once nothing is waiting or running.
+    bool step();
+    // step() until idle
+    void run();
+
+    bool finished(int id) const;
+    // Prompt followed by the generated tokens of a finished request
+    std::vector<int> result(int id) const;
+    int running() const { return static_cast<int>(running_.size()); }
+
+private:
+    struct Sequence {
+        int id;
+        std::vector<int> tokens;
+        int prompt_len;
+        int fed = 0;  // tokens already in the cache
+        int blocks;   // worst-case pool blocks, reserved on admission
+        GenerateConfig cfg;
+        std::mt19937 rng;
+        PagedKVCache cache;
+    };
+
+    int blocks_needed(int prompt_len, const GenerateConfig& cfg) const;
+    void admit();
+
+    const InferenceModel& model_;
+    int max_batch_;
+    int kv_window_;
+    KVBlockPool pool_;
+    int reserved_ = 0;
+    std::vector<std::unique_ptr<Sequence>> running_;
+
+    mutable std::mutex mu_;  // guards the fields below
+    int next_id_ = 0;
+    struct Pending {
+        int id;
+        std::vector<int> prompt;
+        GenerateConfig cfg;
+        unsigned seed;
+    };
+    std::deque<Pending> waiting_;
+    std::map<int, std::vector<int>> results_;
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include "tensor.hpp"
+#include "autodiff.hpp"
+#include "layers/ad_transformer.hpp"
+#include "layers/paged_kv_cache.hpp"
+#include "layers/rope.hpp"
+#include <memory>
+#include <vector>
+
+// KV-cached inference graph for a model trained with ADTransformer. It is
+// built from the same TransformerConfig and reads the trained tensors in
+// place (keeping them alive), so there is no copy to fall out of sync and
+// every block variant is covered: LayerNorm or RMSNorm, GELU FFN, SwiGLU or
+// top-k MoE, ALiBi or RoPE, full or grouped-query attention. Keys and values
+// live in paged caches over a KVBlockPool of kv_dim() rows.
+class InferenceModel {
+public:
+    // params holds the trained parameters in registration order: the
+    // ADEmbedding weight, the ADPositionalEncoding table, every
+    // ADTransformer block, then the output bias. Throws if their number or
+    // shapes do not match cfg.
+    InferenceModel(const TransformerConfig& cfg,
+                   const std::vector<std::shared_ptr<ADTensor>>& params);
+
+    // Token plus learned position embeddings, one column per id
+    Tensor embed(const std::vector<int>& ids, const std::vector<int>& positions) const;
+    // Append x's columns to one sequence's cache and run them
+    Tensor forward(const Tensor& x, PagedKVCache& cache) const;
+    // Batched form: x's columns are consecutive runs of lens[i] columns
+    // continuing seqs[i]. Norms, projections and FFNs run once over all
+    // columns; attention runs per sequence.
+    Tensor forward(const Tensor& x, const std::vector<PagedKVCache*>& seqs,
+                   const std::vector<int>& lens) const;
+    // Output scores [vocab x cols] for hidden states h (tied embedding plus
+    // bias)
+    Tensor logits(const Tensor& h) const;
+
+    const TransformerConfig& config() const { return cfg_; }
+    int num_layers() const { return static_cast<int>(blocks_.size()); }
+    int embed_dim() const { return cfg_.embed_dim; }
+    int kv_dim() const { return kv_heads_ * head_dim_; }
+    int vocab_size() const { return embed_->val.cols; }
+    int max_length() const { return posenc_->val.cols; }
+
+private:
+    using Param = std::shared_ptr<ADTensor>;
+    struct FFN {
+        Param W1, b1, W2, b2;
+    };
+    struct Block {
+        Param W_q, W_k, W_v, W_o;
+        Param norm1_g, norm1_b, norm2_g, norm2_b;  // betas unset for RMSNorm
+        FFN ff;
+        Param W_gate, W_up, W_down;                // SwiGLU
+        Param gate_W, gate_b;                      // MoE router
+        std::vector<FFN> experts;
+    };
+
+    Tensor norm(const Tensor& x, const Param& gamma, const Param& beta) const;
+    Tensor feed_forward(const Block& block, const Tensor& x) const;
+    Tensor moe(const Block& block, const Tensor& x) const;
+
+    TransformerConfig cfg_;
+    int head_dim_;
+    int kv_heads_;
+    Param embed_, posenc_, out_b_;
+    std::vector<Block> blocks_;
+    std::vector<float> alibi_slopes_;
+    std::unique_ptr<RoPE> rope_;
+};
@@ -9,8 +9,4 @@ public:
 private:
     std::shared_ptr<ADTensor> W1, b1;
     std::shared_ptr<ADTensor> W2, b2;
-    // Cached ones tensors for bias broadcast
-    mutable Tensor cached_ones1{1, 1};
-    mutable Tensor cached_ones2{1, 1};
-    mutable int cached_seq_len = -1;
 };
\ No newline at end of file
@@ -3,7 +3,9 @@
 #include <vector>
 
 // Flash Attention: tiled attention computation for memory efficiency
-// Computes exact attention but in tiles to reduce peak memory usage
+// Computes exact attention in tile_size blocks with an online softmax; the
+// backward pass recomputes the tiles from a saved per-row log-sum-exp, so
+// activation memory is O(seq_len) per head instead of O(seq_len^2)
 // Based on the FlashAttention algorithm (Dao et al., 2022)
 class ADFlashAttention {
 public:
@@ -18,13 +20,4 @@ private:
     bool causal;
     std::vector<float> alibi_slopes;
     std::shared_ptr<ADTensor> W_q, W_k, W_v, W_o;
-
-    // Tiled softmax-attention for a single head
-    // Q, K, V: [head_dim x seq_len]
-    // Returns: [head_dim x seq_len]
-    std::shared_ptr<ADTensor> tiled_attention(
-        const std::shared_ptr<ADTensor>& Q,
-        const std::shared_ptr<ADTensor>& K,
-        const std::shared_ptr<ADTensor>& V,
-        int head_idx);
 };
@@ -1,6 +1,6 @@
 #pragma once
 #include "autodiff.hpp"
-#include <deque>
+#include "layers/kv_cache.hpp"
 
 // Sliding Window KV Cache: compresses KV cache by keeping only the most recent window_size tokens
 class ADKVCache {
@@ -23,9 +23,7 @@ public:
 
 private:
     int window_size;
-    // Store raw tensors for the cache (non-AD for efficiency)
-    std::vector<float> k_cache;
-    std::vector<float> v_cache;
-    int head_dim;
-    int current_len;
+    // Ring buffer of the last window_size positions (non-AD for efficiency);
+    // sized on the first update
+    KVCache store;
 };
@@ -1,18 +1,31 @@
 #pragma once
 #include "autodiff.hpp"
+#include "layers/rope.hpp"
 #include <limits>
+#include <memory>
 
 class ADMultiHeadAttention {
 public:
-    ADMultiHeadAttention(int embed_dim, int num_heads, bool causal = true);
-    std::shared_ptr<ADTensor> forward(const std::shared_ptr<ADTensor>& input);
+    // num_kv_heads < num_heads shares each key/value head among a group of
+    // query heads (grouped-query attention; 0 = num_heads). rope_max_len > 0
+    // rotates queries and keys with RoPE over that many positions in place
+    // of the ALiBi bias.
+    ADMultiHeadAttention(int embed_dim, int num_heads, bool causal = true,
+                         int num_kv_heads = 0, int rope_max_len = 0);
+    // input: [embed_dim x (B * seq_len)], B sequences packed side by side.
+    // Projections run over all columns at once; attention (and the causal
+    // mask) stays within each sequence. seq_len <= 0 means one sequence.
+    std::shared_ptr<ADTensor> forward(const std::shared_ptr<ADTensor>& input,
+                                      int seq_len = 0);
 
 private:
     int embed_dim;
     int num_heads;
+    int num_kv_heads;
     int head_dim;
     bool causal;
     // ALiBi slopes for each head
     std::vector<float> alibi_slopes;
+    std::unique_ptr<RoPE> rope;
     std::shared_ptr<ADTensor> W_q, W_k, W_v, W_o;
 };
\ No newline at end of file
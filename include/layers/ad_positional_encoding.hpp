@@ -4,7 +4,9 @@
 class ADPositionalEncoding {
 public:
     ADPositionalEncoding(int embed_dim, int max_len = 512);
-    std::shared_ptr<ADTensor> forward(int seq_len) const;
+    // [embed_dim x seq_len]; with batch > 1 the positions repeat for each of
+    // batch packed sequences: [embed_dim x (batch * seq_len)]
+    std::shared_ptr<ADTensor> forward(int seq_len, int batch = 1) const;
 
 private:
     int embed_dim;
@@ -13,10 +13,4 @@ private:
     int dim_;
     float eps_;
     std::shared_ptr<ADTensor> gamma;
-
-    // Cached tensors
-    mutable Tensor cached_ones_row{1, 1};
-    mutable Tensor cached_ones_col{1, 1};
-    mutable Tensor cached_ones_cols{1, 1};
-    mutable int cached_cols = -1;
 };
@@ -13,8 +13,4 @@ private:
     std::shared_ptr<ADTensor> W_gate;  // [hidden_dim x embed_dim] - gate projection
     std::shared_ptr<ADTensor> W_up;    // [hidden_dim x embed_dim] - up projection
     std::shared_ptr<ADTensor> W_down;  // [embed_dim x hidden_dim] - down projection
-
-    // Cached ones for bias-free broadcast
-    mutable Tensor cached_ones{1, 1};
-    mutable int cached_seq_len = -1;
 };
@@ -19,14 +19,18 @@ struct TransformerConfig {
     int moe_top_k = 2;
     bool use_rmsnorm = false;
     bool use_swiglu = false;
-    bool use_rope = false;
+    bool use_rope = false;      // RoPE on queries and keys instead of ALiBi
+    int n_kv_heads = 0;         // grouped-query attention; 0 = n_heads
+    int max_len = 128;          // positions covered by the RoPE tables
 };
 
 class ADTransformerBlock {
 public:
     ADTransformerBlock(const TransformerConfig& cfg);
+    // x may pack several sequences of seq_len columns (see ADMultiHeadAttention)
     std::shared_ptr<ADTensor> forward(const std::shared_ptr<ADTensor>& x,
-                                       std::shared_ptr<ADTensor>* aux_loss = nullptr);
+                                       std::shared_ptr<ADTensor>* aux_loss = nullptr,
+                                       int seq_len = 0);
 
 private:
     // Normalization (either LayerNorm or RMSNorm)
@@ -56,8 +60,11 @@ public:
     // New config-based constructor
     explicit ADTransformer(const TransformerConfig& cfg);
 
+    // x: [embed_dim x (B * seq_len)] for a batch of B sequences; seq_len <= 0
+    // treats all columns as one sequence
     std::shared_ptr<ADTensor> forward(const std::shared_ptr<ADTensor>& x,
-                                       std::shared_ptr<ADTensor>* aux_loss = nullptr);
+                                       std::shared_ptr<ADTensor>* aux_loss = nullptr,
+                                       int seq_len = 0);
 
 private:
     std::vector<ADTransformerBlock> blocks;
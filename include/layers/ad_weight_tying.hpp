@@ -6,9 +6,12 @@
 // This reduces parameters and often improves generalization
 class ADWeightTying {
 public:
-    // embedding_weights: the shared weight matrix from ADEmbedding [vocab_size x embed_dim]
-    // stored as AD tensor for gradient flow
-    explicit ADWeightTying(const std::shared_ptr<ADTensor>& embedding_weights);
+    // embedding_weights: the shared weight matrix, stored as AD tensor for
+    // gradient flow. [vocab_size x embed_dim] by default; embedding_layout
+    // says it is ADEmbedding's native [embed_dim x vocab_size] instead, read
+    // transposed in place.
+    explicit ADWeightTying(const std::shared_ptr<ADTensor>& embedding_weights,
+                           bool embedding_layout = false);
 
     // Projects hidden states to vocabulary logits using transposed embedding weights
     // input: [embed_dim x seq_len]
@@ -17,4 +20,5 @@ public:
 
 private:
     std::shared_ptr<ADTensor> shared_weights;  // reference to embedding weights
+    bool embedding_layout;
 };
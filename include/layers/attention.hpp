@@ -1,10 +1,44 @@
 #pragma once
 #include "tensor.hpp"
+#include "layers/kv_cache.hpp"
+#include "layers/paged_kv_cache.hpp"
+#include <vector>
+
+// A run of consecutive cached positions: the first len columns of
+// [kv_dim x ld] key/value buffers
+struct KVSegment {
+    const float* k;
+    const float* v;
+    int ld;
+    int len;
+};
+
+// Scaled dot-product attention of q_len queries (columns of Q, row stride
+// ldq) over the keys and values of segs taken in order, read in place.
+// Heads are written to the matching columns of out (row stride ldo); query
+// head h reads key/value head h / (num_heads / num_kv_heads). With mask set,
+// query i sees key columns up to q_pos + i and, given a window, from
+// q_pos + i - window + 1 on. alibi, if given, holds one slope per query head
+// and adds -slope * |q_pos + i - j| to each score.
+void attend_segments(const float* Q, int ldq, int q_len,
+                     const std::vector<KVSegment>& segs,
+                     int num_heads, int num_kv_heads, int head_dim, int q_pos,
+                     bool mask, int window, const float* alibi,
+                     float dropout_prob, float* out, int ldo);
+
 class MultiHeadAttention {
 public:
     MultiHeadAttention(int embed_dim, int num_heads, bool causal = false,
                        float dropout_prob = 0.0f);
     Tensor forward(const Tensor& input, bool training = false, bool use_cache = false);
+    // Inference over paged caches: each span's columns of input continue
+    // its sequence at positions already covered by extend(). Their keys and
+    // values are stored under `layer`, projections run as one GEMM for the
+    // whole batch, and attention reads the pool blocks in place.
+    Tensor forward(const Tensor& input, const std::vector<PagedSpan>& spans, int layer);
+    // Preallocate the KV cache for `capacity` positions. With sliding set it
+    // becomes a ring that keeps only the last `capacity` positions.
+    void reserve_cache(int capacity, bool sliding = false);
     void clear_cache();
 
     int embed_dim;
@@ -16,7 +50,6 @@ public:
     Tensor W_k;
     Tensor W_v;
     Tensor W_o;
-    // KV cache: [embed_dim x cached_len]
-    Tensor k_cache;
-    Tensor v_cache;
+    // KV cache: [embed_dim x capacity], read in place by forward()
+    KVCache cache;
 };
\ No newline at end of file
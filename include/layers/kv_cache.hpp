@@ -0,0 +1,53 @@
+#pragma once
+#include "tensor.hpp"
+#include <vector>
+
+// Preallocated key/value store for one attention layer. Keys and values are
+// [dim x capacity] row-major buffers with one column per cached position, so
+// appending a token writes a single column in place and attention reads the
+// buffers directly with a row stride of capacity().
+//
+// In sliding mode the buffers are a ring: once full, each new position
+// overwrites the oldest one, so only the last capacity() positions are kept.
+// Otherwise capacity is a reservation and appending past it grows the
+// buffers geometrically.
+class KVCache {
+public:
+    KVCache() = default;
+    KVCache(int dim, int capacity, bool sliding = false);
+
+    // Reallocate for a new shape; drops the contents
+    void reserve(int dim, int capacity, bool sliding = false);
+    // Forget all positions but keep the storage
+    void clear();
+
+    // Append columns [c0, c0 + n) of k and v ([dim x cols])
+    void append(const Tensor& k, const Tensor& v, int c0, int n);
+    void append(const Tensor& k, const Tensor& v) { append(k, v, 0, k.cols); }
+
+    int dim() const { return dim_; }
+    int capacity() const { return capacity_; }
+    bool sliding() const { return sliding_; }
+    // Positions appended since the last clear()
+    int length() const { return length_; }
+    // Positions currently held
+    int size() const { return length_ < capacity_ ? length_ : capacity_; }
+    // True once the ring has overwritten a position; columns are then no
+    // longer in position order
+    bool wrapped() const { return sliding_ && length_ > capacity_; }
+    // Column holding absolute position p (one of the last size() positions)
+    int slot(int p) const { return sliding_ ? p % capacity_ : p; }
+
+    const float* keys() const { return k_.data(); }
+    const float* values() const { return v_.data(); }
+
+private:
+    void grow(int capacity);
+
+    int dim_ = 0;
+    int capacity_ = 0;
+    int length_ = 0;
+    bool sliding_ = false;
+    std::vector<float> k_;
+    std::vector<float> v_;
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include "tensor.hpp"
+#include <mutex>
+#include <vector>
+
+// Shared pool of fixed-size KV blocks for serving many sequences from one
+// model. A block holds keys and values for block_size consecutive positions
+// of every layer, each stored [dim x block_size] row-major. Blocks are
+// reference counted so sequences forked from a common prompt share them.
+// Allocation and reference counts are thread-safe; block contents are
+// written only by the sequence that owns them exclusively.
+class KVBlockPool {
+public:
+    KVBlockPool(int num_layers, int dim, int block_size, int num_blocks);
+
+    // Take a free block (reference count 1); throws when the pool is empty
+    int allocate();
+    void retain(int block);
+    // Drop a reference; the block returns to the free list at zero
+    void release(int block);
+    int ref_count(int block) const;
+    int free_blocks() const;
+    // Copy every layer's keys and values from src into dst
+    void copy_block(int src, int dst);
+
+    int num_layers() const { return num_layers_; }
+    int dim() const { return dim_; }
+    int block_size() const { return block_size_; }
+    int num_blocks() const { return num_blocks_; }
+
+    float* keys(int layer, int block) { return data_.data() + offset(layer, block, 0); }
+    float* values(int layer, int block) { return data_.data() + offset(layer, block, 1); }
+
+private:
+    size_t offset(int layer, int block, int kv) const {
+        return ((static_cast<size_t>(block) * num_layers_ + layer) * 2 + kv) * block_elems_;
+    }
+
+    int num_layers_;
+    int dim_;
+    int block_size_;
+    int num_blocks_;
+    size_t block_elems_;
+    std::vector<float> data_;
+    mutable std::mutex mu_;
+    std::vector<int> refs_;
+    std::vector<int> free_;
+};
+
+// One sequence's view of a KVBlockPool: a block table mapping position p to
+// block blocks()[p / block_size] column p % block_size. Memory grows one
+// block at a time instead of reserving max_len up front. fork() shares all
+// blocks with the new sequence; a shared, partly filled tail block is copied
+// before either side appends to it (full blocks are never written again).
+//
+// With a window, position p attends only to (p - window, p], and blocks
+// that no future query can see go back to the pool; their table entries
+// become -1 and first_block() moves past them.
+class PagedKVCache {
+public:
+    explicit PagedKVCache(KVBlockPool& pool, int window = 0);
+    ~PagedKVCache();
+    PagedKVCache(const PagedKVCache&) = delete;
+    PagedKVCache& operator=(const PagedKVCache&) = delete;
+    PagedKVCache(PagedKVCache&& other) noexcept;
+    PagedKVCache& operator=(PagedKVCache&& other) noexcept;
+
+    PagedKVCache fork() const;
+
+    // Make room for n more positions and return the first of them
+    int extend(int n);
+    // Store columns [c0, c0 + n) of k and v ([dim x cols]) for `layer` at
+    // positions [pos, pos + n), which must already be covered by extend()
+    void write(int layer, int pos, const Tensor& k, const Tensor& v, int c0, int n);
+    // Drop positions from len on (e.g. rejected speculative tokens),
+    // returning blocks that no longer hold any position
+    void truncate(int len);
+    // Return every block to the pool
+    void clear();
+
+    int length() const { return length_; }
+    int window() const { return window_; }
+    const std::vector<int>& blocks() const { return blocks_; }
+    // Index in blocks() of the oldest block still held
+    int first_block() const { return first_block_; }
+    KVBlockPool& pool() const { return *pool_; }
+
+private:
+    KVBlockPool* pool_;
+    std::vector<int> blocks_;
+    int length_ = 0;
+    int window_ = 0;
+    int first_block_ = 0;
+};
+
+// Columns [col, col + len) of a batched input that continue `cache` at
+// positions [pos, pos + len)
+struct PagedSpan {
+    PagedKVCache* cache;
+    int col;
+    int len;
+    int pos;
+};
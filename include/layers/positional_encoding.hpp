@@ -1,10 +1,14 @@
 #pragma once
 #include "tensor.hpp"
+#include <vector>
 
 class PositionalEncoding {
 public:
     PositionalEncoding(int embed_dim, int max_len = 512);
     Tensor forward(int seq_len) const;
+    // Encodings of arbitrary positions, one column each
+    Tensor forward(const std::vector<int>& positions) const;
+    int max_length() const { return max_len; }
 
 private:
     int embed_dim;
@@ -17,6 +17,19 @@ public:
     std::shared_ptr<ADTensor> apply_ad(const std::shared_ptr<ADTensor>& x,
                                         int pos_offset = 0) const;
 
+    // Rotate every head of x ([num_heads * head_dim x cols], row-major) in
+    // place, column c at position positions[c]; inverse applies the
+    // transposed rotation
+    void rotate(float* x, int rows, int cols, const int* positions,
+                bool inverse = false) const;
+
+    // AD form of rotate for B sequences of seq_len columns packed side by
+    // side; positions restart at 0 in each sequence (seq_len <= 0: one)
+    std::shared_ptr<ADTensor> apply_heads_ad(const std::shared_ptr<ADTensor>& x,
+                                             int seq_len = 0) const;
+
+    int max_len() const { return max_len_; }
+
 private:
     int head_dim_;
     int max_len_;
@@ -26,6 +26,8 @@ public:
 
     void step() { ++step_; }
     int current_step() const { return step_; }
+    // Resume the schedule at step s
+    void set_step(int s) { step_ = s; }
 
 private:
     float base_lr_;
@@ -14,6 +14,12 @@ public:
 
     void deallocate(void* ptr, std::size_t bytes);
 
+    // Bytes currently allocated through the manager, and the high-water mark
+    // since the last reset_peak()
+    std::size_t bytes_in_use();
+    std::size_t peak_bytes();
+    void reset_peak();
+
     UnifiedMemoryManager(const UnifiedMemoryManager&) = delete;
     UnifiedMemoryManager& operator=(const UnifiedMemoryManager&) = delete;
 
@@ -26,4 +32,6 @@ private:
     std::size_t allocated_on_chip_ = 0;
     char* pool_ = nullptr;
     std::unordered_map<void*, std::size_t> allocations_;
+    std::size_t in_use_ = 0;
+    std::size_t peak_ = 0;
 };
\ No newline at end of file
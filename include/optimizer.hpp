@@ -18,6 +18,15 @@ public:
     void step();
     void zero_grad();
     float lr;
+
+    // Moment estimates, one per registered parameter (empty before the first
+    // step), and the number of steps taken; enough to resume exactly
+    int step_count() const { return t; }
+    const std::vector<Tensor>& first_moments() const { return m; }
+    const std::vector<Tensor>& second_moments() const { return v; }
+    // Replace the state with one saved from step_count() and the moments.
+    // Throws std::invalid_argument if m and v do not match the parameters.
+    void restore(int steps, std::vector<Tensor> m_, std::vector<Tensor> v_);
 private:
     float beta1;
     float beta2;
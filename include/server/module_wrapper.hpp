@@ -23,6 +23,10 @@ public:
     virtual std::unordered_map<std::string, PortValue> execute(
         const std::unordered_map<std::string, PortValue>& inputs) = 0;
 
+    // True if execute() runs backward(), which ends the tape's recording
+    // epoch: the executor never runs such a node alongside another
+    virtual bool runs_backward() const { return false; }
+
     json to_catalog_json() const {
         json j;
         j["type"] = type_name();
@@ -1,9 +1,10 @@
 #pragma once
 #include <vector>
-#include "allocator.hpp"
+#include "tensor_storage.hpp"
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <memory>
 #include <numeric>
 #include <stdexcept>
 
@@ -11,7 +12,7 @@ class Tensor {
 public:
     int rows, cols;  // backward compat: set for 2D, -1 otherwise
     std::vector<int> shape;
-    std::vector<float, UnifiedMemoryAllocator<float>> data;
+    TensorStorage data;
 
     // N-dimensional constructor
     Tensor(const std::vector<int>& shape);
@@ -22,6 +23,12 @@ public:
     // 1D constructor (backward compatible)
     Tensor(int size);
 
+    // Tensor viewing existing storage (e.g. a mapped checkpoint) without
+    // copying it; see TensorStorage::view. owner keeps the storage alive
+    // while the tensor refers to it; copies of the tensor own fresh memory.
+    static Tensor adopt(float* ptr, const std::vector<int>& shape,
+                        std::shared_ptr<void> owner);
+
     int ndim() const { return static_cast<int>(shape.size()); }
     int numel() const { return static_cast<int>(data.size()); }
 
@@ -31,6 +38,10 @@ public:
     // 2D operations (assert ndim()==2)
     Tensor matmul(const Tensor& other) const;
     Tensor transpose() const;
+    // C = alpha * op(A) * op(B) + beta * C, op(X) = X or X^T; C must already
+    // have the result shape. Lets callers skip materialising transposes.
+    static void gemm(bool trans_a, bool trans_b, float alpha,
+                     const Tensor& A, const Tensor& B, float beta, Tensor& C);
     float dot(const Tensor& other) const;
 
     Tensor operator+(const Tensor& other) const;
@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "allocator.hpp"
+
+// Element storage of a Tensor: a vector from the unified memory manager, or
+// a view of floats that live elsewhere (a mapped checkpoint) and are kept
+// alive by a shared owner. Views are writable in place; anything that grows
+// or replaces the contents (resize, assign, copy assignment) moves them into
+// owned memory first. A copy always owns fresh memory.
+class TensorStorage {
+public:
+    using value_type = float;
+    using size_type = std::size_t;
+    using iterator = float*;
+    using const_iterator = const float*;
+
+    TensorStorage() = default;
+    explicit TensorStorage(size_type n, float value = 0.0f) : owned_(n, value) { sync(); }
+    TensorStorage(std::initializer_list<float> values) : owned_(values) { sync(); }
+    template <typename It>
+    TensorStorage(It first, It last) : owned_(first, last) { sync(); }
+
+    // n floats at ptr, without copying; owner keeps them alive as long as
+    // this storage (or anything moved from it) refers to them
+    static TensorStorage view(float* ptr, size_type n, std::shared_ptr<void> owner) {
+        TensorStorage s;
+        s.ptr_ = ptr;
+        s.size_ = n;
+        s.owner_ = std::move(owner);
+        return s;
+    }
+
+    TensorStorage(const TensorStorage& other) : owned_(other.begin(), other.end()) { sync(); }
+    TensorStorage(TensorStorage&& other) noexcept { take(std::move(other)); }
+    TensorStorage& operator=(const TensorStorage& other) {
+        if (this != &other) assign(other.begin(), other.end());
+        return *this;
+    }
+    TensorStorage& operator=(TensorStorage&& other) noexcept {
+        if (this != &other) take(std::move(other));
+        return *this;
+    }
+    TensorStorage& operator=(std::initializer_list<float> values) {
+        assign(values.begin(), values.end());
+        return *this;
+    }
+
+    // True while this is a view of external memory
+    bool is_view() const { return owner_ != nullptr; }
+
+    size_type size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    float* data() { return ptr_; }
+    const float* data() const { return ptr_; }
+    float& operator[](size_type i) { return ptr_[i]; }
+    const float& operator[](size_type i) const { return ptr_[i]; }
+    iterator begin() { return ptr_; }
+    iterator end() { return ptr_ + size_; }
+    const_iterator begin() const { return ptr_; }
+    const_iterator end() const { return ptr_ + size_; }
+
+    // Owned storage reuses its capacity; a view is copied out first
+    template <typename It>
+    void assign(It first, It last) {
+        owned_.assign(first, last);
+        owner_.reset();
+        sync();
+    }
+    void assign(size_type n, float value) {
+        owned_.assign(n, value);
+        owner_.reset();
+        sync();
+    }
+    void resize(size_type n, float value = 0.0f) {
+        if (is_view()) {
+            owned_.assign(begin(), begin() + std::min(n, size_));
+            owner_.reset();
+        }
+        owned_.resize(n, value);
+        sync();
+    }
+    void clear() {
+        owned_.clear();
+        owner_.reset();
+        sync();
+    }
+
+    friend bool operator==(const TensorStorage& a, const TensorStorage& b) {
+        return a.size_ == b.size_ && std::equal(a.begin(), a.end(), b.begin());
+    }
+    friend bool operator!=(const TensorStorage& a, const TensorStorage& b) { return !(a == b); }
+
+private:
+    void sync() {
+        ptr_ = owned_.data();
+        size_ = owned_.size();
+    }
+    void take(TensorStorage&& other) {
+        owned_ = std::move(other.owned_);
+        owner_ = std::move(other.owner_);
+        if (owner_) {
+            ptr_ = other.ptr_;
+            size_ = other.size_;
+        } else {
+            sync();
+        }
+        other.owned_.clear();
+        other.owner_.reset();
+        other.sync();
+    }
+
+    std::vector<float, UnifiedMemoryAllocator<float>> owned_;
+    std::shared_ptr<void> owner_;  // set for a view
+    float* ptr_ = nullptr;
+    size_type size_ = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <functional>
+#include <memory>
+
+// Process-wide work-stealing scheduler shared by GEMM, attention heads, MoE
+// experts, per-channel kernels, data-parallel training and graph execution.
+// Every thread that spawns tasks owns a deque: it pushes and pops at the back
+// while idle workers steal from the front. A thread waiting on a group helps
+// by running that group's own tasks and otherwise blocks, so nested parallel
+// regions reuse the same workers and never oversubscribe the machine.
+//
+// Tasks inherit the spawning thread's autodiff state (tape, NoGradGuard,
+// gradient shard), so ops recorded inside a task land on the spawner's tape.
+namespace parallel {
+
+// Worker threads plus the calling thread
+int num_threads();
+// Resize the pool (n <= 0: hardware concurrency). Call while no tasks are
+// in flight.
+void set_num_threads(int n);
+
+// Pin worker i to core (i + 1) mod hardware_concurrency, leaving core 0 to
+// the main thread. Linux only; a no-op elsewhere. Restarts the workers.
+void set_pinning(bool pin);
+bool pinning();
+
+namespace detail {
+struct GroupState;
+}
+
+// Set of tasks that are waited on together. wait() rethrows the first
+// exception thrown by a task; the destructor waits but swallows errors.
+class TaskGroup {
+public:
+    TaskGroup();
+    ~TaskGroup();
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void run(std::function<void()> fn);
+    void wait();
+
+private:
+    std::unique_ptr<detail::GroupState> state_;
+};
+
+// Call fn(lo, hi) over disjoint chunks covering [begin, end), each at least
+// grain long (except possibly the last). Runs inline when the range fits in
+// one chunk or the pool has a single thread.
+void parallel_for(int begin, int end, int grain,
+                  const std::function<void(int, int)>& fn);
+
+} // namespace parallel
@@ -16,6 +16,9 @@ public:
 
     TransformerBlock(int input_dim, int hidden_dim, int n_heads);
     Tensor forward(const Tensor& input, bool training = false, bool use_cache = false);
+    // Inference step for a batch of paged sequences (see MultiHeadAttention)
+    Tensor forward(const Tensor& input, const std::vector<PagedSpan>& spans, int layer);
+    void reserve_cache(int capacity, bool sliding = false);
     void clear_cache();
 };
 
@@ -24,6 +27,17 @@ public:
     Transformer(int num_layers, int input_dim, int hidden_dim,
                int n_heads);
     Tensor forward(const Tensor& input, bool training = false, bool use_cache = false);
+    // Append input's columns to one sequence's paged cache and run them.
+    // Each session keeps its own PagedKVCache over a KVBlockPool built with
+    // (blocks.size(), input_dim, ...), so one model serves many sequences.
+    Tensor forward(const Tensor& input, PagedKVCache& paged);
+    // Batched form: input's columns are split into consecutive runs of
+    // lens[i] columns continuing seqs[i]. LayerNorm, projections and the FFN
+    // run once over all columns; attention runs per sequence.
+    Tensor forward(const Tensor& input, const std::vector<PagedKVCache*>& seqs,
+                   const std::vector<int>& lens);
+    // Preallocate every layer's KV cache (see MultiHeadAttention::reserve_cache)
+    void reserve_cache(int capacity, bool sliding = false);
     void clear_cache();
 
     std::vector<TransformerBlock> blocks;
@@ -1,89 +1,308 @@
 #include "autodiff.hpp"
-#include <functional>
-#include <vector>
+#include "gemm.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <string>
 #include <unordered_set>
+#include <vector>
 #include <mutex>
 
-ADTensor::ADTensor(int rows, int cols)
-    : val(rows, cols), grad(rows, cols) {
-    grad.fill(0.0f);
+// Tape implementation
+namespace {
+
+struct TapeRecord {
+    std::shared_ptr<ADTensor> out;
+    tape::Thunk run;      // null once the step has been applied
+    tape::Thunk destroy;
+    void* ctx;
+};
+
+// Bump allocator for backward closures. Blocks are kept across clears so a
+// steady-state training step allocates nothing here.
+class TapeArena {
+public:
+    void* alloc(std::size_t size, std::size_t align) {
+        for (;;) {
+            if (block_ < blocks_.size()) {
+                Block& b = blocks_[block_];
+                std::size_t off = (offset_ + align - 1) / align * align;
+                if (off + size <= b.size) {
+                    offset_ = off + size;
+                    return b.mem.get() + off;
+                }
+                if (block_ + 1 < blocks_.size()) {
+                    ++block_;
+                    offset_ = 0;
+                    continue;
+                }
+            }
+            std::size_t sz = std::max(kBlockSize, size + align);
+            blocks_.push_back({std::unique_ptr<unsigned char[]>(new unsigned char[sz]), sz});
+            block_ = blocks_.size() - 1;
+            offset_ = 0;
+        }
+    }
+    void reset() {
+        block_ = 0;
+        offset_ = 0;
+    }
+
+private:
+    static constexpr std::size_t kBlockSize = 64 * 1024;
+    struct Block {
+        std::unique_ptr<unsigned char[]> mem;
+        std::size_t size;
+    };
+    std::vector<Block> blocks_;
+    std::size_t block_ = 0;
+    std::size_t offset_ = 0;
+};
+
+// Epochs are unique across threads so a node can tell whether it belongs
+// to the tape it is being used on
+std::atomic<unsigned> tape_epochs{0};
+
+struct Tape {
+    // Pool tasks bound to this tape record concurrently with its owner
+    std::recursive_mutex mu;
+    std::vector<TapeRecord> records;
+    std::vector<std::shared_ptr<ADTensor>> retained;  // leaves used by records
+    TapeArena arena;
+    std::size_t pending = 0;
+    unsigned epoch = ++tape_epochs;
+
+    ~Tape() { clear(); }
+
+    bool holds(const ADTensor* x) const {
+        return x->tape_epoch == epoch && x->tape_pos >= 0;
+    }
+
+    void clear() {
+        for (auto it = records.rbegin(); it != records.rend(); ++it) {
+            it->destroy(it->ctx);
+        }
+        records.clear();
+        retained.clear();
+        arena.reset();
+        pending = 0;
+        epoch = ++tape_epochs;
+    }
+};
+
+Tape& own_tape() {
+    thread_local Tape t;
+    return t;
 }
 
-ADTensor::ADTensor(const Tensor& t)
-    : val(t), grad(t.shape) {
-    grad.fill(0.0f);
+// Tape borrowed from another thread through tape::bind()
+thread_local Tape* bound_tape = nullptr;
+
+Tape& current_tape() {
+    return bound_tape ? *bound_tape : own_tape();
+}
+
+// record_backward() for a runtime list of inputs
+template <typename Fn>
+void record_backward_list(const std::shared_ptr<ADTensor>& out, Fn&& fn,
+                          const std::vector<std::shared_ptr<ADTensor>>& inputs) {
+    bool any = false;
+    if (grad_enabled()) {
+        for (auto& x : inputs) any = any || x->requires_grad;
+    }
+    if (!any) {
+        out->requires_grad = false;
+        return;
+    }
+    for (auto& x : inputs) tape::retain(x);
+    using F = std::decay_t<Fn>;
+    void* ctx = new (tape::alloc(sizeof(F), alignof(F))) F(std::forward<Fn>(fn));
+    tape::push(out,
+               [](void* p) { (*static_cast<F*>(p))(); },
+               [](void* p) { static_cast<F*>(p)->~F(); },
+               ctx);
+}
+
+} // namespace
+
+namespace tape {
+
+void* alloc(std::size_t size, std::size_t align) {
+    Tape& t = current_tape();
+    std::lock_guard<std::recursive_mutex> lock(t.mu);
+    return t.arena.alloc(size, align);
+}
+
+void retain(const std::shared_ptr<ADTensor>& x) {
+    Tape& t = current_tape();
+    std::lock_guard<std::recursive_mutex> lock(t.mu);
+    if (!t.holds(x.get())) t.retained.push_back(x);
+}
+
+void push(const std::shared_ptr<ADTensor>& out, Thunk run, Thunk destroy, void* ctx) {
+    Tape& t = current_tape();
+    std::lock_guard<std::recursive_mutex> lock(t.mu);
+    out->requires_grad = true;
+    out->tape_pos = static_cast<int>(t.records.size());
+    out->tape_epoch = t.epoch;
+    t.records.push_back({out, run, destroy, ctx});
+    ++t.pending;
+}
+
+Context capture() {
+    return {&current_tape(), grad_mode, grad_shard};
 }
 
+void* bind(void* t) {
+    Tape* prev = bound_tape;
+    bound_tape = static_cast<Tape*>(t);
+    return prev;
+}
+
+} // namespace tape
+
+void clear_tape() {
+    Tape& t = current_tape();
+    std::lock_guard<std::recursive_mutex> lock(t.mu);
+    t.clear();
+}
+
+std::size_t tape_size() {
+    Tape& t = current_tape();
+    std::lock_guard<std::recursive_mutex> lock(t.mu);
+    return t.records.size();
+}
+
+ADTensor::ADTensor(int rows, int cols)
+    : val(rows, cols), grad(std::vector<int>{}) {}
+
+ADTensor::ADTensor(const Tensor& t)
+    : val(t), grad(std::vector<int>{}) {}
+
 ADTensor::ADTensor(const std::vector<int>& shape)
-    : val(shape), grad(shape) {
-    grad.fill(0.0f);
+    : val(shape), grad(std::vector<int>{}) {}
+
+ADTensor::ADTensor(Tensor&& t, bool requires_grad)
+    : val(std::move(t)), grad(std::vector<int>{}), requires_grad(requires_grad) {}
+
+Tensor& ADTensor::ensure_grad() {
+    if (grad.data.size() != val.data.size()) grad = Tensor(val.shape);
+    return grad;
 }
 
 void ADTensor::backward() {
     // Initialize gradient of the root node
-    grad.fill(1.0f);
-    // Build topological order
-    std::vector<ADTensor*> topo;
-    std::unordered_set<ADTensor*> visited;
-    std::function<void(ADTensor*)> dfs = [&](ADTensor* node) {
-        if (!visited.insert(node).second) return;
-        for (auto& dep : node->deps) {
-            dfs(dep.first.get());
-        }
-        topo.push_back(node);
-    };
-    dfs(this);
-    // Backpropagate in reverse topological order
-    for (auto it = topo.rbegin(); it != topo.rend(); ++it) {
-        ADTensor* node = *it;
-        for (auto& dep : node->deps) {
-            // dep.second applies local gradient to dep.first->grad
-            dep.second();
-        }
-    }
-    // Clear dependencies to release the computation graph and free memory
-    for (ADTensor* node : topo) {
-        node->deps.clear();
+    ensure_grad().fill(1.0f);
+    Tape& t = current_tape();
+    std::lock_guard<std::recursive_mutex> lock(t.mu);
+    if (!t.holds(this)) return;
+    // Records are appended in creation order, so walking back from the root
+    // visits every node after all of its consumers. Records the root's
+    // gradient never reached have no grad buffer and are skipped.
+    for (int i = tape_pos; i >= 0; --i) {
+        TapeRecord& r = t.records[i];
+        if (!r.run || r.out->grad.data.empty()) continue;
+        tape::Thunk run = r.run;
+        r.run = nullptr;
+        --t.pending;
+        run(r.ctx);
     }
+    // Release the step once every record has been applied
+    if (t.pending == 0) t.clear();
 }
 
 std::shared_ptr<ADTensor> make_ad(const Tensor& t) {
     return std::make_shared<ADTensor>(t);
 }
+
+std::shared_ptr<ADTensor> make_const(const Tensor& t) {
+    return std::make_shared<ADTensor>(Tensor(t), false);
+}
+
+std::shared_ptr<ADTensor> make_op_result(Tensor&& t) {
+    return std::make_shared<ADTensor>(std::move(t), true);
+}
 // Parameter registry implementation
 namespace {
     std::vector<std::shared_ptr<ADTensor>> param_list;
+    std::vector<std::string> param_names;
+    std::unordered_set<std::string> taken_names;
     std::mutex param_mutex;
+    thread_local std::string scope_prefix;
 }
-void register_parameter(const std::shared_ptr<ADTensor>& p) {
+void register_parameter(const std::shared_ptr<ADTensor>& p, const std::string& name) {
     std::lock_guard<std::mutex> lock(param_mutex);
+    std::string full = scope_prefix +
+        (name.empty() ? "param" + std::to_string(param_list.size()) : name);
+    if (taken_names.count(full)) {
+        int n = 1;
+        while (taken_names.count(full + "." + std::to_string(n))) ++n;
+        full += "." + std::to_string(n);
+    }
+    taken_names.insert(full);
     param_list.push_back(p);
+    param_names.push_back(std::move(full));
 }
 std::vector<std::shared_ptr<ADTensor>>& get_parameters() {
     return param_list;
 }
+const std::vector<std::string>& parameter_names() {
+    return param_names;
+}
 void clear_parameters() {
     std::lock_guard<std::mutex> lock(param_mutex);
     param_list.clear();
+    param_names.clear();
+    taken_names.clear();
+}
+
+ParameterScope::ParameterScope(const std::string& name)
+    : outer_len_(scope_prefix.size()) {
+    scope_prefix += name + ".";
+}
+
+ParameterScope::~ParameterScope() {
+    scope_prefix.resize(outer_len_);
+}
+
+void allocate_grad_shards(int n) {
+    std::lock_guard<std::mutex> lock(param_mutex);
+    for (auto& p : param_list) {
+        size_t want = n > 1 ? static_cast<size_t>(n - 1) : 0;
+        if (p->grad_shards.size() == want) continue;
+        p->grad_shards.assign(want, Tensor(p->val.shape));
+        for (auto& g : p->grad_shards) g.fill(0.0f);
+    }
+}
+
+void reduce_grad_shards() {
+    std::lock_guard<std::mutex> lock(param_mutex);
+    for (auto& p : param_list) {
+        if (p->grad_shards.empty()) continue;
+        Tensor& g = p->ensure_grad();
+        for (auto& s : p->grad_shards) {
+            for (size_t i = 0; i < g.data.size(); ++i) g.data[i] += s.data[i];
+            s.fill(0.0f);
+        }
+    }
 }
 
 std::shared_ptr<ADTensor> add(const std::shared_ptr<ADTensor>& a,
                               const std::shared_ptr<ADTensor>& b) {
     // elementwise addition
-    Tensor v = a->val + b->val;
-    auto out = std::make_shared<ADTensor>(v);
-    // grad_a += grad_out
-    out->deps.emplace_back(a, [a, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
-            a->grad.data[i] += out->grad.data[i];
+    auto out = make_op_result(a->val + b->val);
+    // grad_a += grad_out, grad_b += grad_out
+    record_backward(out, [a = a.get(), b = b.get(), out = out.get()]() {
+        const auto& go = out->grad.data;
+        if (Tensor* ga = grad_of(a)) {
+            for (size_t i = 0; i < go.size(); ++i) ga->data[i] += go[i];
         }
-    });
-    // grad_b += grad_out
-    out->deps.emplace_back(b, [b, out]() {
-        for (size_t i = 0; i < b->grad.data.size(); ++i) {
-            b->grad.data[i] += out->grad.data[i];
+        if (Tensor* gb = grad_of(b)) {
+            for (size_t i = 0; i < go.size(); ++i) gb->data[i] += go[i];
         }
-    });
+    }, a, b);
     return out;
 }
 // natural logarithm
@@ -92,27 +311,30 @@ std::shared_ptr<ADTensor> log_ad(const std::shared_ptr<ADTensor>& a) {
     for (size_t i = 0; i < v.data.size(); ++i) {
         v.data[i] = std::log(a->val.data[i]);
     }
-    auto out = std::make_shared<ADTensor>(v);
-    out->deps.emplace_back(a, [a, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [a = a.get(), out = out.get()]() {
+        Tensor* ga = grad_of(a);
+        for (size_t i = 0; i < ga->data.size(); ++i) {
             // d/dx log(x) = 1/x
-            a->grad.data[i] += out->grad.data[i] / a->val.data[i];
+            ga->data[i] += out->grad.data[i] / a->val.data[i];
         }
-    });
+    }, a);
     return out;
 }
 // Transpose an ADTensor
 std::shared_ptr<ADTensor> transpose(const std::shared_ptr<ADTensor>& a) {
-    Tensor v = a->val.transpose();
-    auto out = std::make_shared<ADTensor>(v);
-    out->deps.emplace_back(a, [a, out]() {
-        // a->grad += out->grad^T
-        Tensor go = out->grad;
-        Tensor goT = go.transpose();
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
-            a->grad.data[i] += goT.data[i];
+    auto out = make_op_result(a->val.transpose());
+    record_backward(out, [a = a.get(), out = out.get()]() {
+        // a->grad += out->grad^T, without materialising the transpose
+        const int r = a->val.rows, c = a->val.cols;
+        const float* go = out->grad.data.data();
+        float* ga = grad_of(a)->data.data();
+        for (int i = 0; i < r; ++i) {
+            for (int j = 0; j < c; ++j) {
+                ga[i * c + j] += go[j * r + i];
+            }
         }
-    });
+    }, a);
     return out;
 }
 // Slice rows [row_offset .. row_offset+row_count) of a
@@ -125,16 +347,17 @@ std::shared_ptr<ADTensor> slice(const std::shared_ptr<ADTensor>& a,
             v.data[i * cols + j] = a->val.data[(row_offset + i) * cols + j];
         }
     }
-    auto out = std::make_shared<ADTensor>(v);
-    out->deps.emplace_back(a, [a, out, row_offset, row_count]() {
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [a = a.get(), out = out.get(), row_offset, row_count]() {
         int cols = a->val.cols;
+        Tensor* ga = grad_of(a);
         for (int i = 0; i < row_count; ++i) {
             for (int j = 0; j < cols; ++j) {
-                a->grad.data[(row_offset + i) * cols + j] +=
+                ga->data[(row_offset + i) * cols + j] +=
                     out->grad.data[i * cols + j];
             }
         }
-    });
+    }, a);
     return out;
 }
 // Concatenate parts vertically (row-wise)
@@ -156,23 +379,659 @@ std::shared_ptr<ADTensor> concat(const std::vector<std::shared_ptr<ADTensor>>& p
         }
         row_off += p->val.rows;
     }
-    auto out = std::make_shared<ADTensor>(v);
+    auto out = make_op_result(std::move(v));
+    std::vector<ADTensor*> ps;
+    ps.reserve(parts.size());
+    for (auto& p : parts) ps.push_back(p.get());
+    record_backward_list(out, [ps = std::move(ps), out = out.get(), cols]() {
+        int row_off = 0;
+        for (ADTensor* p : ps) {
+            if (Tensor* gp = grad_of(p)) {
+                for (int i = 0; i < p->val.rows; ++i) {
+                    for (int j = 0; j < cols; ++j) {
+                        gp->data[i * cols + j] +=
+                            out->grad.data[(row_off + i) * cols + j];
+                    }
+                }
+            }
+            row_off += p->val.rows;
+        }
+    }, parts);
+    return out;
+}
+std::shared_ptr<ADTensor> slice_cols(const std::shared_ptr<ADTensor>& a,
+                                     int col_offset, int col_count) {
+    int rows = a->val.rows, cols = a->val.cols;
+    if (col_offset < 0 || col_count < 0 || col_offset + col_count > cols)
+        throw std::out_of_range("slice_cols: range exceeds tensor columns");
+    Tensor v(rows, col_count);
+    for (int i = 0; i < rows; ++i) {
+        const float* src = a->val.data.data() + static_cast<size_t>(i) * cols + col_offset;
+        std::copy(src, src + col_count, v.data.begin() + static_cast<size_t>(i) * col_count);
+    }
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [a = a.get(), out = out.get(), col_offset, col_count, rows, cols]() {
+        Tensor* ga = grad_of(a);
+        for (int i = 0; i < rows; ++i) {
+            float* dst = ga->data.data() + static_cast<size_t>(i) * cols + col_offset;
+            const float* go = out->grad.data.data() + static_cast<size_t>(i) * col_count;
+            for (int j = 0; j < col_count; ++j) dst[j] += go[j];
+        }
+    }, a);
+    return out;
+}
+// Concatenate parts horizontally (column-wise)
+std::shared_ptr<ADTensor> concat_cols(const std::vector<std::shared_ptr<ADTensor>>& parts) {
+    if (parts.empty()) throw std::runtime_error("concat_cols: no parts");
+    int rows = parts[0]->val.rows;
+    int total_cols = 0;
+    for (auto& p : parts) {
+        if (p->val.rows != rows) throw std::runtime_error("concat_cols: mismatched rows");
+        total_cols += p->val.cols;
+    }
+    Tensor v(rows, total_cols);
+    int col_off = 0;
     for (auto& p : parts) {
-        int row_off_p = 0;
-        for (auto& prev : parts) {
-            if (prev.get() == p.get()) break;
-            row_off_p += prev->val.rows;
-        }
-        out->deps.emplace_back(p, [p, out, row_off_p]() {
-            int cols = p->val.cols;
-            for (int i = 0; i < p->val.rows; ++i) {
-                for (int j = 0; j < cols; ++j) {
-                    p->grad.data[i * cols + j] +=
-                        out->grad.data[(row_off_p + i) * cols + j];
+        int pc = p->val.cols;
+        for (int i = 0; i < rows; ++i) {
+            std::copy(p->val.data.begin() + static_cast<size_t>(i) * pc,
+                      p->val.data.begin() + static_cast<size_t>(i + 1) * pc,
+                      v.data.begin() + static_cast<size_t>(i) * total_cols + col_off);
+        }
+        col_off += pc;
+    }
+    auto out = make_op_result(std::move(v));
+    std::vector<ADTensor*> ps;
+    ps.reserve(parts.size());
+    for (auto& p : parts) ps.push_back(p.get());
+    record_backward_list(out, [ps = std::move(ps), out = out.get(), rows, total_cols]() {
+        int col_off = 0;
+        for (ADTensor* p : ps) {
+            int pc = p->val.cols;
+            if (Tensor* gp = grad_of(p)) {
+                for (int i = 0; i < rows; ++i) {
+                    const float* go = out->grad.data.data() + static_cast<size_t>(i) * total_cols + col_off;
+                    float* dst = gp->data.data() + static_cast<size_t>(i) * pc;
+                    for (int j = 0; j < pc; ++j) dst[j] += go[j];
+                }
+            }
+            col_off += pc;
+        }
+    }, parts);
+    return out;
+}
+// x + b with b [R x 1] repeated across columns
+std::shared_ptr<ADTensor> add_bias_broadcast(const std::shared_ptr<ADTensor>& x,
+                                             const std::shared_ptr<ADTensor>& b) {
+    int rows = x->val.rows, cols = x->val.cols;
+    if (b->val.numel() != rows) throw std::runtime_error("add_bias_broadcast: bias size mismatch");
+    Tensor v = x->val;
+    for (int i = 0; i < rows; ++i) {
+        float bi = b->val.data[i];
+        float* vi = v.data.data() + static_cast<size_t>(i) * cols;
+        for (int j = 0; j < cols; ++j) vi[j] += bi;
+    }
+    auto out = make_op_result(std::move(v));
+    // grad_x += grad_out, grad_b += row sums of grad_out
+    record_backward(out, [x = x.get(), b = b.get(), out = out.get(), rows, cols]() {
+        const float* go = out->grad.data.data();
+        if (Tensor* gx = grad_of(x)) {
+            for (size_t i = 0; i < gx->data.size(); ++i) gx->data[i] += go[i];
+        }
+        if (Tensor* gb = grad_of(b)) {
+            for (int i = 0; i < rows; ++i) {
+                float s = 0.0f;
+                for (int j = 0; j < cols; ++j) s += go[i * cols + j];
+                gb->data[i] += s;
+            }
+        }
+    }, x, b);
+    return out;
+}
+// [R x C] -> [R x 1]
+std::shared_ptr<ADTensor> sum_rows(const std::shared_ptr<ADTensor>& x) {
+    int rows = x->val.rows, cols = x->val.cols;
+    Tensor v(rows, 1);
+    for (int i = 0; i < rows; ++i) {
+        const float* xi = x->val.data.data() + static_cast<size_t>(i) * cols;
+        float s = 0.0f;
+        for (int j = 0; j < cols; ++j) s += xi[j];
+        v.data[i] = s;
+    }
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [x = x.get(), out = out.get(), rows, cols]() {
+        float* gx = grad_of(x)->data.data();
+        for (int i = 0; i < rows; ++i) {
+            float g = out->grad.data[i];
+            for (int j = 0; j < cols; ++j) gx[i * cols + j] += g;
+        }
+    }, x);
+    return out;
+}
+
+// Shared body of sum_cols / mean_cols: [R x C] -> [1 x C] scaled by s
+static std::shared_ptr<ADTensor> scaled_col_sum(const std::shared_ptr<ADTensor>& x, float s) {
+    int rows = x->val.rows, cols = x->val.cols;
+    Tensor v(1, cols);
+    for (int i = 0; i < rows; ++i) {
+        const float* xi = x->val.data.data() + static_cast<size_t>(i) * cols;
+        for (int j = 0; j < cols; ++j) v.data[j] += xi[j];
+    }
+    if (s != 1.0f) for (auto& e : v.data) e *= s;
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [x = x.get(), out = out.get(), rows, cols, s]() {
+        float* gx = grad_of(x)->data.data();
+        const float* go = out->grad.data.data();
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) gx[i * cols + j] += s * go[j];
+        }
+    }, x);
+    return out;
+}
+
+std::shared_ptr<ADTensor> sum_cols(const std::shared_ptr<ADTensor>& x) {
+    return scaled_col_sum(x, 1.0f);
+}
+
+std::shared_ptr<ADTensor> mean_cols(const std::shared_ptr<ADTensor>& x) {
+    return scaled_col_sum(x, 1.0f / x->val.rows);
+}
+// [R x 1] -> [R x n]
+std::shared_ptr<ADTensor> broadcast_col(const std::shared_ptr<ADTensor>& v, int n) {
+    int rows = v->val.numel();
+    Tensor r(rows, n);
+    for (int i = 0; i < rows; ++i) {
+        std::fill(r.data.begin() + static_cast<size_t>(i) * n,
+                  r.data.begin() + static_cast<size_t>(i + 1) * n, v->val.data[i]);
+    }
+    auto out = make_op_result(std::move(r));
+    record_backward(out, [v = v.get(), out = out.get(), rows, n]() {
+        Tensor* gv = grad_of(v);
+        const float* go = out->grad.data.data();
+        for (int i = 0; i < rows; ++i) {
+            float s = 0.0f;
+            for (int j = 0; j < n; ++j) s += go[i * n + j];
+            gv->data[i] += s;
+        }
+    }, v);
+    return out;
+}
+// [1 x C] -> [n x C]
+std::shared_ptr<ADTensor> broadcast_row(const std::shared_ptr<ADTensor>& v, int n) {
+    int cols = v->val.numel();
+    Tensor r(n, cols);
+    for (int i = 0; i < n; ++i) {
+        std::copy(v->val.data.begin(), v->val.data.end(),
+                  r.data.begin() + static_cast<size_t>(i) * cols);
+    }
+    auto out = make_op_result(std::move(r));
+    record_backward(out, [v = v.get(), out = out.get(), cols, n]() {
+        float* gv = grad_of(v)->data.data();
+        const float* go = out->grad.data.data();
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < cols; ++j) gv[j] += go[i * cols + j];
+        }
+    }, v);
+    return out;
+}
+// Softmax over n lines of len elements each; element k of line l sits at
+// l * line_stride + k * elem_stride
+static void softmax_lines(const float* x, float* y, int n, int len,
+                          int line_stride, int elem_stride, float scale,
+                          const float* bias, int causal_offset) {
+    for (int l = 0; l < n; ++l) {
+        const float* xl = x + static_cast<size_t>(l) * line_stride;
+        const float* bl = bias ? bias + static_cast<size_t>(l) * line_stride : nullptr;
+        float* yl = y + static_cast<size_t>(l) * line_stride;
+        int valid = causal_offset >= 0 ? std::min(len, l + causal_offset + 1) : len;
+        float mx = -std::numeric_limits<float>::infinity();
+        for (int k = 0; k < valid; ++k) {
+            float v = scale * xl[k * elem_stride] + (bl ? bl[k * elem_stride] : 0.0f);
+            yl[k * elem_stride] = v;
+            mx = std::max(mx, v);
+        }
+        float s = 0.0f;
+        for (int k = 0; k < valid; ++k) {
+            float e = std::exp(yl[k * elem_stride] - mx);
+            yl[k * elem_stride] = e;
+            s += e;
+        }
+        float inv = 1.0f / s;
+        for (int k = 0; k < valid; ++k) yl[k * elem_stride] *= inv;
+        for (int k = valid; k < len; ++k) yl[k * elem_stride] = 0.0f;
+    }
+}
+
+// dx = scale * y * (dy - sum(dy * y)) along each line
+static void softmax_lines_backward(const float* y, const float* dy, float* dx,
+                                   int n, int len, int line_stride, int elem_stride,
+                                   float scale) {
+    for (int l = 0; l < n; ++l) {
+        size_t base = static_cast<size_t>(l) * line_stride;
+        float dot = 0.0f;
+        for (int k = 0; k < len; ++k) dot += dy[base + k * elem_stride] * y[base + k * elem_stride];
+        for (int k = 0; k < len; ++k) {
+            size_t idx = base + k * elem_stride;
+            dx[idx] += scale * y[idx] * (dy[idx] - dot);
+        }
+    }
+}
+
+std::shared_ptr<ADTensor> softmax_ad(const std::shared_ptr<ADTensor>& x, bool causal,
+                                     const Tensor* bias, float scale) {
+    int rows = x->val.rows, cols = x->val.cols;
+    if (bias && (bias->rows != rows || bias->cols != cols))
+        throw std::runtime_error("softmax_ad: bias shape mismatch");
+    if (causal && cols < rows)
+        throw std::runtime_error("softmax_ad: causal mask needs cols >= rows");
+    Tensor y(rows, cols);
+    softmax_lines(x->val.data.data(), y.data.data(), rows, cols, cols, 1, scale,
+                  bias ? bias->data.data() : nullptr, causal ? cols - rows : -1);
+    auto out = make_op_result(std::move(y));
+    record_backward(out, [x = x.get(), out = out.get(), rows, cols, scale]() {
+        softmax_lines_backward(out->val.data.data(), out->grad.data.data(),
+                               grad_of(x)->data.data(), rows, cols, cols, 1, scale);
+    }, x);
+    return out;
+}
+
+std::shared_ptr<ADTensor> softmax_cols_ad(const std::shared_ptr<ADTensor>& x) {
+    int rows = x->val.rows, cols = x->val.cols;
+    Tensor y(rows, cols);
+    softmax_lines(x->val.data.data(), y.data.data(), cols, rows, 1, cols, 1.0f, nullptr, -1);
+    auto out = make_op_result(std::move(y));
+    record_backward(out, [x = x.get(), out = out.get(), rows, cols]() {
+        softmax_lines_backward(out->val.data.data(), out->grad.data.data(),
+                               grad_of(x)->data.data(), cols, rows, 1, cols, 1.0f);
+    }, x);
+    return out;
+}
+
+// Head/sequence geometry shared by the attention kernels; see attention_ad
+struct AttentionShape {
+    int hd, kv_heads, group, T, batch, total;
+};
+
+static AttentionShape attention_shape(const ADTensor& q, const ADTensor& k,
+                                      const ADTensor& v, int num_heads, int seq_len,
+                                      const char* op) {
+    std::string name(op);
+    int q_rows = q.val.rows, total = q.val.cols;
+    if (num_heads <= 0 || q_rows % num_heads != 0)
+        throw std::runtime_error(name + ": q rows must split into num_heads");
+    int hd = q_rows / num_heads;
+    int kv_rows = k.val.rows;
+    if (v.val.rows != kv_rows || kv_rows % hd != 0 || num_heads % (kv_rows / hd) != 0)
+        throw std::runtime_error(name + ": k/v rows must be a divisor of num_heads heads");
+    if (k.val.cols != total || v.val.cols != total)
+        throw std::runtime_error(name + ": q, k and v column counts differ");
+    if (seq_len <= 0) seq_len = total;
+    if (total % seq_len != 0)
+        throw std::runtime_error(name + ": columns must be a multiple of seq_len");
+    int kv_heads = kv_rows / hd;
+    return {hd, kv_heads, num_heads / kv_heads, seq_len, total / seq_len, total};
+}
+
+// Query rows per block in attention_ad. Under the causal mask a block only
+// computes scores for the keys its last row can see.
+constexpr int kAttentionRowBlock = 32;
+
+// In-place softmax of scale * s - slope * |i - j| for query rows
+// [i0, i0 + br) of S (row stride ld) over keys [0, nk). With causal, keys
+// past each row's own position are zeroed.
+static void attention_softmax_rows(float* S, int br, int nk, int ld, int i0,
+                                   float scale, float slope, bool causal) {
+    for (int i = 0; i < br; ++i) {
+        int gi = i0 + i;
+        float* row = S + static_cast<std::size_t>(i) * ld;
+        int valid = causal ? std::min(nk, gi + 1) : nk;
+        float mx = -std::numeric_limits<float>::infinity();
+        for (int j = 0; j < valid; ++j) {
+            float v = scale * row[j] - slope * static_cast<float>(std::abs(j - gi));
+            row[j] = v;
+            mx = std::max(mx, v);
+        }
+        float sum = 0.0f;
+        for (int j = 0; j < valid; ++j) {
+            row[j] = std::exp(row[j] - mx);
+            sum += row[j];
+        }
+        float inv = 1.0f / sum;
+        for (int j = 0; j < valid; ++j) row[j] *= inv;
+        for (int j = valid; j < nk; ++j) row[j] = 0.0f;
+    }
+}
+
+std::shared_ptr<ADTensor> attention_ad(const std::shared_ptr<ADTensor>& q,
+                                       const std::shared_ptr<ADTensor>& k,
+                                       const std::shared_ptr<ADTensor>& v,
+                                       int num_heads, int seq_len, bool causal,
+                                       float scale, const std::vector<float>* alibi) {
+    const AttentionShape sh = attention_shape(*q, *k, *v, num_heads, seq_len, "attention_ad");
+    const int hd = sh.hd, kv_heads = sh.kv_heads, group = sh.group, T = sh.T;
+    const int batch = sh.batch, total = sh.total, q_rows = q->val.rows;
+    const std::size_t TT = static_cast<std::size_t>(T) * T;
+    if (alibi && static_cast<int>(alibi->size()) != num_heads)
+        throw std::runtime_error("attention_ad: need one ALiBi slope per head");
+    std::vector<float> slopes = alibi ? *alibi : std::vector<float>(num_heads, 0.0f);
+    const int rb = causal ? std::min(kAttentionRowBlock, T) : T;
+    const std::size_t ld = total;
+    const float* Q = q->val.data.data();
+    const float* K = k->val.data.data();
+    const float* V = v->val.data.data();
+
+    // Probabilities per (sequence, head); under the mask only the key prefix
+    // of each row block is written or read
+    std::vector<float> probs(static_cast<std::size_t>(batch) * num_heads * TT);
+    Tensor o(q_rows, total);
+    float* O = o.data.data();
+    parallel::parallel_for(0, batch * num_heads, 1, [&](int lo, int hi) {
+        for (int t = lo; t < hi; ++t) {
+            int b = t / num_heads, h = t % num_heads, kh = h / group;
+            std::size_t q_off = h * hd * ld + b * T, kv_off = kh * hd * ld + b * T;
+            for (int i0 = 0; i0 < T; i0 += rb) {
+                int br = std::min(rb, T - i0);
+                int nk = causal ? i0 + br : T;
+                float* P = probs.data() + t * TT + static_cast<std::size_t>(i0) * T;
+                gemm::sgemm(true, false, br, nk, hd, 1.0f, Q + q_off + i0, total,
+                            K + kv_off, total, 0.0f, P, T);
+                attention_softmax_rows(P, br, nk, T, i0, scale, slopes[h], causal);
+                gemm::sgemm(false, true, hd, br, nk, 1.0f, V + kv_off, total, P, T,
+                            0.0f, O + q_off + i0, total);
+            }
+        }
+    });
+
+    auto out = make_op_result(std::move(o));
+    record_backward(out, [q = q.get(), k = k.get(), v = v.get(), out = out.get(),
+                          probs = std::move(probs), num_heads, kv_heads, group, hd,
+                          T, TT, rb, batch, total, ld, scale, causal]() {
+        Tensor* gq = grad_of(q);
+        Tensor* gk = grad_of(k);
+        Tensor* gv = grad_of(v);
+        const float* dO = out->grad.data.data();
+        const float* Q = q->val.data.data();
+        const float* K = k->val.data.data();
+        const float* V = v->val.data.data();
+        // Query heads sharing a KV head accumulate into the same dK/dV
+        // block, so each task owns one (sequence, KV head) pair
+        parallel::parallel_for(0, batch * kv_heads, 1, [&](int lo, int hi) {
+            std::vector<float> dS(static_cast<std::size_t>(rb) * T);
+            for (int t = lo; t < hi; ++t) {
+                int b = t / kv_heads, kh = t % kv_heads;
+                std::size_t kv_off = kh * hd * ld + b * T;
+                for (int h = kh * group; h < (kh + 1) * group; ++h) {
+                    std::size_t q_off = h * hd * ld + b * T;
+                    const float* Ph = probs.data() + (static_cast<std::size_t>(b) * num_heads + h) * TT;
+                    for (int i0 = 0; i0 < T; i0 += rb) {
+                        int br = std::min(rb, T - i0);
+                        int nk = causal ? i0 + br : T;
+                        const float* P = Ph + static_cast<std::size_t>(i0) * T;
+                        if (gv) {
+                            gemm::sgemm(false, false, hd, nk, br, 1.0f, dO + q_off + i0, total,
+                                        P, T, 1.0f, gv->data.data() + kv_off, total);
+                        }
+                        if (!gq && !gk) continue;
+                        // dS = scale * P * (dP - rowdot(dP, P)), dP = dO^T V
+                        gemm::sgemm(true, false, br, nk, hd, 1.0f, dO + q_off + i0, total,
+                                    V + kv_off, total, 0.0f, dS.data(), nk);
+                        for (int i = 0; i < br; ++i) {
+                            const float* pi = P + static_cast<std::size_t>(i) * T;
+                            float* di = dS.data() + static_cast<std::size_t>(i) * nk;
+                            float dot = 0.0f;
+                            for (int j = 0; j < nk; ++j) dot += di[j] * pi[j];
+                            for (int j = 0; j < nk; ++j) di[j] = scale * pi[j] * (di[j] - dot);
+                        }
+                        if (gq) {
+                            gemm::sgemm(false, true, hd, br, nk, 1.0f, K + kv_off, total,
+                                        dS.data(), nk, 1.0f, gq->data.data() + q_off + i0, total);
+                        }
+                        if (gk) {
+                            gemm::sgemm(false, false, hd, nk, br, 1.0f, Q + q_off + i0, total,
+                                        dS.data(), nk, 1.0f, gk->data.data() + kv_off, total);
+                        }
+                    }
+                }
+            }
+        });
+    }, q, k, v);
+    return out;
+}
+
+// One tile of scale * Q_i^T K_j for query rows [i0, i0 + br) and keys
+// [j0, j0 + bc) of a sequence, plus ALiBi and the causal mask
+static void flash_scores(const float* Qi, const float* Kj, int ld, int hd,
+                         int br, int bc, int i0, int j0, float scale, float slope,
+                         bool causal, float* S) {
+    gemm::sgemm(true, false, br, bc, hd, scale, Qi, ld, Kj, ld, 0.0f, S, bc);
+    if (slope == 0.0f && !causal) return;
+    for (int i = 0; i < br; ++i) {
+        for (int j = 0; j < bc; ++j) {
+            int gi = i0 + i, gj = j0 + j;
+            float& sv = S[i * bc + j];
+            if (causal && gj > gi) sv = -std::numeric_limits<float>::infinity();
+            else sv -= slope * static_cast<float>(std::abs(gj - gi));
+        }
+    }
+}
+
+std::shared_ptr<ADTensor> flash_attention_ad(const std::shared_ptr<ADTensor>& q,
+                                             const std::shared_ptr<ADTensor>& k,
+                                             const std::shared_ptr<ADTensor>& v,
+                                             int num_heads, int seq_len, bool causal,
+                                             float scale, int tile,
+                                             const std::vector<float>* alibi) {
+    const AttentionShape sh = attention_shape(*q, *k, *v, num_heads, seq_len,
+                                              "flash_attention_ad");
+    const int hd = sh.hd, kv_heads = sh.kv_heads, group = sh.group, T = sh.T;
+    const int batch = sh.batch, total = sh.total;
+    if (tile <= 0) throw std::runtime_error("flash_attention_ad: tile must be positive");
+    if (alibi && static_cast<int>(alibi->size()) != num_heads)
+        throw std::runtime_error("flash_attention_ad: need one ALiBi slope per head");
+    tile = std::min(tile, T);
+    std::vector<float> slopes = alibi ? *alibi : std::vector<float>(num_heads, 0.0f);
+    const std::size_t ld = total;
+    const float* Q = q->val.data.data();
+    const float* K = k->val.data.data();
+    const float* V = v->val.data.data();
+
+    // Log-sum-exp of every query row: all backward needs besides Q, K, V, O
+    std::vector<float> lse(static_cast<std::size_t>(batch) * num_heads * T);
+    Tensor o(q->val.rows, total);
+    float* O = o.data.data();
+    parallel::parallel_for(0, batch * num_heads, 1, [&](int lo, int hi) {
+        std::vector<float> S(static_cast<std::size_t>(tile) * tile);
+        std::vector<float> acc(static_cast<std::size_t>(hd) * tile), m(tile), l(tile);
+        for (int t = lo; t < hi; ++t) {
+            int b = t / num_heads, h = t % num_heads, kh = h / group;
+            std::size_t q_off = h * hd * ld + b * T, kv_off = kh * hd * ld + b * T;
+            for (int i0 = 0; i0 < T; i0 += tile) {
+                int br = std::min(tile, T - i0);
+                std::fill(m.begin(), m.end(), -std::numeric_limits<float>::infinity());
+                std::fill(l.begin(), l.end(), 0.0f);
+                std::fill(acc.begin(), acc.end(), 0.0f);
+                for (int j0 = 0; j0 < T; j0 += tile) {
+                    if (causal && j0 > i0 + br - 1) break;
+                    int bc = std::min(tile, T - j0);
+                    flash_scores(Q + q_off + i0, K + kv_off + j0, total, hd, br, bc,
+                                 i0, j0, scale, slopes[h], causal, S.data());
+                    // Online softmax: rescale what has been accumulated so
+                    // far to the new row maximum, then add this tile
+                    for (int i = 0; i < br; ++i) {
+                        float* si = S.data() + i * bc;
+                        float m_new = m[i];
+                        for (int j = 0; j < bc; ++j) m_new = std::max(m_new, si[j]);
+                        if (m_new == -std::numeric_limits<float>::infinity()) {
+                            std::fill(si, si + bc, 0.0f);
+                            continue;
+                        }
+                        float corr = std::exp(m[i] - m_new);
+                        float row = 0.0f;
+                        for (int j = 0; j < bc; ++j) {
+                            si[j] = std::exp(si[j] - m_new);
+                            row += si[j];
+                        }
+                        l[i] = l[i] * corr + row;
+                        m[i] = m_new;
+                        if (corr != 1.0f) {
+                            for (int d = 0; d < hd; ++d) acc[d * br + i] *= corr;
+                        }
+                    }
+                    gemm::sgemm(false, true, hd, br, bc, 1.0f, V + kv_off + j0, total,
+                                S.data(), bc, 1.0f, acc.data(), br);
+                }
+                for (int i = 0; i < br; ++i) {
+                    float inv = 1.0f / l[i];
+                    for (int d = 0; d < hd; ++d) O[q_off + d * ld + i0 + i] = acc[d * br + i] * inv;
+                    lse[static_cast<std::size_t>(t) * T + i0 + i] = m[i] + std::log(l[i]);
+                }
+            }
+        }
+    });
+
+    auto out = make_op_result(std::move(o));
+    record_backward(out, [q = q.get(), k = k.get(), v = v.get(), out = out.get(),
+                          lse = std::move(lse), slopes = std::move(slopes), num_heads,
+                          kv_heads, group, hd, T, batch, total, ld, scale, tile, causal]() {
+        Tensor* gq = grad_of(q);
+        Tensor* gk = grad_of(k);
+        Tensor* gv = grad_of(v);
+        const float* dO = out->grad.data.data();
+        const float* O = out->val.data.data();
+        const float* Q = q->val.data.data();
+        const float* K = k->val.data.data();
+        const float* V = v->val.data.data();
+        // One task per (sequence, KV head) owns that block of dK/dV and the
+        // dQ blocks of its query heads
+        parallel::parallel_for(0, batch * kv_heads, 1, [&](int lo, int hi) {
+            std::vector<float> P(static_cast<std::size_t>(tile) * tile);
+            std::vector<float> dP(P.size()), D(T);
+            for (int t = lo; t < hi; ++t) {
+                int b = t / kv_heads, kh = t % kv_heads;
+                std::size_t kv_off = kh * hd * ld + b * T;
+                for (int h = kh * group; h < (kh + 1) * group; ++h) {
+                    std::size_t q_off = h * hd * ld + b * T;
+                    const float* L = lse.data() + (static_cast<std::size_t>(b) * num_heads + h) * T;
+                    // D_i = dO_i . O_i, the softmax backward's row dot product
+                    std::fill(D.begin(), D.end(), 0.0f);
+                    for (int d = 0; d < hd; ++d) {
+                        const float* go = dO + q_off + d * ld;
+                        const float* oo = O + q_off + d * ld;
+                        for (int i = 0; i < T; ++i) D[i] += go[i] * oo[i];
+                    }
+                    for (int j0 = 0; j0 < T; j0 += tile) {
+                        int bc = std::min(tile, T - j0);
+                        // Query tiles wholly above the diagonal see none of these keys
+                        for (int i0 = causal ? j0 / tile * tile : 0; i0 < T; i0 += tile) {
+                            int br = std::min(tile, T - i0);
+                            flash_scores(Q + q_off + i0, K + kv_off + j0, total, hd, br, bc,
+                                         i0, j0, scale, slopes[h], causal, P.data());
+                            for (int i = 0; i < br; ++i) {
+                                for (int j = 0; j < bc; ++j) {
+                                    float& p = P[i * bc + j];
+                                    p = std::exp(p - L[i0 + i]);
+                                }
+                            }
+                            if (gv) {
+                                gemm::sgemm(false, false, hd, bc, br, 1.0f, dO + q_off + i0, total,
+                                            P.data(), bc, 1.0f, gv->data.data() + kv_off + j0, total);
+                            }
+                            if (!gq && !gk) continue;
+                            gemm::sgemm(true, false, br, bc, hd, 1.0f, dO + q_off + i0, total,
+                                        V + kv_off + j0, total, 0.0f, dP.data(), bc);
+                            for (int i = 0; i < br; ++i) {
+                                for (int j = 0; j < bc; ++j) {
+                                    float& ds = dP[i * bc + j];
+                                    ds = scale * P[i * bc + j] * (ds - D[i0 + i]);
+                                }
+                            }
+                            if (gq) {
+                                gemm::sgemm(false, true, hd, br, bc, 1.0f, K + kv_off + j0, total,
+                                            dP.data(), bc, 1.0f, gq->data.data() + q_off + i0, total);
+                            }
+                            if (gk) {
+                                gemm::sgemm(false, false, hd, bc, br, 1.0f, Q + q_off + i0, total,
+                                            dP.data(), bc, 1.0f, gk->data.data() + kv_off + j0, total);
+                            }
+                        }
+                    }
                 }
             }
         });
+    }, q, k, v);
+    return out;
+}
+
+std::shared_ptr<ADTensor> cross_entropy_ad(const std::shared_ptr<ADTensor>& logits,
+                                           const std::vector<int>& targets) {
+    int V = logits->val.rows, T = logits->val.cols;
+    const float* x = logits->val.data.data();
+    std::vector<int> tgt(T, -1);
+    for (int t = 0; t < T && t < static_cast<int>(targets.size()); ++t)
+        if (targets[t] >= 0 && targets[t] < V) tgt[t] = targets[t];
+
+    // Row-major [V x T]: walk whole rows so each pass reads the logits
+    // sequentially, carrying one running value per column
+    std::vector<float> lse(T, -std::numeric_limits<float>::infinity());
+    for (int v = 0; v < V; ++v) {
+        const float* row = x + static_cast<size_t>(v) * T;
+        for (int t = 0; t < T; ++t) lse[t] = std::max(lse[t], row[t]);
+    }
+    std::vector<float> sum_exp(T, 0.0f);
+    for (int v = 0; v < V; ++v) {
+        const float* row = x + static_cast<size_t>(v) * T;
+        for (int t = 0; t < T; ++t) sum_exp[t] += std::exp(row[t] - lse[t]);
+    }
+    float loss = 0.0f;
+    for (int t = 0; t < T; ++t) {
+        lse[t] += std::log(sum_exp[t]);
+        if (tgt[t] >= 0) loss += lse[t] - x[static_cast<size_t>(tgt[t]) * T + t];
+    }
+
+    Tensor v(1, 1);
+    v.data[0] = loss;
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [logits = logits.get(), out = out.get(),
+                          tgt = std::move(tgt), lse = std::move(lse), V, T]() {
+        float g = out->grad.data[0];
+        const float* x = logits->val.data.data();
+        float* gx = grad_of(logits)->data.data();
+        for (int v = 0; v < V; ++v) {
+            size_t base = static_cast<size_t>(v) * T;
+            for (int t = 0; t < T; ++t)
+                if (tgt[t] >= 0) gx[base + t] += g * std::exp(x[base + t] - lse[t]);
+        }
+        for (int t = 0; t < T; ++t)
+            if (tgt[t] >= 0) gx[static_cast<size_t>(tgt[t]) * T + t] -= g;
+    }, logits);
+    return out;
+}
+
+// Gather columns of a (embedding / position lookup)
+std::shared_ptr<ADTensor> gather_cols(const std::shared_ptr<ADTensor>& a,
+                                      const std::vector<int>& ids) {
+    int rows = a->val.rows, cols = a->val.cols;
+    int n = static_cast<int>(ids.size());
+    for (int id : ids) {
+        if (id < 0 || id >= cols) throw std::out_of_range("gather_cols: index out of range");
     }
+    Tensor v(rows, n);
+    for (int i = 0; i < rows; ++i) {
+        const float* src = a->val.data.data() + static_cast<size_t>(i) * cols;
+        float* dst = v.data.data() + static_cast<size_t>(i) * n;
+        for (int j = 0; j < n; ++j) dst[j] = src[ids[j]];
+    }
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [a = a.get(), out = out.get(), ids]() {
+        int rows = a->val.rows, cols = a->val.cols;
+        int n = static_cast<int>(ids.size());
+        Tensor* ga = grad_of(a);
+        for (int i = 0; i < rows; ++i) {
+            float* dst = ga->data.data() + static_cast<size_t>(i) * cols;
+            const float* go = out->grad.data.data() + static_cast<size_t>(i) * n;
+            for (int j = 0; j < n; ++j) dst[ids[j]] += go[j];
+        }
+    }, a);
     return out;
 }
 
@@ -183,19 +1042,17 @@ std::shared_ptr<ADTensor> mul(const std::shared_ptr<ADTensor>& a,
     for (size_t i = 0; i < a->val.data.size(); ++i) {
         v.data[i] = a->val.data[i] * b->val.data[i];
     }
-    auto out = std::make_shared<ADTensor>(v);
-    // grad_a += grad_out * b
-    out->deps.emplace_back(a, [a, b, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
-            a->grad.data[i] += b->val.data[i] * out->grad.data[i];
+    auto out = make_op_result(std::move(v));
+    // grad_a += grad_out * b, grad_b += grad_out * a
+    record_backward(out, [a = a.get(), b = b.get(), out = out.get()]() {
+        const auto& go = out->grad.data;
+        if (Tensor* ga = grad_of(a)) {
+            for (size_t i = 0; i < go.size(); ++i) ga->data[i] += b->val.data[i] * go[i];
         }
-    });
-    // grad_b += grad_out * a
-    out->deps.emplace_back(b, [a, b, out]() {
-        for (size_t i = 0; i < b->grad.data.size(); ++i) {
-            b->grad.data[i] += a->val.data[i] * out->grad.data[i];
+        if (Tensor* gb = grad_of(b)) {
+            for (size_t i = 0; i < go.size(); ++i) gb->data[i] += a->val.data[i] * go[i];
         }
-    });
+    }, a, b);
     return out;
 }
 
@@ -203,38 +1060,46 @@ std::shared_ptr<ADTensor> scalar_mul(const std::shared_ptr<ADTensor>& a,
                                      float s) {
     Tensor v = a->val;
     for (auto& x : v.data) x *= s;
-    auto out = std::make_shared<ADTensor>(v);
+    auto out = make_op_result(std::move(v));
     // grad_a += s * grad_out
-    out->deps.emplace_back(a, [a, out, s]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
-            a->grad.data[i] += s * out->grad.data[i];
+    record_backward(out, [a = a.get(), out = out.get(), s]() {
+        Tensor* ga = grad_of(a);
+        for (size_t i = 0; i < ga->data.size(); ++i) {
+            ga->data[i] += s * out->grad.data[i];
         }
-    });
+    }, a);
     return out;
 }
 
 std::shared_ptr<ADTensor> matmul(const std::shared_ptr<ADTensor>& a,
                                  const std::shared_ptr<ADTensor>& b) {
-    Tensor v = a->val.matmul(b->val);
-    auto out = std::make_shared<ADTensor>(v);
-    // grad w.r.t a: grad_out.matmul(b^T)
-    out->deps.emplace_back(a, [a, b, out]() {
-        Tensor grad_out = out->grad;
-        Tensor bT = b->val.transpose();
-        Tensor ga = grad_out.matmul(bT);
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
-            a->grad.data[i] += ga.data[i];
+    return matmul(a, b, false, false);
+}
+
+std::shared_ptr<ADTensor> matmul(const std::shared_ptr<ADTensor>& a,
+                                 const std::shared_ptr<ADTensor>& b,
+                                 bool trans_a, bool trans_b) {
+    int M = trans_a ? a->val.cols : a->val.rows;
+    int N = trans_b ? b->val.rows : b->val.cols;
+    Tensor v(M, N);
+    Tensor::gemm(trans_a, trans_b, 1.0f, a->val, b->val, 0.0f, v);
+    auto out = make_op_result(std::move(v));
+    // Gradients accumulate straight into a->grad / b->grad (beta = 1), with
+    // the transposes folded into the GEMM instead of materialised:
+    //   C = A B     : dA += dC B^T,   dB += A^T dC
+    //   C = A^T B   : dA += B dC^T,   dB += A dC
+    //   C = A B^T   : dA += dC B,     dB += dC^T A
+    //   C = A^T B^T : dA += B^T dC^T, dB += dC^T A^T
+    record_backward(out, [a = a.get(), b = b.get(), out = out.get(), trans_a, trans_b]() {
+        if (Tensor* ga = grad_of(a)) {
+            if (!trans_a) Tensor::gemm(false, !trans_b, 1.0f, out->grad, b->val, 1.0f, *ga);
+            else Tensor::gemm(trans_b, true, 1.0f, b->val, out->grad, 1.0f, *ga);
         }
-    });
-    // grad w.r.t b: a^T.matmul(grad_out)
-    out->deps.emplace_back(b, [a, b, out]() {
-        Tensor grad_out = out->grad;
-        Tensor aT = a->val.transpose();
-        Tensor gb = aT.matmul(grad_out);
-        for (size_t i = 0; i < b->grad.data.size(); ++i) {
-            b->grad.data[i] += gb.data[i];
+        if (Tensor* gb = grad_of(b)) {
+            if (!trans_b) Tensor::gemm(!trans_a, false, 1.0f, a->val, out->grad, 1.0f, *gb);
+            else Tensor::gemm(true, trans_a, 1.0f, out->grad, a->val, 1.0f, *gb);
         }
-    });
+    }, a, b);
     return out;
 }
 
@@ -243,14 +1108,15 @@ std::shared_ptr<ADTensor> tanh_ad(const std::shared_ptr<ADTensor>& a) {
     for (size_t i = 0; i < v.data.size(); ++i) {
         v.data[i] = std::tanh(a->val.data[i]);
     }
-    auto out = std::make_shared<ADTensor>(v);
+    auto out = make_op_result(std::move(v));
     // grad_a += (1 - tanh^2(x)) * grad_out
-    out->deps.emplace_back(a, [a, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
+    record_backward(out, [a = a.get(), out = out.get()]() {
+        Tensor* ga = grad_of(a);
+        for (size_t i = 0; i < ga->data.size(); ++i) {
             float y = out->val.data[i];
-            a->grad.data[i] += (1.0f - y * y) * out->grad.data[i];
+            ga->data[i] += (1.0f - y * y) * out->grad.data[i];
         }
-    });
+    }, a);
     return out;
 }
 
@@ -259,13 +1125,14 @@ std::shared_ptr<ADTensor> exp_ad(const std::shared_ptr<ADTensor>& a) {
     for (size_t i = 0; i < v.data.size(); ++i) {
         v.data[i] = std::exp(a->val.data[i]);
     }
-    auto out = std::make_shared<ADTensor>(v);
+    auto out = make_op_result(std::move(v));
     // grad_a += exp(x) * grad_out
-    out->deps.emplace_back(a, [a, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
-            a->grad.data[i] += out->val.data[i] * out->grad.data[i];
+    record_backward(out, [a = a.get(), out = out.get()]() {
+        Tensor* ga = grad_of(a);
+        for (size_t i = 0; i < ga->data.size(); ++i) {
+            ga->data[i] += out->val.data[i] * out->grad.data[i];
         }
-    });
+    }, a);
     return out;
 }
 // sqrt(x)
@@ -274,13 +1141,14 @@ std::shared_ptr<ADTensor> sqrt_ad(const std::shared_ptr<ADTensor>& a) {
     for (size_t i = 0; i < v.data.size(); ++i) {
         v.data[i] = std::sqrt(a->val.data[i]);
     }
-    auto out = std::make_shared<ADTensor>(v);
-    out->deps.emplace_back(a, [a, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [a = a.get(), out = out.get()]() {
+        Tensor* ga = grad_of(a);
+        for (size_t i = 0; i < ga->data.size(); ++i) {
             float y = out->val.data[i];
-            a->grad.data[i] += (out->grad.data[i] * 0.5f) / y;
+            ga->data[i] += (out->grad.data[i] * 0.5f) / y;
         }
-    });
+    }, a);
     return out;
 }
 // 1/x
@@ -289,13 +1157,14 @@ std::shared_ptr<ADTensor> reciprocal(const std::shared_ptr<ADTensor>& a) {
     for (size_t i = 0; i < v.data.size(); ++i) {
         v.data[i] = 1.0f / a->val.data[i];
     }
-    auto out = std::make_shared<ADTensor>(v);
-    out->deps.emplace_back(a, [a, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [a = a.get(), out = out.get()]() {
+        Tensor* ga = grad_of(a);
+        for (size_t i = 0; i < ga->data.size(); ++i) {
             float ai = a->val.data[i];
-            a->grad.data[i] -= out->grad.data[i] / (ai * ai);
+            ga->data[i] -= out->grad.data[i] / (ai * ai);
         }
-    });
+    }, a);
     return out;
 }
 // a - b
@@ -304,17 +1173,17 @@ std::shared_ptr<ADTensor> sub(const std::shared_ptr<ADTensor>& a,
     Tensor v(a->val.rows, a->val.cols);
     for (size_t i = 0; i < v.data.size(); ++i)
         v.data[i] = a->val.data[i] - b->val.data[i];
-    auto out = std::make_shared<ADTensor>(v);
-    // grad a += grad_out
-    out->deps.emplace_back(a, [a, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i)
-            a->grad.data[i] += out->grad.data[i];
-    });
-    // grad b -= grad_out
-    out->deps.emplace_back(b, [b, out]() {
-        for (size_t i = 0; i < b->grad.data.size(); ++i)
-            b->grad.data[i] -= out->grad.data[i];
-    });
+    auto out = make_op_result(std::move(v));
+    // grad a += grad_out, grad b -= grad_out
+    record_backward(out, [a = a.get(), b = b.get(), out = out.get()]() {
+        const auto& go = out->grad.data;
+        if (Tensor* ga = grad_of(a)) {
+            for (size_t i = 0; i < go.size(); ++i) ga->data[i] += go[i];
+        }
+        if (Tensor* gb = grad_of(b)) {
+            for (size_t i = 0; i < go.size(); ++i) gb->data[i] -= go[i];
+        }
+    }, a, b);
     return out;
 }
 // Sum all elements to scalar
@@ -323,11 +1192,11 @@ std::shared_ptr<ADTensor> sum(const std::shared_ptr<ADTensor>& a) {
     for (float v : a->val.data) s += v;
     Tensor v(1, 1);
     v.data[0] = s;
-    auto out = std::make_shared<ADTensor>(v);
-    out->deps.emplace_back(a, [a, out]() {
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [a = a.get(), out = out.get()]() {
         float d = out->grad.data[0];
-        for (float &g : a->grad.data) g += d;
-    });
+        for (float &g : grad_of(a)->data) g += d;
+    }, a);
     return out;
 }
 
@@ -337,14 +1206,15 @@ std::shared_ptr<ADTensor> relu_ad(const std::shared_ptr<ADTensor>& a) {
     for (size_t i = 0; i < v.data.size(); ++i) {
         v.data[i] = a->val.data[i] > 0.0f ? a->val.data[i] : 0.0f;
     }
-    auto out = std::make_shared<ADTensor>(v);
-    out->deps.emplace_back(a, [a, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [a = a.get(), out = out.get()]() {
+        Tensor* ga = grad_of(a);
+        for (size_t i = 0; i < ga->data.size(); ++i) {
             if (a->val.data[i] > 0.0f) {
-                a->grad.data[i] += out->grad.data[i];
+                ga->data[i] += out->grad.data[i];
             }
         }
-    });
+    }, a);
     return out;
 }
 
@@ -354,40 +1224,40 @@ std::shared_ptr<ADTensor> sigmoid_ad(const std::shared_ptr<ADTensor>& a) {
     for (size_t i = 0; i < v.data.size(); ++i) {
         v.data[i] = 1.0f / (1.0f + std::exp(-a->val.data[i]));
     }
-    auto out = std::make_shared<ADTensor>(v);
-    out->deps.emplace_back(a, [a, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [a = a.get(), out = out.get()]() {
+        Tensor* ga = grad_of(a);
+        for (size_t i = 0; i < ga->data.size(); ++i) {
             float s = out->val.data[i];
-            a->grad.data[i] += out->grad.data[i] * s * (1.0f - s);
+            ga->data[i] += out->grad.data[i] * s * (1.0f - s);
         }
-    });
+    }, a);
     return out;
 }
 
 // Reshape (view)
 std::shared_ptr<ADTensor> reshape_ad(const std::shared_ptr<ADTensor>& a,
                                       const std::vector<int>& new_shape) {
-    Tensor v = a->val.reshape(new_shape);
-    auto out = std::make_shared<ADTensor>(v);
-    auto orig_shape = a->val.shape;
-    out->deps.emplace_back(a, [a, out, orig_shape]() {
+    auto out = make_op_result(a->val.reshape(new_shape));
+    record_backward(out, [a = a.get(), out = out.get()]() {
         // Gradient flows through unchanged - just reshape back
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
-            a->grad.data[i] += out->grad.data[i];
+        Tensor* ga = grad_of(a);
+        for (size_t i = 0; i < ga->data.size(); ++i) {
+            ga->data[i] += out->grad.data[i];
         }
-    });
+    }, a);
     return out;
 }
 
 // Flatten
 std::shared_ptr<ADTensor> flatten_ad(const std::shared_ptr<ADTensor>& a,
                                       int start_dim, int end_dim) {
-    Tensor v = a->val.flatten(start_dim, end_dim);
-    auto out = std::make_shared<ADTensor>(v);
-    out->deps.emplace_back(a, [a, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
-            a->grad.data[i] += out->grad.data[i];
+    auto out = make_op_result(a->val.flatten(start_dim, end_dim));
+    record_backward(out, [a = a.get(), out = out.get()]() {
+        Tensor* ga = grad_of(a);
+        for (size_t i = 0; i < ga->data.size(); ++i) {
+            ga->data[i] += out->grad.data[i];
         }
-    });
+    }, a);
     return out;
-}
\ No newline at end of file
+}
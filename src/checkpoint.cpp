@@ -0,0 +1,516 @@
+#include "checkpoint.hpp"
+#include "autodiff.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ckpt {
+
+namespace {
+
+const char kMagic[4] = {'D', 'S', 'C', 'K'};
+const std::uint32_t kVersion = 2;  // 1: no metadata
+const std::uint32_t kFloat32 = 0;
+const std::uint64_t kAlign = 64;
+// Optimizer state is stored next to the parameters under these prefixes
+const std::string kFirstMoment = "adam.m.";
+const std::string kSecondMoment = "adam.v.";
+
+bool is_optimizer_state(const std::string& name) {
+    return name.compare(0, kFirstMoment.size(), kFirstMoment) == 0 ||
+           name.compare(0, kSecondMoment.size(), kSecondMoment) == 0;
+}
+
+template <typename T>
+std::string to_text(const T& v) {
+    std::ostringstream out;
+    out << std::setprecision(9) << v;
+    return out.str();
+}
+
+const std::string& lookup(const Metadata& meta, const std::string& key, const std::string& path) {
+    auto it = meta.find(key);
+    if (it == meta.end())
+        throw std::runtime_error("checkpoint training state has no '" + key + "': " + path);
+    return it->second;
+}
+
+std::uint64_t align_up(std::uint64_t x) { return (x + kAlign - 1) / kAlign * kAlign; }
+
+std::uint64_t numel(const std::vector<int>& shape) {
+    if (shape.empty()) return 0;
+    std::uint64_t n = 1;
+    for (int d : shape) n *= static_cast<std::uint64_t>(d);
+    return n;
+}
+
+template <typename T>
+void put(std::string& out, T v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+// Bounds-checked reads from the mapped index
+struct Cursor {
+    const char* p;
+    const char* end;
+    const std::string& path;
+
+    void need(std::size_t n) const {
+        if (static_cast<std::size_t>(end - p) < n)
+            throw std::runtime_error("checkpoint index truncated: " + path);
+    }
+    template <typename T>
+    T get() {
+        need(sizeof(T));
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+    std::string str(std::size_t n) {
+        need(n);
+        std::string s(p, n);
+        p += n;
+        return s;
+    }
+};
+
+bool is_current_format(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open checkpoint file for reading: " + path);
+    char magic[4] = {};
+    in.read(magic, sizeof(magic));
+    return in && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+// Older layout: u32 count, then rows, cols and floats for each parameter in
+// registration order
+int load_legacy(const std::string& path) {
+    auto& params = get_parameters();
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open checkpoint file for reading: " + path);
+    std::uint32_t num = 0;
+    in.read(reinterpret_cast<char*>(&num), sizeof(num));
+    if (num != params.size()) {
+        std::cerr << "Warning: checkpoint parameter count mismatch (" << num << " vs "
+                  << params.size() << "), attempting partial load\n";
+    }
+    std::uint32_t to_load = std::min<std::uint32_t>(num, (std::uint32_t)params.size());
+    int shape_mismatches = 0;
+    int loaded = 0;
+    for (std::uint32_t i = 0; i < to_load; ++i) {
+        auto& p = params[i];
+        std::uint32_t r = 0, c = 0;
+        in.read(reinterpret_cast<char*>(&r), sizeof(r));
+        in.read(reinterpret_cast<char*>(&c), sizeof(c));
+        if (r != (std::uint32_t)p->val.rows || c != (std::uint32_t)p->val.cols) {
+            std::cerr << "Warning: checkpoint param shape mismatch (" << r << "x" << c
+                      << " vs " << p->val.rows << "x" << p->val.cols << "), skipping\n";
+            in.seekg((std::streamoff)r * c * sizeof(float), std::ios::cur);
+            if (++shape_mismatches > 3)
+                throw std::runtime_error("too many shape mismatches (>3), aborting checkpoint load");
+        } else {
+            in.read(reinterpret_cast<char*>(p->val.data.data()), (std::streamsize)r * c * sizeof(float));
+            ++loaded;
+        }
+    }
+    if (!in) throw std::runtime_error("checkpoint file truncated: " + path);
+    return loaded;
+}
+
+bool write_all(int fd, const void* data, std::size_t n) {
+    const char* p = static_cast<const char*>(data);
+    while (n > 0) {
+        ssize_t w = ::write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        n -= static_cast<std::size_t>(w);
+    }
+    return true;
+}
+
+std::string shape_str(const std::vector<int>& shape) {
+    std::string s;
+    for (size_t i = 0; i < shape.size(); ++i) s += (i ? "x" : "") + std::to_string(shape[i]);
+    return s;
+}
+
+}  // namespace
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("cannot open checkpoint file for reading: " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < (off_t)(sizeof(kMagic) + 8)) {
+        ::close(fd);
+        throw std::runtime_error("not a checkpoint file: " + path);
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    // Private and writable: pages stay shared with the page cache until
+    // something writes to them, which then gets its own copy rather than a
+    // fault
+    void* addr = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) throw std::runtime_error("cannot map checkpoint file: " + path);
+    std::size_t size = size_;
+    base_ = std::shared_ptr<void>(addr, [size](void* p) { ::munmap(p, size); });
+
+    const char* begin = static_cast<const char*>(addr);
+    Cursor c{begin, begin + size_, path};
+    if (std::memcmp(c.str(sizeof(kMagic)).data(), kMagic, sizeof(kMagic)) != 0)
+        throw std::runtime_error("not a checkpoint file: " + path);
+    std::uint32_t version = c.get<std::uint32_t>();
+    if (version < 1 || version > kVersion)
+        throw std::runtime_error("unsupported checkpoint version " + std::to_string(version) +
+                                 ": " + path);
+    std::uint32_t count = c.get<std::uint32_t>();
+    std::uint32_t meta_count = version >= 2 ? c.get<std::uint32_t>() : 0;
+    for (std::uint32_t i = 0; i < meta_count; ++i) {
+        std::string key = c.str(c.get<std::uint32_t>());
+        metadata_[key] = c.str(c.get<std::uint32_t>());
+    }
+    for (std::uint32_t i = 0; i < count; ++i) {
+        Entry e;
+        e.name = c.str(c.get<std::uint32_t>());
+        std::uint32_t dtype = c.get<std::uint32_t>();
+        std::uint32_t ndim = c.get<std::uint32_t>();
+        for (std::uint32_t d = 0; d < ndim; ++d)
+            e.shape.push_back(static_cast<int>(c.get<std::int64_t>()));
+        e.offset = c.get<std::uint64_t>();
+        e.bytes = c.get<std::uint64_t>();
+        if (dtype != kFloat32 || e.bytes != numel(e.shape) * sizeof(float) ||
+            e.offset % kAlign != 0 || e.offset > size_ || e.bytes > size_ - e.offset) {
+            throw std::runtime_error("corrupt checkpoint entry '" + e.name + "': " + path);
+        }
+        if (!index_.emplace(e.name, entries_.size()).second)
+            throw std::runtime_error("duplicate checkpoint entry '" + e.name + "': " + path);
+        entries_.push_back(std::move(e));
+    }
+}
+
+const Entry* MappedFile::find(const std::string& name) const {
+    auto it = index_.find(name);
+    return it == index_.end() ? nullptr : &entries_[it->second];
+}
+
+const float* MappedFile::data(const Entry& e) const {
+    return reinterpret_cast<const float*>(static_cast<const char*>(base_.get()) + e.offset);
+}
+
+Tensor MappedFile::tensor(const Entry& e) const {
+    return Tensor::adopt(const_cast<float*>(data(e)), e.shape, base_);
+}
+
+void write(const std::string& path, const std::vector<std::string>& names,
+           const std::vector<const Tensor*>& tensors, const Metadata& metadata) {
+    if (names.size() != tensors.size())
+        throw std::invalid_argument("ckpt::write: one name per tensor");
+    // Index first, with data offsets laid out after it
+    std::uint64_t index_bytes = sizeof(kMagic) + 3 * sizeof(std::uint32_t);
+    for (const auto& kv : metadata)
+        index_bytes += 2 * sizeof(std::uint32_t) + kv.first.size() + kv.second.size();
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        index_bytes += 3 * sizeof(std::uint32_t) + names[i].size() +
+                       tensors[i]->shape.size() * sizeof(std::int64_t) +
+                       2 * sizeof(std::uint64_t);
+    }
+    std::string index;
+    index.reserve(index_bytes);
+    index.append(kMagic, sizeof(kMagic));
+    put(index, kVersion);
+    put(index, static_cast<std::uint32_t>(tensors.size()));
+    put(index, static_cast<std::uint32_t>(metadata.size()));
+    for (const auto& kv : metadata) {
+        put(index, static_cast<std::uint32_t>(kv.first.size()));
+        index += kv.first;
+        put(index, static_cast<std::uint32_t>(kv.second.size()));
+        index += kv.second;
+    }
+    std::vector<std::uint64_t> offsets;
+    std::uint64_t offset = align_up(index_bytes);
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        const Tensor& t = *tensors[i];
+        std::uint64_t bytes = t.data.size() * sizeof(float);
+        put(index, static_cast<std::uint32_t>(names[i].size()));
+        index += names[i];
+        put(index, kFloat32);
+        put(index, static_cast<std::uint32_t>(t.shape.size()));
+        for (int d : t.shape) put(index, static_cast<std::int64_t>(d));
+        put(index, offset);
+        put(index, bytes);
+        offsets.push_back(offset);
+        offset = align_up(offset + bytes);
+    }
+
+    // Write a temporary file, make it durable, then swap it in
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("cannot open checkpoint file for writing: " + tmp);
+    bool ok = write_all(fd, index.data(), index.size());
+    std::uint64_t pos = index.size();
+    const char zeros[kAlign] = {};
+    for (size_t i = 0; ok && i < tensors.size(); ++i) {
+        const Tensor& t = *tensors[i];
+        std::size_t bytes = t.data.size() * sizeof(float);
+        ok = write_all(fd, zeros, offsets[i] - pos) && write_all(fd, t.data.data(), bytes);
+        pos = offsets[i] + bytes;
+    }
+    ok = ok && ::fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        throw std::runtime_error("failed writing checkpoint file: " + path);
+    }
+    // Persist the rename itself
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int dfd = ::open(dir.c_str(), O_RDONLY);
+    if (dfd >= 0) {
+        ::fsync(dfd);
+        ::close(dfd);
+    }
+}
+
+void save_parameters(const std::string& path) {
+    std::vector<const Tensor*> tensors;
+    for (auto& p : get_parameters()) tensors.push_back(&p->val);
+    write(path, parameter_names(), tensors);
+}
+
+int load_parameters(const std::string& path, bool map) {
+    if (!is_current_format(path)) return load_legacy(path);
+    MappedFile file(path);
+    auto& params = get_parameters();
+    const auto& names = parameter_names();
+    int loaded = 0, missing = 0, shape_mismatches = 0;
+    std::size_t stored = std::count_if(file.entries().begin(), file.entries().end(),
+                                       [](const Entry& e) { return !is_optimizer_state(e.name); });
+    for (size_t i = 0; i < params.size(); ++i) {
+        auto& p = params[i];
+        const Entry* e = file.find(names[i]);
+        if (!e) {
+            ++missing;
+            continue;
+        }
+        if (e->shape != p->val.shape) {
+            std::cerr << "Warning: checkpoint param '" << names[i] << "' shape mismatch ("
+                      << shape_str(e->shape) << " vs " << shape_str(p->val.shape)
+                      << "), skipping\n";
+            if (++shape_mismatches > 3)
+                throw std::runtime_error("too many shape mismatches (>3), aborting checkpoint load");
+            continue;
+        }
+        if (map) {
+            p->val = file.tensor(*e);
+        } else {
+            std::copy(file.data(*e), file.data(*e) + p->val.data.size(), p->val.data.begin());
+        }
+        ++loaded;
+    }
+    if (missing > 0 || stored != params.size()) {
+        std::cerr << "Warning: checkpoint has " << stored << " tensors, model has "
+                  << params.size() << " parameters (" << missing
+                  << " not in the checkpoint keep their initial values)\n";
+    }
+    return loaded;
+}
+
+void save_training(AsyncWriter& writer, const std::string& path, const AdamW& opt,
+                   const TrainingState& state) {
+    const auto& params = get_parameters();
+    std::vector<std::string> names = parameter_names();
+    std::vector<const Tensor*> tensors;
+    for (auto& p : params) tensors.push_back(&p->val);
+    // Moments exist only once AdamW has stepped
+    const auto& m = opt.first_moments();
+    const auto& v = opt.second_moments();
+    bool moments = m.size() == params.size() && v.size() == params.size();
+    if (moments) {
+        for (size_t i = 0; i < params.size(); ++i) {
+            names.push_back(kFirstMoment + parameter_names()[i]);
+            tensors.push_back(&m[i]);
+            names.push_back(kSecondMoment + parameter_names()[i]);
+            tensors.push_back(&v[i]);
+        }
+    }
+    std::ostringstream rng;
+    rng << state.rng;
+    Metadata meta = {
+        {"adam.t", std::to_string(moments ? opt.step_count() : 0)},
+        {"train.epoch", std::to_string(state.epoch)},
+        {"train.batches_done", std::to_string(state.batches_done)},
+        {"train.global_step", std::to_string(state.global_step)},
+        {"train.scheduler_step", std::to_string(state.scheduler_step)},
+        {"train.rng", rng.str()},
+        {"train.loss_sum", to_text(state.loss_sum)},
+        {"train.loss_count", std::to_string(state.loss_count)},
+        {"train.best_val_loss", to_text(state.best_val_loss)},
+        {"train.no_improve", std::to_string(state.no_improve)},
+    };
+    writer.save(path, names, tensors, meta);
+}
+
+bool load_training(const std::string& path, AdamW& opt, TrainingState& state) {
+    if (!is_current_format(path)) return false;
+    MappedFile file(path);
+    const Metadata& meta = file.metadata();
+    if (meta.find("train.epoch") == meta.end()) return false;
+
+    TrainingState s;
+    try {
+        s.epoch = std::stoi(lookup(meta, "train.epoch", path));
+        s.batches_done = std::stoll(lookup(meta, "train.batches_done", path));
+        s.global_step = std::stoi(lookup(meta, "train.global_step", path));
+        s.scheduler_step = std::stoi(lookup(meta, "train.scheduler_step", path));
+        s.loss_sum = std::stof(lookup(meta, "train.loss_sum", path));
+        s.loss_count = std::stoi(lookup(meta, "train.loss_count", path));
+        s.best_val_loss = std::stof(lookup(meta, "train.best_val_loss", path));
+        s.no_improve = std::stoi(lookup(meta, "train.no_improve", path));
+    } catch (const std::logic_error&) {  // stoi and friends on a bad value
+        throw std::runtime_error("checkpoint training state is malformed: " + path);
+    }
+    std::istringstream rng(lookup(meta, "train.rng", path));
+    rng >> s.rng;
+    if (!rng) throw std::runtime_error("checkpoint RNG state is malformed: " + path);
+
+    // Moments are copied: AdamW rewrites them every step
+    const auto& params = get_parameters();
+    const auto& names = parameter_names();
+    int t = std::stoi(lookup(meta, "adam.t", path));
+    std::vector<Tensor> m, v;
+    for (size_t i = 0; t > 0 && i < params.size(); ++i) {
+        const Entry* em = file.find(kFirstMoment + names[i]);
+        const Entry* ev = file.find(kSecondMoment + names[i]);
+        std::uint64_t bytes = params[i]->val.data.size() * sizeof(float);
+        if (!em || !ev || em->bytes != bytes || ev->bytes != bytes) {
+            std::cerr << "Warning: checkpoint has no usable AdamW state for '" << names[i]
+                      << "', restarting the optimizer\n";
+            m.clear();
+            v.clear();
+            t = 0;
+            break;
+        }
+        Tensor mi(em->shape), vi(ev->shape);
+        std::copy(file.data(*em), file.data(*em) + mi.data.size(), mi.data.begin());
+        std::copy(file.data(*ev), file.data(*ev) + vi.data.size(), vi.data.begin());
+        m.push_back(std::move(mi));
+        v.push_back(std::move(vi));
+    }
+    opt.restore(t, std::move(m), std::move(v));
+    state = s;
+    return true;
+}
+
+AsyncWriter::AsyncWriter() : thread_([this] { run(); }) {}
+
+AsyncWriter::~AsyncWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+void AsyncWriter::save(const std::string& path, const std::vector<std::string>& names,
+                       const std::vector<const Tensor*>& tensors, const Metadata& metadata) {
+    if (names.size() != tensors.size())
+        throw std::invalid_argument("AsyncWriter::save: one name per tensor");
+    int b;
+    {
+        // Take back a queued snapshot, or else fill the buffer not being
+        // written; either way the writer thread cannot pick it up meanwhile
+        std::lock_guard<std::mutex> lock(mu_);
+        if (pending_ >= 0) {
+            b = pending_;
+            pending_ = -1;
+            ++skipped_;
+        } else {
+            b = writing_ == 0 ? 1 : 0;
+        }
+    }
+    // The copy is the only work done on the caller's thread; buffers keep
+    // their storage from one checkpoint to the next
+    Snapshot& snap = buffers_[b];
+    snap.path = path;
+    snap.names = names;
+    snap.metadata = metadata;
+    if (snap.tensors.size() != tensors.size()) {
+        snap.tensors.clear();
+        for (const Tensor* t : tensors) snap.tensors.push_back(*t);
+    } else {
+        for (size_t i = 0; i < tensors.size(); ++i) snap.tensors[i] = *tensors[i];
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    pending_ = b;
+    cv_.notify_all();
+    rethrow_error();
+}
+
+void AsyncWriter::save_parameters(const std::string& path) {
+    std::vector<const Tensor*> tensors;
+    for (auto& p : get_parameters()) tensors.push_back(&p->val);
+    save(path, parameter_names(), tensors);
+}
+
+void AsyncWriter::wait() {
+    std::unique_lock<std::mutex> lock(mu_);
+    cv_.wait(lock, [this] { return pending_ < 0 && writing_ < 0; });
+    rethrow_error();
+}
+
+int AsyncWriter::written() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return written_;
+}
+
+int AsyncWriter::skipped() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return skipped_;
+}
+
+void AsyncWriter::rethrow_error() {
+    if (!error_) return;
+    std::exception_ptr e = error_;
+    error_ = nullptr;
+    std::rethrow_exception(e);
+}
+
+void AsyncWriter::run() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (true) {
+        cv_.wait(lock, [this] { return pending_ >= 0 || stop_; });
+        if (pending_ < 0) return;  // stopped with nothing queued
+        writing_ = pending_;
+        pending_ = -1;
+        Snapshot& snap = buffers_[writing_];
+        lock.unlock();
+        std::exception_ptr err;
+        try {
+            std::vector<const Tensor*> tensors;
+            for (const Tensor& t : snap.tensors) tensors.push_back(&t);
+            write(snap.path, snap.names, tensors, snap.metadata);
+        } catch (...) {
+            err = std::current_exception();
+        }
+        lock.lock();
+        if (err) error_ = err;
+        else ++written_;
+        writing_ = -1;
+        cv_.notify_all();
+    }
+}
+
+}  // namespace ckpt
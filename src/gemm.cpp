@@ -0,0 +1,402 @@
+#include "gemm.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEMM_X86 1
+#endif
+
+namespace gemm {
+namespace {
+
+// Cache blocking: a KC x NC slice of B stays in L3, an MC x KC block of A in L2,
+// and one KC x NR micro-panel of B in L1 while the microkernel sweeps A.
+constexpr int KC = 256;
+constexpr int MC_MAX = 144;   // multiple of every MR below
+constexpr int NC = 3072;      // multiple of every NR below
+// Below this many multiply-adds the product runs on the calling thread only
+constexpr long long PARALLEL_MIN_FLOPS = 1LL << 18;
+
+// Microkernel: C[mr x nr] = alpha * Ap * Bp + beta * C over a depth of kc,
+// where Ap holds kc columns of mr packed A values and Bp kc rows of nr packed
+// B values. When beta == 0, C is not read.
+using MicroKernel = void (*)(int kc, const float* a, const float* b,
+                             float* c, int ldc, float alpha, float beta);
+
+struct KernelInfo {
+    const char* name;
+    int mr;
+    int nr;
+    MicroKernel fn;
+};
+
+// ---------------------------------------------------------------------------
+// Microkernels
+// ---------------------------------------------------------------------------
+
+template <int MR, int NR>
+void kernel_generic(int kc, const float* a, const float* b,
+                    float* c, int ldc, float alpha, float beta) {
+    float acc[MR][NR] = {};
+    for (int p = 0; p < kc; ++p) {
+        for (int i = 0; i < MR; ++i) {
+            float ai = a[i];
+            for (int j = 0; j < NR; ++j) acc[i][j] += ai * b[j];
+        }
+        a += MR;
+        b += NR;
+    }
+    for (int i = 0; i < MR; ++i) {
+        float* ci = c + i * ldc;
+        if (beta == 0.0f) {
+            for (int j = 0; j < NR; ++j) ci[j] = alpha * acc[i][j];
+        } else {
+            for (int j = 0; j < NR; ++j) ci[j] = alpha * acc[i][j] + beta * ci[j];
+        }
+    }
+}
+
+#ifdef GEMM_X86
+// 6x16 tile: 12 ymm accumulators, 2 for B, 1 broadcast
+__attribute__((target("avx2,fma")))
+void kernel_avx2_6x16(int kc, const float* a, const float* b,
+                      float* c, int ldc, float alpha, float beta) {
+    __m256 acc[6][2];
+    for (int i = 0; i < 6; ++i) {
+        acc[i][0] = _mm256_setzero_ps();
+        acc[i][1] = _mm256_setzero_ps();
+    }
+    for (int p = 0; p < kc; ++p) {
+        __m256 b0 = _mm256_loadu_ps(b);
+        __m256 b1 = _mm256_loadu_ps(b + 8);
+        for (int i = 0; i < 6; ++i) {
+            __m256 ai = _mm256_broadcast_ss(a + i);
+            acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+        }
+        a += 6;
+        b += 16;
+    }
+    __m256 va = _mm256_set1_ps(alpha);
+    __m256 vb = _mm256_set1_ps(beta);
+    for (int i = 0; i < 6; ++i) {
+        float* ci = c + i * ldc;
+        for (int h = 0; h < 2; ++h) {
+            __m256 r = _mm256_mul_ps(va, acc[i][h]);
+            if (beta != 0.0f) r = _mm256_fmadd_ps(vb, _mm256_loadu_ps(ci + 8 * h), r);
+            _mm256_storeu_ps(ci + 8 * h, r);
+        }
+    }
+}
+
+// 8x32 tile: 16 zmm accumulators, 2 for B, 1 broadcast
+__attribute__((target("avx512f")))
+void kernel_avx512_8x32(int kc, const float* a, const float* b,
+                        float* c, int ldc, float alpha, float beta) {
+    __m512 acc[8][2];
+    for (int i = 0; i < 8; ++i) {
+        acc[i][0] = _mm512_setzero_ps();
+        acc[i][1] = _mm512_setzero_ps();
+    }
+    for (int p = 0; p < kc; ++p) {
+        __m512 b0 = _mm512_loadu_ps(b);
+        __m512 b1 = _mm512_loadu_ps(b + 16);
+        for (int i = 0; i < 8; ++i) {
+            __m512 ai = _mm512_set1_ps(a[i]);
+            acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+        }
+        a += 8;
+        b += 32;
+    }
+    __m512 va = _mm512_set1_ps(alpha);
+    __m512 vb = _mm512_set1_ps(beta);
+    for (int i = 0; i < 8; ++i) {
+        float* ci = c + i * ldc;
+        for (int h = 0; h < 2; ++h) {
+            __m512 r = _mm512_mul_ps(va, acc[i][h]);
+            if (beta != 0.0f) r = _mm512_fmadd_ps(vb, _mm512_loadu_ps(ci + 16 * h), r);
+            _mm512_storeu_ps(ci + 16 * h, r);
+        }
+    }
+}
+#endif
+
+const KernelInfo kGeneric{"generic", 4, 16, kernel_generic<4, 16>};
+#ifdef GEMM_X86
+const KernelInfo kAvx2{"avx2", 6, 16, kernel_avx2_6x16};
+const KernelInfo kAvx512{"avx512", 8, 32, kernel_avx512_8x32};
+#endif
+
+bool cpu_supports(const KernelInfo& k) {
+#ifdef GEMM_X86
+    __builtin_cpu_init();
+    if (&k == &kAvx512) return __builtin_cpu_supports("avx512f");
+    if (&k == &kAvx2) return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    return &k == &kGeneric;
+}
+
+const KernelInfo* detect_kernel() {
+#ifdef GEMM_X86
+    if (cpu_supports(kAvx512)) return &kAvx512;
+    if (cpu_supports(kAvx2)) return &kAvx2;
+#endif
+    return &kGeneric;
+}
+
+std::atomic<const KernelInfo*> g_kernel{detect_kernel()};
+
+// ---------------------------------------------------------------------------
+// Packing
+// ---------------------------------------------------------------------------
+
+// 64-byte aligned scratch buffer reused across calls on the same thread
+struct PackBuffer {
+    std::vector<float> storage;
+    float* get(std::size_t n) {
+        if (storage.size() < n + 16) storage.resize(n + 16);
+        auto addr = reinterpret_cast<std::uintptr_t>(storage.data());
+        return storage.data() + ((64 - addr % 64) % 64) / sizeof(float);
+    }
+};
+
+// Pack rows [0, mc) x cols [0, kc) of op(A) into mr-row micro-panels; each
+// panel stores kc columns of mr values, zero-padded past mc. A points at
+// op(A)(0, 0); element (i, p) lives at A[i * rs + p * cs].
+void pack_a(int mc, int kc, const float* A, std::size_t rs, std::size_t cs,
+            int mr, float* out) {
+    for (int ir = 0; ir < mc; ir += mr) {
+        int m = std::min(mr, mc - ir);
+        const float* src = A + ir * rs;
+        for (int p = 0; p < kc; ++p) {
+            const float* col = src + p * cs;
+            int i = 0;
+            for (; i < m; ++i) out[i] = col[i * rs];
+            for (; i < mr; ++i) out[i] = 0.0f;
+            out += mr;
+        }
+    }
+}
+
+// Pack rows [0, kc) x cols [0, n) of op(B) into one nr-column micro-panel of
+// kc rows, zero-padded past n. Element (p, j) lives at B[p * rs + j * cs].
+void pack_b_panel(int kc, int n, const float* B, std::size_t rs, std::size_t cs,
+                  int nr, float* out) {
+    for (int p = 0; p < kc; ++p) {
+        const float* src = B + p * rs;
+        int j = 0;
+        if (cs == 1) {
+            for (; j < n; ++j) out[j] = src[j];
+        } else {
+            for (; j < n; ++j) out[j] = src[j * cs];
+        }
+        for (; j < nr; ++j) out[j] = 0.0f;
+        out += nr;
+    }
+}
+
+// Sweep one packed A block over micro-panels [jr_begin, jr_end) of packed B
+void macro_kernel(const KernelInfo& k, int mc, int nc, int kc,
+                  const float* Ap, const float* Bp,
+                  int jr_begin, int jr_end,
+                  float alpha, float beta, float* C, int ldc) {
+    const int mr = k.mr, nr = k.nr;
+    float edge[8 * 32];
+    for (int jp = jr_begin; jp < jr_end; ++jp) {
+        int jr = jp * nr;
+        int n = std::min(nr, nc - jr);
+        const float* b = Bp + static_cast<std::size_t>(jp) * nr * kc;
+        for (int ir = 0; ir < mc; ir += mr) {
+            int m = std::min(mr, mc - ir);
+            const float* a = Ap + static_cast<std::size_t>(ir) * kc;
+            float* c = C + static_cast<std::size_t>(ir) * ldc + jr;
+            if (m == mr && n == nr) {
+                k.fn(kc, a, b, c, ldc, alpha, beta);
+                continue;
+            }
+            // Partial tile: compute into scratch, then merge the valid region
+            k.fn(kc, a, b, edge, nr, 1.0f, 0.0f);
+            for (int i = 0; i < m; ++i) {
+                float* ci = c + static_cast<std::size_t>(i) * ldc;
+                const float* ei = edge + i * nr;
+                if (beta == 0.0f) {
+                    for (int j = 0; j < n; ++j) ci[j] = alpha * ei[j];
+                } else {
+                    for (int j = 0; j < n; ++j) ci[j] = alpha * ei[j] + beta * ci[j];
+                }
+            }
+        }
+    }
+}
+
+// Run fn(0) .. fn(n_tasks - 1) on the shared pool
+template <typename Fn>
+void run_tasks(int n_tasks, const Fn& fn) {
+    parallel::parallel_for(0, n_tasks, 1, [&](int lo, int hi) {
+        for (int i = lo; i < hi; ++i) fn(i);
+    });
+}
+
+int round_up(int x, int m) { return (x + m - 1) / m * m; }
+
+// C = beta * C, treating beta == 0 as an overwrite
+void scale_c(int M, int N, float beta, float* C, int ldc) {
+    for (int i = 0; i < M; ++i) {
+        float* ci = C + static_cast<std::size_t>(i) * ldc;
+        if (beta == 0.0f) std::fill(ci, ci + N, 0.0f);
+        else if (beta != 1.0f) for (int j = 0; j < N; ++j) ci[j] *= beta;
+    }
+}
+
+// Skinny products where packing would waste most of the microkernel tile.
+// y[i * incy] = alpha * sum_p Mat[i * ld + p] * x[p] + beta * y[i * incy]
+void gemv_dot(int rows, int K, float alpha, const float* Mat, int ld,
+              const float* x, float beta, float* y, int incy, int threads) {
+    const int rows_per_task = 256;
+    int n_tasks = (rows + rows_per_task - 1) / rows_per_task;
+    auto task = [&](int t) {
+        int i_end = std::min(rows, (t + 1) * rows_per_task);
+        for (int i = t * rows_per_task; i < i_end; ++i) {
+            const float* mi = Mat + static_cast<std::size_t>(i) * ld;
+            float s = 0.0f;
+            for (int p = 0; p < K; ++p) s += mi[p] * x[p];
+            float& yi = y[static_cast<std::size_t>(i) * incy];
+            yi = (beta == 0.0f) ? alpha * s : alpha * s + beta * yi;
+        }
+    };
+    if (threads > 1) run_tasks(n_tasks, task);
+    else for (int t = 0; t < n_tasks; ++t) task(t);
+}
+
+// y[i * incy] = alpha * sum_p Mat[p * ld + i] * x[p] + beta * y[i * incy]
+void gemv_axpy(int rows, int K, float alpha, const float* Mat, int ld,
+               const float* x, float beta, float* y, int incy) {
+    std::vector<float> acc(rows, 0.0f);
+    for (int p = 0; p < K; ++p) {
+        float xp = x[p];
+        if (xp == 0.0f) continue;
+        const float* mp = Mat + static_cast<std::size_t>(p) * ld;
+        for (int i = 0; i < rows; ++i) acc[i] += xp * mp[i];
+    }
+    for (int i = 0; i < rows; ++i) {
+        float& yi = y[static_cast<std::size_t>(i) * incy];
+        yi = (beta == 0.0f) ? alpha * acc[i] : alpha * acc[i] + beta * yi;
+    }
+}
+
+} // namespace
+
+const char* kernel_name() {
+    return g_kernel.load()->name;
+}
+
+bool set_kernel(const std::string& name) {
+#ifdef GEMM_X86
+    for (const KernelInfo* k : {&kAvx512, &kAvx2, &kGeneric}) {
+#else
+    for (const KernelInfo* k : {&kGeneric}) {
+#endif
+        if (name == k->name) {
+            if (!cpu_supports(*k)) return false;
+            g_kernel.store(k);
+            return true;
+        }
+    }
+    return false;
+}
+
+int num_threads() {
+    return parallel::num_threads();
+}
+
+void set_num_threads(int n) {
+    parallel::set_num_threads(n);
+}
+
+void sgemm(bool trans_a, bool trans_b, int M, int N, int K,
+           float alpha, const float* A, int lda,
+           const float* B, int ldb,
+           float beta, float* C, int ldc) {
+    if (M <= 0 || N <= 0) return;
+    if (K <= 0 || alpha == 0.0f) {
+        scale_c(M, N, beta, C, ldc);
+        return;
+    }
+    // Strides of op(A)(i, p) and op(B)(p, j) in the stored row-major arrays
+    const std::size_t a_rs = trans_a ? 1 : lda, a_cs = trans_a ? lda : 1;
+    const std::size_t b_rs = trans_b ? 1 : ldb, b_cs = trans_b ? ldb : 1;
+
+    long long flops = static_cast<long long>(M) * N * K;
+    int threads = flops >= PARALLEL_MIN_FLOPS ? num_threads() : 1;
+    if (N == 1 || M == 1) {
+        // Gather the vector operand, then run a dot or axpy sweep over the
+        // matrix operand in whichever order keeps its rows contiguous
+        std::vector<float> x(K);
+        if (N == 1) {
+            for (int p = 0; p < K; ++p) x[p] = B[p * b_rs];
+            if (!trans_a) gemv_dot(M, K, alpha, A, lda, x.data(), beta, C, ldc, threads);
+            else gemv_axpy(M, K, alpha, A, lda, x.data(), beta, C, ldc);
+        } else {
+            for (int p = 0; p < K; ++p) x[p] = A[p * a_cs];
+            if (trans_b) gemv_dot(N, K, alpha, B, ldb, x.data(), beta, C, 1, threads);
+            else gemv_axpy(N, K, alpha, B, ldb, x.data(), beta, C, 1);
+        }
+        return;
+    }
+
+    const KernelInfo& k = *g_kernel.load();
+    const int mr = k.mr, nr = k.nr;
+    // Shrink the A block so every thread gets at least one block to work on
+    int mc = std::min(MC_MAX, std::max(mr, round_up((M + threads - 1) / threads, mr)));
+    int m_blocks = (M + mc - 1) / mc;
+
+    static thread_local PackBuffer b_buf;
+    static thread_local PackBuffer a_buf;
+
+    for (int jc = 0; jc < N; jc += NC) {
+        int nc = std::min(NC, N - jc);
+        int n_panels = (nc + nr - 1) / nr;
+        // Split the B panels when there are fewer A blocks than threads
+        int n_chunks = std::min(n_panels, std::max(1, threads / m_blocks));
+        int panels_per_chunk = (n_panels + n_chunks - 1) / n_chunks;
+        n_chunks = (n_panels + panels_per_chunk - 1) / panels_per_chunk;
+
+        for (int pc = 0; pc < K; pc += KC) {
+            int kc = std::min(KC, K - pc);
+            float beta_eff = (pc == 0) ? beta : 1.0f;
+            float* Bp = b_buf.get(static_cast<std::size_t>(n_panels) * nr * kc);
+            const float* Bsrc = B + pc * b_rs + jc * b_cs;
+
+            auto pack_b_task = [&](int jp) {
+                pack_b_panel(kc, std::min(nr, nc - jp * nr), Bsrc + jp * nr * b_cs,
+                             b_rs, b_cs, nr, Bp + static_cast<std::size_t>(jp) * nr * kc);
+            };
+            auto gemm_task = [&](int t) {
+                int ib = t / n_chunks;
+                int chunk = t % n_chunks;
+                int ic = ib * mc;
+                int m = std::min(mc, M - ic);
+                float* Ap = a_buf.get(static_cast<std::size_t>(round_up(m, mr)) * kc);
+                pack_a(m, kc, A + ic * a_rs + pc * a_cs, a_rs, a_cs, mr, Ap);
+                int jr_begin = chunk * panels_per_chunk;
+                int jr_end = std::min(n_panels, jr_begin + panels_per_chunk);
+                macro_kernel(k, m, nc, kc, Ap, Bp, jr_begin, jr_end, alpha, beta_eff,
+                             C + static_cast<std::size_t>(ic) * ldc + jc, ldc);
+            };
+
+            if (threads > 1) {
+                run_tasks(n_panels, pack_b_task);
+                run_tasks(m_blocks * n_chunks, gemm_task);
+            } else {
+                for (int jp = 0; jp < n_panels; ++jp) pack_b_task(jp);
+                for (int t = 0; t < m_blocks * n_chunks; ++t) gemm_task(t);
+            }
+        }
+    }
+}
+
+} // namespace gemm
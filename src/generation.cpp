@@ -0,0 +1,443 @@
+#include "generation.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+std::vector<float> token_distribution(const std::vector<float>& logits_in,
+                                      int top_k, float top_p, float temperature) {
+    int V = (int)logits_in.size();
+    std::vector<float> logit_v(V);
+    for (int i = 0; i < V; ++i) logit_v[i] = logits_in[i] / temperature;
+
+    float max_logit = *std::max_element(logit_v.begin(), logit_v.end());
+    std::vector<float> weights(V, 0.0f);
+
+    if (top_k > 0) {
+        int k = std::min(top_k, V);
+        std::vector<int> idxs(V);
+        std::iota(idxs.begin(), idxs.end(), 0);
+        std::partial_sort(idxs.begin(), idxs.begin() + k, idxs.end(),
+                          [&](int a, int b) { return logit_v[a] > logit_v[b]; });
+        for (int j = 0; j < k; ++j)
+            weights[idxs[j]] = std::exp(logit_v[idxs[j]] - max_logit);
+    } else if (top_p > 0.0f) {
+        std::vector<float> probs(V);
+        for (int i = 0; i < V; ++i) probs[i] = std::exp(logit_v[i] - max_logit);
+        float sum_probs = std::accumulate(probs.begin(), probs.end(), 0.0f);
+        std::vector<int> idxs(V);
+        std::iota(idxs.begin(), idxs.end(), 0);
+        std::sort(idxs.begin(), idxs.end(), [&](int a, int b) { return probs[a] > probs[b]; });
+        float cum = 0.0f;
+        for (int j = 0; j < V; ++j) {
+            int i = idxs[j]; cum += probs[i]; weights[i] = probs[i];
+            if (cum / sum_probs >= top_p) break;
+        }
+    } else {
+        // Greedy
+        weights[std::max_element(logit_v.begin(), logit_v.end()) - logit_v.begin()] = 1.0f;
+        return weights;
+    }
+    float total = std::accumulate(weights.begin(), weights.end(), 0.0f);
+    for (auto& w : weights) w /= total;
+    return weights;
+}
+
+int sample_next_token(const std::vector<float>& logits,
+                      int top_k, float top_p, float temperature,
+                      std::mt19937& rng) {
+    std::vector<float> probs = token_distribution(logits, top_k, top_p, temperature);
+    if (top_k <= 0 && top_p <= 0.0f) {
+        return std::max_element(probs.begin(), probs.end()) - probs.begin();
+    }
+    std::discrete_distribution<int> dist(probs.begin(), probs.end());
+    return dist(rng);
+}
+
+// Embed tokens at the given positions and run them through the paged model;
+// returns logits ([V x seqs.size()]) at each sequence's last column
+static Tensor decode_logits(const InferenceModel& m, const std::vector<int>& ids,
+                            const std::vector<int>& positions,
+                            const std::vector<PagedKVCache*>& seqs,
+                            const std::vector<int>& lens) {
+    Tensor h = m.forward(m.embed(ids, positions), seqs, lens);
+    int D = h.rows;
+    int B = static_cast<int>(seqs.size());
+    Tensor h_last(D, B);
+    int col = -1;
+    for (int b = 0; b < B; ++b) {
+        col += lens[b];
+        for (int r = 0; r < D; ++r) h_last.data[r * B + b] = h.data[r * h.cols + col];
+    }
+    return m.logits(h_last);
+}
+
+std::vector<int> beam_search(const InferenceModel& model,
+                             const std::vector<int>& prompt,
+                             const GenerateConfig& cfg, int block_size) {
+    int max_len = model.max_length();
+    if (prompt.empty() || (int)prompt.size() > max_len) {
+        throw std::invalid_argument("beam_search: prompt must hold 1..max_len tokens");
+    }
+    int beam_width = std::max(1, cfg.beam_width);
+    int P = static_cast<int>(prompt.size());
+    int total = std::min(P + cfg.max_new_tokens, max_len);
+    // Old and new beams coexist while pruning, each with a private tail
+    int per_seq = (total + block_size - 1) / block_size;
+    KVBlockPool pool(model.num_layers(), model.kv_dim(), block_size,
+                     2 * beam_width * per_seq + beam_width);
+
+    // Generated tokens as a tree of back-pointers, so beams never copy
+    // their histories
+    struct Node {
+        int token;
+        int parent;
+    };
+    std::vector<Node> nodes;
+    struct Beam {
+        int node;    // last token, -1 for the bare prompt
+        float score;
+        bool done;
+        int col;     // column in the current logits
+        PagedKVCache cache;
+    };
+
+    std::vector<Beam> beams;
+    beams.push_back({-1, 0.0f, false, 0, PagedKVCache(pool)});
+    std::vector<int> positions(P);
+    std::iota(positions.begin(), positions.end(), 0);
+    Tensor logits = decode_logits(model, prompt, positions, {&beams[0].cache}, {P});
+    int V = logits.rows;
+
+    for (int step = 0; step < cfg.max_new_tokens; ++step) {
+        // Finished beams compete unchanged; live ones offer their best tokens
+        struct Candidate {
+            int beam;
+            int token;  // -1: carry a finished beam
+            float score;
+        };
+        std::vector<Candidate> candidates;
+        int n_cols = logits.cols;
+        std::vector<float> logit_v(V);
+        std::vector<int> idxs(V);
+        for (int b = 0; b < (int)beams.size(); ++b) {
+            const Beam& beam = beams[b];
+            if (beam.done) {
+                candidates.push_back({b, -1, beam.score});
+                continue;
+            }
+            for (int i = 0; i < V; ++i)
+                logit_v[i] = logits.data[i * n_cols + beam.col];
+            float max_l = *std::max_element(logit_v.begin(), logit_v.end());
+            float sum_exp = 0.0f;
+            for (int i = 0; i < V; ++i) sum_exp += std::exp(logit_v[i] - max_l);
+            float log_sum = max_l + std::log(sum_exp);
+            int k = std::min(beam_width, V);
+            std::iota(idxs.begin(), idxs.end(), 0);
+            std::partial_sort(idxs.begin(), idxs.begin() + k, idxs.end(),
+                              [&](int a, int c) { return logit_v[a] > logit_v[c]; });
+            for (int j = 0; j < k; ++j)
+                candidates.push_back({b, idxs[j], beam.score + logit_v[idxs[j]] - log_sum});
+        }
+        int keep = std::min(beam_width, (int)candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(),
+                          [](const Candidate& a, const Candidate& c) { return a.score > c.score; });
+        candidates.resize(keep);
+
+        // Survivors fork their parent's cache; a parent's last survivor
+        // takes it over, so only siblings pay for a copy-on-write tail
+        std::vector<int> uses(beams.size(), 0);
+        for (const auto& c : candidates) {
+            if (c.token >= 0) ++uses[c.beam];
+        }
+        std::vector<Beam> next;
+        for (const auto& c : candidates) {
+            Beam& parent = beams[c.beam];
+            if (c.token < 0) {
+                next.push_back(std::move(parent));
+                continue;
+            }
+            nodes.push_back({c.token, parent.node});
+            bool done = cfg.eos_id >= 0 && c.token == cfg.eos_id;
+            PagedKVCache cache = --uses[c.beam] == 0 ? std::move(parent.cache)
+                                                     : parent.cache.fork();
+            if (done) cache.clear();
+            next.push_back({(int)nodes.size() - 1, c.score, done, 0, std::move(cache)});
+        }
+        beams = std::move(next);
+
+        // Feed each live beam's new token as one batched decode step
+        int pos = P + step;
+        if (step + 1 == cfg.max_new_tokens || pos >= max_len) break;
+        std::vector<int> ids;
+        std::vector<PagedKVCache*> seqs;
+        for (auto& beam : beams) {
+            if (beam.done) continue;
+            beam.col = static_cast<int>(ids.size());
+            ids.push_back(nodes[beam.node].token);
+            seqs.push_back(&beam.cache);
+        }
+        if (ids.empty()) break;
+        logits = decode_logits(model, ids, std::vector<int>(ids.size(), pos), seqs,
+                               std::vector<int>(ids.size(), 1));
+    }
+
+    std::vector<int> tail;
+    for (int n = beams[0].node; n >= 0; n = nodes[n].parent) tail.push_back(nodes[n].token);
+    std::vector<int> out = prompt;
+    out.insert(out.end(), tail.rbegin(), tail.rend());
+    return out;
+}
+
+// Run ids through one paged sequence and return the distributions that
+// sample_next_token would use at each of their positions
+static std::vector<std::vector<float>> cached_distributions(
+    const InferenceModel& m, const std::vector<int>& ids, PagedKVCache& cache,
+    const GenerateConfig& cfg) {
+    int n = static_cast<int>(ids.size());
+    std::vector<int> positions(n);
+    std::iota(positions.begin(), positions.end(), cache.length());
+    Tensor logits = m.logits(m.forward(m.embed(ids, positions), cache));
+    int V = logits.rows;
+    std::vector<std::vector<float>> dists(n);
+    std::vector<float> logit_v(V);
+    for (int c = 0; c < n; ++c) {
+        for (int i = 0; i < V; ++i) logit_v[i] = logits.data[i * n + c];
+        dists[c] = token_distribution(logit_v, cfg.top_k, cfg.top_p, cfg.temperature);
+    }
+    return dists;
+}
+
+static int sample_from(const std::vector<float>& probs, std::mt19937& rng) {
+    std::discrete_distribution<int> dist(probs.begin(), probs.end());
+    return dist(rng);
+}
+
+std::vector<int> speculative_generate(const InferenceModel& target,
+                                      const InferenceModel& draft,
+                                      const std::vector<int>& prompt,
+                                      const GenerateConfig& cfg, int k,
+                                      std::mt19937& rng,
+                                      SpeculativeStats* stats, int block_size) {
+    int max_len = std::min(target.max_length(), draft.max_length());
+    if (prompt.empty() || (int)prompt.size() > max_len) {
+        throw std::invalid_argument("speculative_generate: prompt must hold 1..max_len tokens");
+    }
+    if (target.vocab_size() != draft.vocab_size()) {
+        throw std::invalid_argument("speculative_generate: draft vocabulary differs from target");
+    }
+    k = std::max(1, k);
+    int per_seq = (max_len + block_size - 1) / block_size + 1;
+    KVBlockPool target_pool(target.num_layers(), target.kv_dim(), block_size, per_seq);
+    KVBlockPool draft_pool(draft.num_layers(), draft.kv_dim(), block_size, per_seq);
+    PagedKVCache target_cache(target_pool), draft_cache(draft_pool);
+
+    // Both caches hold every token except the newest, which the next round
+    // feeds first
+    std::vector<int> tokens = prompt;
+    int P = static_cast<int>(prompt.size());
+    if (P > 1) {
+        std::vector<int> head(prompt.begin(), prompt.end() - 1);
+        cached_distributions(target, head, target_cache, cfg);
+        cached_distributions(draft, head, draft_cache, cfg);
+    }
+    auto finished = [&]() {
+        int generated = static_cast<int>(tokens.size()) - P;
+        return generated >= cfg.max_new_tokens ||
+               (generated > 0 && cfg.eos_id >= 0 && tokens.back() == cfg.eos_id) ||
+               static_cast<int>(tokens.size()) > max_len;
+    };
+
+    while (!finished()) {
+        int n = static_cast<int>(tokens.size());
+        // Never propose past max_len or the token budget
+        int kk = std::min({k, max_len - n, P + cfg.max_new_tokens - n - 1});
+        // Draft: catch up on the tokens it has not seen, then propose
+        std::vector<int> proposal;
+        std::vector<std::vector<float>> q;
+        std::vector<int> feed(tokens.begin() + draft_cache.length(), tokens.end());
+        for (int i = 0; i < kk; ++i) {
+            q.push_back(cached_distributions(draft, feed, draft_cache, cfg).back());
+            proposal.push_back(sample_from(q.back(), rng));
+            feed = {proposal.back()};
+        }
+        // Target: score the newest token and every proposal in one pass
+        std::vector<int> verify = {tokens.back()};
+        verify.insert(verify.end(), proposal.begin(), proposal.end());
+        auto p = cached_distributions(target, verify, target_cache, cfg);
+
+        int accepted = 0;
+        int next = -1;
+        for (; accepted < kk; ++accepted) {
+            int x = proposal[accepted];
+            float px = p[accepted][x], qx = q[accepted][x];
+            std::uniform_real_distribution<float> u(0.0f, 1.0f);
+            if (qx > 0.0f && (px >= qx || u(rng) < px / qx)) continue;
+            // Rejected: resample from the part of p the draft under-covers
+            std::vector<float> residual(p[accepted].size());
+            float mass = 0.0f;
+            for (size_t i = 0; i < residual.size(); ++i) {
+                residual[i] = std::max(0.0f, p[accepted][i] - q[accepted][i]);
+                mass += residual[i];
+            }
+            next = sample_from(mass > 0.0f ? residual : p[accepted], rng);
+            break;
+        }
+        if (next < 0) next = sample_from(p[kk], rng);
+
+        if (stats) {
+            ++stats->rounds;
+            stats->proposed += kk;
+            stats->accepted += accepted;
+        }
+        for (int i = 0; i < accepted; ++i) {
+            tokens.push_back(proposal[i]);
+            if (cfg.eos_id >= 0 && proposal[i] == cfg.eos_id) break;
+        }
+        if (!(cfg.eos_id >= 0 && tokens.back() == cfg.eos_id && (int)tokens.size() > n)) {
+            tokens.push_back(next);
+        }
+        // Keep only positions of tokens that stay, minus the newest
+        int keep = static_cast<int>(tokens.size()) - 1;
+        target_cache.truncate(std::min(keep, target_cache.length()));
+        draft_cache.truncate(std::min(keep, draft_cache.length()));
+    }
+    if ((int)tokens.size() > P + cfg.max_new_tokens) tokens.resize(P + cfg.max_new_tokens);
+    return tokens;
+}
+
+static int default_blocks(const InferenceModel& model, int max_batch, int block_size) {
+    int max_len = model.max_length();
+    return max_batch * ((max_len + block_size - 1) / block_size);
+}
+
+BatchScheduler::BatchScheduler(const InferenceModel& model, int max_batch,
+                               int block_size, int num_blocks, int kv_window)
+    : model_(model), max_batch_(max_batch), kv_window_(kv_window),
+      pool_(model.num_layers(), model.kv_dim(), block_size,
+            num_blocks > 0 ? num_blocks : default_blocks(model, max_batch, block_size)) {
+    if (max_batch <= 0) {
+        throw std::invalid_argument("BatchScheduler: max_batch must be positive");
+    }
+}
+
+int BatchScheduler::blocks_needed(int prompt_len, const GenerateConfig& cfg) const {
+    // Every token but the last generated one is fed through the cache
+    int positions = std::min(prompt_len + cfg.max_new_tokens - 1,
+                             model_.max_length());
+    int bs = pool_.block_size();
+    return (positions + bs - 1) / bs;
+}
+
+int BatchScheduler::submit(const std::vector<int>& prompt, const GenerateConfig& cfg,
+                           unsigned seed) {
+    if (prompt.empty()) {
+        throw std::invalid_argument("BatchScheduler: empty prompt");
+    }
+    if ((int)prompt.size() > model_.max_length()) {
+        throw std::invalid_argument("BatchScheduler: prompt longer than max_len");
+    }
+    if (blocks_needed((int)prompt.size(), cfg) > pool_.num_blocks()) {
+        throw std::invalid_argument("BatchScheduler: request does not fit in the KV pool");
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    int id = next_id_++;
+    if (cfg.max_new_tokens <= 0) {
+        results_[id] = prompt;
+    } else {
+        waiting_.push_back({id, prompt, cfg, seed});
+    }
+    return id;
+}
+
+void BatchScheduler::admit() {
+    std::lock_guard<std::mutex> lock(mu_);
+    while (!waiting_.empty() && (int)running_.size() < max_batch_) {
+        Pending& p = waiting_.front();
+        int need = blocks_needed((int)p.prompt.size(), p.cfg);
+        // Admit only what is sure to finish, so no sequence is ever preempted
+        if (reserved_ + need > pool_.num_blocks()) break;
+        reserved_ += need;
+        running_.push_back(std::unique_ptr<Sequence>(new Sequence{
+            p.id, std::move(p.prompt), 0, 0, need, p.cfg, std::mt19937(p.seed),
+            PagedKVCache(pool_, kv_window_)}));
+        running_.back()->prompt_len = (int)running_.back()->tokens.size();
+        waiting_.pop_front();
+    }
+}
+
+bool BatchScheduler::step() {
+    admit();
+    if (running_.empty()) {
+        // Only a submit() that raced with admit() can be left waiting
+        std::lock_guard<std::mutex> lock(mu_);
+        return !waiting_.empty();
+    }
+
+    // New prompts contribute all their tokens, running sequences their last
+    int B = (int)running_.size();
+    std::vector<int> ids, positions, lens(B);
+    std::vector<PagedKVCache*> seqs(B);
+    for (int b = 0; b < B; ++b) {
+        Sequence& s = *running_[b];
+        for (int t = s.fed; t < (int)s.tokens.size(); ++t) {
+            ids.push_back(s.tokens[t]);
+            positions.push_back(t);
+        }
+        lens[b] = (int)s.tokens.size() - s.fed;
+        seqs[b] = &s.cache;
+    }
+    Tensor logits = decode_logits(model_, ids, positions, seqs, lens);
+    int V = logits.rows;
+    std::vector<int> next(B);
+    parallel::parallel_for(0, B, 1, [&](int lo, int hi) {
+        std::vector<float> logit_v(V);
+        for (int b = lo; b < hi; ++b) {
+            Sequence& s = *running_[b];
+            for (int i = 0; i < V; ++i)
+                logit_v[i] = logits.data[i * B + b];
+            next[b] = sample_next_token(logit_v, s.cfg.top_k, s.cfg.top_p,
+                                        s.cfg.temperature, s.rng);
+        }
+    });
+
+    std::vector<std::unique_ptr<Sequence>> still_running;
+    for (int b = 0; b < B; ++b) {
+        Sequence& s = *running_[b];
+        s.fed = (int)s.tokens.size();
+        s.tokens.push_back(next[b]);
+        bool done = (int)s.tokens.size() - s.prompt_len >= s.cfg.max_new_tokens ||
+                    (s.cfg.eos_id >= 0 && next[b] == s.cfg.eos_id) ||
+                    s.fed >= model_.max_length();
+        if (done) {
+            s.cache.clear();
+            std::lock_guard<std::mutex> lock(mu_);
+            reserved_ -= s.blocks;
+            results_[s.id] = std::move(s.tokens);
+        } else {
+            still_running.push_back(std::move(running_[b]));
+        }
+    }
+    running_ = std::move(still_running);
+    return true;
+}
+
+void BatchScheduler::run() {
+    while (step()) {
+    }
+}
+
+bool BatchScheduler::finished(int id) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return results_.count(id) > 0;
+}
+
+std::vector<int> BatchScheduler::result(int id) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = results_.find(id);
+    if (it == results_.end()) {
+        throw std::out_of_range("BatchScheduler: request not finished");
+    }
+    return it->second;
+}
@@ -0,0 +1,316 @@
+#include "inference_model.hpp"
+#include "layers/attention.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+// Same constants as ADFeedForward's tanh approximation
+static constexpr float GELU_SQRT_2_OVER_PI = 0.79788456f;
+static constexpr float GELU_COEFF = 0.044715f;
+
+static void add_bias(Tensor& y, const Tensor& b) {
+    for (int r = 0; r < y.rows; ++r) {
+        float bv = b.data[r];
+        float* row = y.data.data() + static_cast<size_t>(r) * y.cols;
+        for (int c = 0; c < y.cols; ++c) row[c] += bv;
+    }
+}
+
+static void add_into(Tensor& y, const Tensor& x) {
+    for (size_t i = 0; i < y.data.size(); ++i) y.data[i] += x.data[i];
+}
+
+InferenceModel::InferenceModel(const TransformerConfig& cfg,
+                               const std::vector<std::shared_ptr<ADTensor>>& params)
+    : cfg_(cfg) {
+    int D = cfg.embed_dim, H = cfg.hidden_dim;
+    if (cfg.n_heads <= 0 || D % cfg.n_heads != 0) {
+        throw std::invalid_argument("InferenceModel: embed_dim must be divisible by n_heads");
+    }
+    kv_heads_ = cfg.n_kv_heads > 0 ? cfg.n_kv_heads : cfg.n_heads;
+    if (cfg.n_heads % kv_heads_ != 0) {
+        throw std::invalid_argument("InferenceModel: n_heads must be divisible by n_kv_heads");
+    }
+    head_dim_ = D / cfg.n_heads;
+    int kvd = kv_dim();
+
+    // Walk the parameters in the order the training modules registered them
+    size_t next = 0;
+    auto take = [&](int rows, int cols) {
+        if (next >= params.size()) {
+            throw std::invalid_argument("InferenceModel: too few parameters for the config");
+        }
+        const Param& p = params[next++];
+        if (p->val.rows != rows || (cols >= 0 && p->val.cols != cols)) {
+            throw std::invalid_argument("InferenceModel: parameter " + std::to_string(next - 1) +
+                                        " has shape " + std::to_string(p->val.rows) + "x" +
+                                        std::to_string(p->val.cols));
+        }
+        return p;
+    };
+    auto take_ffn = [&]() {
+        FFN f;
+        f.W1 = take(H, D);
+        f.b1 = take(H, 1);
+        f.W2 = take(D, H);
+        f.b2 = take(D, 1);
+        return f;
+    };
+    embed_ = take(D, -1);
+    posenc_ = take(D, -1);
+    for (int l = 0; l < cfg.num_layers; ++l) {
+        Block b;
+        b.W_q = take(D, D);
+        b.W_k = take(kvd, D);
+        b.W_v = take(kvd, D);
+        b.W_o = take(D, D);
+        if (cfg.use_rmsnorm) {
+            b.norm1_g = take(D, 1);
+            b.norm2_g = take(D, 1);
+        } else {
+            b.norm1_g = take(D, 1);
+            b.norm1_b = take(D, 1);
+            b.norm2_g = take(D, 1);
+            b.norm2_b = take(D, 1);
+        }
+        if (cfg.use_moe) {
+            b.gate_W = take(cfg.num_experts, D);
+            b.gate_b = take(cfg.num_experts, 1);
+            for (int e = 0; e < cfg.num_experts; ++e) b.experts.push_back(take_ffn());
+        } else if (cfg.use_swiglu) {
+            b.W_gate = take(H, D);
+            b.W_up = take(H, D);
+            b.W_down = take(D, H);
+        } else {
+            b.ff = take_ffn();
+        }
+        blocks_.push_back(std::move(b));
+    }
+    out_b_ = take(vocab_size(), 1);
+    if (next != params.size()) {
+        throw std::invalid_argument("InferenceModel: more parameters than the config uses");
+    }
+
+    if (cfg.use_rope) {
+        rope_ = std::make_unique<RoPE>(head_dim_, max_length());
+    } else {
+        for (int h = 0; h < cfg.n_heads; ++h) {
+            alibi_slopes_.push_back(std::pow(2.0f, -8.0f * static_cast<float>(h + 1) /
+                                                       static_cast<float>(cfg.n_heads)));
+        }
+    }
+}
+
+Tensor InferenceModel::embed(const std::vector<int>& ids,
+                             const std::vector<int>& positions) const {
+    if (ids.size() != positions.size()) {
+        throw std::invalid_argument("InferenceModel::embed: one position per id expected");
+    }
+    int n = static_cast<int>(ids.size());
+    int V = vocab_size(), L = max_length();
+    const Tensor& E = embed_->val;
+    const Tensor& P = posenc_->val;
+    for (int c = 0; c < n; ++c) {
+        if (ids[c] < 0 || ids[c] >= V) throw std::out_of_range("Token ID out of range");
+        if (positions[c] < 0 || positions[c] >= L) {
+            throw std::out_of_range("Sequence length exceeds max_len");
+        }
+    }
+    Tensor out(embed_dim(), n);
+    for (int r = 0; r < embed_dim(); ++r)
+        for (int c = 0; c < n; ++c)
+            out.data[r * n + c] = E(r, ids[c]) + P(r, positions[c]);
+    return out;
+}
+
+Tensor InferenceModel::norm(const Tensor& x, const Param& gamma, const Param& beta) const {
+    // LayerNorm when there is a beta, else RMSNorm (the training eps values)
+    int rows = x.rows, cols = x.cols;
+    float eps = beta ? 1e-5f : 1e-6f;
+    std::vector<float> mean(cols, 0.0f), inv(cols, 0.0f);
+    if (beta) {
+        for (int i = 0; i < rows; ++i)
+            for (int j = 0; j < cols; ++j) mean[j] += x.data[i * cols + j];
+        for (int j = 0; j < cols; ++j) mean[j] /= rows;
+    }
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            float d = x.data[i * cols + j] - mean[j];
+            inv[j] += d * d;
+        }
+    }
+    for (int j = 0; j < cols; ++j) inv[j] = 1.0f / std::sqrt(inv[j] / rows + eps);
+    Tensor y(rows, cols);
+    for (int i = 0; i < rows; ++i) {
+        float g = gamma->val.data[i];
+        float b = beta ? beta->val.data[i] : 0.0f;
+        for (int j = 0; j < cols; ++j)
+            y.data[i * cols + j] = g * (x.data[i * cols + j] - mean[j]) * inv[j] + b;
+    }
+    return y;
+}
+
+static Tensor gelu_ffn(const Tensor& W1, const Tensor& b1, const Tensor& W2,
+                       const Tensor& b2, const Tensor& x) {
+    Tensor h = W1.matmul(x);
+    add_bias(h, b1);
+    for (auto& v : h.data) {
+        v = 0.5f * v * (1.0f + std::tanh(GELU_SQRT_2_OVER_PI * (v + GELU_COEFF * v * v * v)));
+    }
+    Tensor y = W2.matmul(h);
+    add_bias(y, b2);
+    return y;
+}
+
+Tensor InferenceModel::feed_forward(const Block& block, const Tensor& x) const {
+    if (cfg_.use_moe) return moe(block, x);
+    if (cfg_.use_swiglu) {
+        Tensor gate = block.W_gate->val.matmul(x);
+        Tensor up = block.W_up->val.matmul(x);
+        for (size_t i = 0; i < gate.data.size(); ++i) {
+            float g = gate.data[i];
+            gate.data[i] = g / (1.0f + std::exp(-g)) * up.data[i];
+        }
+        return block.W_down->val.matmul(gate);
+    }
+    const FFN& f = block.ff;
+    return gelu_ffn(f.W1->val, f.b1->val, f.W2->val, f.b2->val, x);
+}
+
+Tensor InferenceModel::moe(const Block& block, const Tensor& x) const {
+    // Route each column to its top-k experts with renormalized softmax
+    // weights, then run every expert on just the columns routed to it
+    int D = x.rows, N = x.cols;
+    int E = static_cast<int>(block.experts.size());
+    int k = std::min(cfg_.moe_top_k, E);
+    Tensor gates = block.gate_W->val.matmul(x);
+    add_bias(gates, block.gate_b->val);
+    std::vector<std::vector<int>> cols(E);
+    std::vector<std::vector<float>> weights(E);
+    std::vector<float> probs(E);
+    std::vector<int> idxs(E);
+    for (int j = 0; j < N; ++j) {
+        float max_g = gates(0, j);
+        for (int e = 1; e < E; ++e) max_g = std::max(max_g, gates(e, j));
+        float sum = 0.0f;
+        for (int e = 0; e < E; ++e) {
+            probs[e] = std::exp(gates(e, j) - max_g);
+            sum += probs[e];
+        }
+        for (int e = 0; e < E; ++e) probs[e] /= sum;
+        std::iota(idxs.begin(), idxs.end(), 0);
+        std::partial_sort(idxs.begin(), idxs.begin() + k, idxs.end(),
+                          [&](int a, int b) { return probs[a] > probs[b]; });
+        float kept = 0.0f;
+        for (int t = 0; t < k; ++t) kept += probs[idxs[t]];
+        for (int t = 0; t < k; ++t) {
+            cols[idxs[t]].push_back(j);
+            weights[idxs[t]].push_back(probs[idxs[t]] / kept);
+        }
+    }
+    std::vector<Tensor> outs(E, Tensor(0, 0));
+    parallel::parallel_for(0, E, 1, [&](int lo, int hi) {
+        for (int e = lo; e < hi; ++e) {
+            int n = static_cast<int>(cols[e].size());
+            if (n == 0) continue;
+            Tensor xe(D, n);
+            for (int r = 0; r < D; ++r)
+                for (int c = 0; c < n; ++c) xe.data[r * n + c] = x.data[r * N + cols[e][c]];
+            const FFN& f = block.experts[e];
+            outs[e] = gelu_ffn(f.W1->val, f.b1->val, f.W2->val, f.b2->val, xe);
+        }
+    });
+    // Combine in expert order, as training does
+    Tensor out(D, N);
+    out.fill(0.0f);
+    for (int e = 0; e < E; ++e) {
+        int n = static_cast<int>(cols[e].size());
+        for (int r = 0; r < D; ++r)
+            for (int c = 0; c < n; ++c)
+                out.data[r * N + cols[e][c]] += weights[e][c] * outs[e].data[r * n + c];
+    }
+    return out;
+}
+
+Tensor InferenceModel::forward(const Tensor& x, PagedKVCache& cache) const {
+    return forward(x, std::vector<PagedKVCache*>{&cache}, {x.cols});
+}
+
+Tensor InferenceModel::forward(const Tensor& x, const std::vector<PagedKVCache*>& seqs,
+                               const std::vector<int>& lens) const {
+    if (seqs.size() != lens.size()) {
+        throw std::invalid_argument("InferenceModel: one length per sequence expected");
+    }
+    if (x.rows != embed_dim()) {
+        throw std::invalid_argument("InferenceModel: input rows != embed_dim");
+    }
+    int N = x.cols;
+    std::vector<PagedSpan> spans;
+    int col = 0;
+    for (size_t i = 0; i < seqs.size(); ++i) {
+        const KVBlockPool& pool = seqs[i]->pool();
+        if (pool.num_layers() != num_layers() || pool.dim() != kv_dim()) {
+            throw std::invalid_argument("InferenceModel: KV block pool shape mismatch");
+        }
+        spans.push_back({seqs[i], col, lens[i], 0});
+        col += lens[i];
+    }
+    if (col != N) {
+        throw std::invalid_argument("InferenceModel: sequence lengths do not cover the input");
+    }
+    std::vector<int> positions(N);
+    for (auto& span : spans) {
+        span.pos = span.cache->extend(span.len);
+        std::iota(positions.begin() + span.col, positions.begin() + span.col + span.len,
+                  span.pos);
+    }
+
+    const float* alibi = rope_ ? nullptr : alibi_slopes_.data();
+    Tensor h = x;
+    for (int l = 0; l < num_layers(); ++l) {
+        const Block& b = blocks_[l];
+        // Pre-norm attention over every sequence's cache
+        Tensor a = norm(h, b.norm1_g, b.norm1_b);
+        Tensor Q = b.W_q->val.matmul(a);
+        Tensor K = b.W_k->val.matmul(a);
+        Tensor V = b.W_v->val.matmul(a);
+        if (rope_) {
+            rope_->rotate(Q.data.data(), Q.rows, N, positions.data());
+            rope_->rotate(K.data.data(), K.rows, N, positions.data());
+        }
+        Tensor concat(embed_dim(), N);
+        parallel::parallel_for(0, static_cast<int>(spans.size()), 1, [&](int lo, int hi) {
+            for (int s = lo; s < hi; ++s) {
+                const PagedSpan& span = spans[s];
+                PagedKVCache& paged = *span.cache;
+                paged.write(l, span.pos, K, V, span.col, span.len);
+                KVBlockPool& pool = paged.pool();
+                int bs = pool.block_size();
+                int base = paged.first_block() * bs;
+                int kv_len = span.pos + span.len;
+                std::vector<KVSegment> segs;
+                for (int p = base; p < kv_len; p += bs) {
+                    int blk = paged.blocks()[p / bs];
+                    segs.push_back({pool.keys(l, blk), pool.values(l, blk), bs,
+                                    std::min(bs, kv_len - p)});
+                }
+                attend_segments(Q.data.data() + span.col, N, span.len, segs, cfg_.n_heads,
+                                kv_heads_, head_dim_, span.pos - base, true, paged.window(),
+                                alibi, 0.0f, concat.data.data() + span.col, N);
+            }
+        });
+        add_into(h, b.W_o->val.matmul(concat));
+        // Pre-norm feed-forward
+        add_into(h, feed_forward(b, norm(h, b.norm2_g, b.norm2_b)));
+    }
+    return h;
+}
+
+Tensor InferenceModel::logits(const Tensor& h) const {
+    Tensor out(vocab_size(), h.cols);
+    Tensor::gemm(true, false, 1.0f, embed_->val, h, 0.0f, out);
+    add_bias(out, out_b_->val);
+    return out;
+}
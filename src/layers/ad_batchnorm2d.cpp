@@ -1,4 +1,6 @@
 #include "layers/ad_batchnorm2d.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
 #include <cmath>
 #include <stdexcept>
 
@@ -13,8 +15,8 @@ ADBatchNorm2D::ADBatchNorm2D(int nf, float eps, float momentum)
     running_mean.fill(0.0f);
     running_var.fill(1.0f);
 
-    register_parameter(gamma);
-    register_parameter(beta);
+    register_parameter(gamma, "gamma");
+    register_parameter(beta, "beta");
 }
 
 std::shared_ptr<ADTensor> ADBatchNorm2D::forward(const std::shared_ptr<ADTensor>& input) {
@@ -25,40 +27,46 @@ std::shared_ptr<ADTensor> ADBatchNorm2D::forward(const std::shared_ptr<ADTensor>
 
     int spatial = H * W;
     int n = B * spatial;
+    // Channels are independent; give each pool task ~16K elements
+    int grain = std::max(1, (1 << 14) / std::max(1, n));
 
     // Compute per-channel mean and variance
     std::vector<float> mean(C, 0.0f), var(C, 0.0f);
-    for (int c = 0; c < C; ++c) {
-        float sum = 0.0f;
-        for (int b = 0; b < B; ++b) {
-            for (int hw = 0; hw < spatial; ++hw) {
-                sum += input->val.data[(b * C + c) * spatial + hw];
+    parallel::parallel_for(0, C, grain, [&](int c_lo, int c_hi) {
+        for (int c = c_lo; c < c_hi; ++c) {
+            float sum = 0.0f;
+            for (int b = 0; b < B; ++b) {
+                for (int hw = 0; hw < spatial; ++hw) {
+                    sum += input->val.data[(b * C + c) * spatial + hw];
+                }
             }
-        }
-        mean[c] = sum / n;
+            mean[c] = sum / n;
 
-        float vsum = 0.0f;
-        for (int b = 0; b < B; ++b) {
-            for (int hw = 0; hw < spatial; ++hw) {
-                float d = input->val.data[(b * C + c) * spatial + hw] - mean[c];
-                vsum += d * d;
+            float vsum = 0.0f;
+            for (int b = 0; b < B; ++b) {
+                for (int hw = 0; hw < spatial; ++hw) {
+                    float d = input->val.data[(b * C + c) * spatial + hw] - mean[c];
+                    vsum += d * d;
+                }
             }
+            var[c] = vsum / n;
         }
-        var[c] = vsum / n;
-    }
+    });
 
     // Normalize and apply gamma/beta
     Tensor out_val(s);
-    for (int b = 0; b < B; ++b) {
-        for (int c = 0; c < C; ++c) {
-            float inv_std = 1.0f / std::sqrt(var[c] + eps);
-            for (int hw = 0; hw < spatial; ++hw) {
-                int idx = (b * C + c) * spatial + hw;
-                float normalized = (input->val.data[idx] - mean[c]) * inv_std;
-                out_val.data[idx] = gamma->val.data[c] * normalized + beta->val.data[c];
+    parallel::parallel_for(0, C, grain, [&](int c_lo, int c_hi) {
+        for (int b = 0; b < B; ++b) {
+            for (int c = c_lo; c < c_hi; ++c) {
+                float inv_std = 1.0f / std::sqrt(var[c] + eps);
+                for (int hw = 0; hw < spatial; ++hw) {
+                    int idx = (b * C + c) * spatial + hw;
+                    float normalized = (input->val.data[idx] - mean[c]) * inv_std;
+                    out_val.data[idx] = gamma->val.data[c] * normalized + beta->val.data[c];
+                }
             }
         }
-    }
+    });
 
     // Update running stats
     if (training) {
@@ -68,67 +76,50 @@ std::shared_ptr<ADTensor> ADBatchNorm2D::forward(const std::shared_ptr<ADTensor>
         }
     }
 
-    auto out = std::make_shared<ADTensor>(out_val);
-    auto g = gamma;
-    auto be = beta;
+    auto out = make_op_result(std::move(out_val));
     float e = eps;
 
-    // Backward for input
-    out->deps.emplace_back(input, [input, out, g, mean, var, e, B, C, spatial]() {
-        for (int c = 0; c < C; ++c) {
-            float inv_std = 1.0f / std::sqrt(var[c] + e);
-            int n = B * spatial;
-
-            // Compute sum of grad_out and sum of grad_out * (x - mean)
-            float sum_grad = 0.0f, sum_grad_x = 0.0f;
-            for (int b = 0; b < B; ++b) {
-                for (int hw = 0; hw < spatial; ++hw) {
-                    int idx = (b * C + c) * spatial + hw;
-                    float go = out->grad.data[idx] * g->val.data[c];
-                    sum_grad += go;
-                    sum_grad_x += go * (input->val.data[idx] - mean[c]);
-                }
-            }
-
-            for (int b = 0; b < B; ++b) {
-                for (int hw = 0; hw < spatial; ++hw) {
-                    int idx = (b * C + c) * spatial + hw;
-                    float go = out->grad.data[idx] * g->val.data[c];
-                    float xhat = (input->val.data[idx] - mean[c]) * inv_std;
-                    input->grad.data[idx] += inv_std * (go - sum_grad / n - xhat * sum_grad_x * inv_std / n);
-                }
-            }
-        }
-    });
+    record_backward(out, [in = input.get(), out = out.get(), g = gamma.get(), be = beta.get(),
+                          mean = std::move(mean), var = std::move(var), e, B, C, spatial,
+                          grain]() {
+        Tensor* gin = grad_of(in);
+        Tensor* gg = grad_of(g);
+        Tensor* gbe = grad_of(be);
+        int n = B * spatial;
+        parallel::parallel_for(0, C, grain, [&](int c_lo, int c_hi) {
+            for (int c = c_lo; c < c_hi; ++c) {
+                float inv_std = 1.0f / std::sqrt(var[c] + e);
 
-    // Backward for gamma
-    out->deps.emplace_back(g, [input, out, g, mean, var, e, B, C, spatial]() {
-        for (int c = 0; c < C; ++c) {
-            float inv_std = 1.0f / std::sqrt(var[c] + e);
-            float sum = 0.0f;
-            for (int b = 0; b < B; ++b) {
-                for (int hw = 0; hw < spatial; ++hw) {
-                    int idx = (b * C + c) * spatial + hw;
-                    float xhat = (input->val.data[idx] - mean[c]) * inv_std;
-                    sum += out->grad.data[idx] * xhat;
+                // Sums of grad_out, grad_out * xhat and (for the input) of the
+                // gamma-scaled versions
+                float sum_go = 0.0f, sum_go_xhat = 0.0f;
+                for (int b = 0; b < B; ++b) {
+                    for (int hw = 0; hw < spatial; ++hw) {
+                        int idx = (b * C + c) * spatial + hw;
+                        float go = out->grad.data[idx];
+                        sum_go += go;
+                        sum_go_xhat += go * (in->val.data[idx] - mean[c]) * inv_std;
+                    }
                 }
-            }
-            g->grad.data[c] += sum;
-        }
-    });
+                if (gg) gg->data[c] += sum_go_xhat;
+                if (gbe) gbe->data[c] += sum_go;
 
-    // Backward for beta
-    out->deps.emplace_back(be, [out, be, B, C, spatial]() {
-        for (int c = 0; c < C; ++c) {
-            float sum = 0.0f;
-            for (int b = 0; b < B; ++b) {
-                for (int hw = 0; hw < spatial; ++hw) {
-                    sum += out->grad.data[(b * C + c) * spatial + hw];
+                if (gin) {
+                    float gc = g->val.data[c];
+                    float sum_grad = sum_go * gc;
+                    float sum_grad_x = sum_go_xhat * gc / inv_std;
+                    for (int b = 0; b < B; ++b) {
+                        for (int hw = 0; hw < spatial; ++hw) {
+                            int idx = (b * C + c) * spatial + hw;
+                            float go = out->grad.data[idx] * gc;
+                            float xhat = (in->val.data[idx] - mean[c]) * inv_std;
+                            gin->data[idx] += inv_std * (go - sum_grad / n - xhat * sum_grad_x * inv_std / n);
+                        }
+                    }
                 }
             }
-            be->grad.data[c] += sum;
-        }
-    });
+        });
+    }, input, gamma, beta);
 
     return out;
 }
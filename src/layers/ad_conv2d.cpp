@@ -15,8 +15,8 @@ ADConv2D::ADConv2D(int in_ch, int out_ch, int kernel_sz, int s, int p)
     for (auto& v : weight->val.data) v = dist(rng);
     bias->val.fill(0.0f);
 
-    register_parameter(weight);
-    register_parameter(bias);
+    register_parameter(weight, "weight");
+    register_parameter(bias, "bias");
 }
 
 Tensor ADConv2D::im2col(const Tensor& input, int B, int C, int H, int W,
@@ -93,13 +93,13 @@ std::shared_ptr<ADTensor> ADConv2D::forward(const std::shared_ptr<ADTensor>& inp
     // im2col: [B*Hout*Wout, Cin*kH*kW]
     Tensor col = im2col(input->val, B, C, H, W, kH, kW, stride, padding, Hout, Wout);
 
-    // Reshape weight to [Cout, Cin*kH*kW] then transpose to [Cin*kH*kW, Cout]
+    // Reshape weight to [Cout, Cin*kH*kW]
     Tensor w_mat(out_channels, in_channels * kH * kW);
     std::copy(weight->val.data.begin(), weight->val.data.end(), w_mat.data.begin());
-    Tensor w_matT = w_mat.transpose();
 
-    // matmul: [B*Hout*Wout, Cin*kH*kW] x [Cin*kH*kW, Cout] = [B*Hout*Wout, Cout]
-    Tensor out_mat = col.matmul(w_matT);
+    // col x w_mat^T: [B*Hout*Wout, Cin*kH*kW] x [Cin*kH*kW, Cout] = [B*Hout*Wout, Cout]
+    Tensor out_mat(col.rows, out_channels);
+    Tensor::gemm(false, true, 1.0f, col, w_mat, 0.0f, out_mat);
 
     // Add bias
     for (int i = 0; i < out_mat.rows; ++i) {
@@ -122,16 +122,13 @@ std::shared_ptr<ADTensor> ADConv2D::forward(const std::shared_ptr<ADTensor>& inp
         }
     }
 
-    auto out = std::make_shared<ADTensor>(out_val);
+    auto out = make_op_result(std::move(out_val));
 
-    // Backward for input
-    auto self = this;
-    auto w = weight;
-    auto bi = bias;
     int ic = in_channels, oc = out_channels;
     int str = stride, pad = padding;
 
-    out->deps.emplace_back(input, [input, out, w, ic, oc, kH, kW, str, pad, B, C, H, W, Hout, Wout]() {
+    record_backward(out, [in = input.get(), out = out.get(), w = weight.get(), bi = bias.get(),
+                          ic, oc, kH, kW, str, pad, B, C, H, W, Hout, Wout]() {
         // grad_out shape: [B, Cout, Hout, Wout]
         // Reshape to [B*Hout*Wout, Cout]
         Tensor grad_mat(B * Hout * Wout, oc);
@@ -147,57 +144,44 @@ std::shared_ptr<ADTensor> ADConv2D::forward(const std::shared_ptr<ADTensor>& inp
             }
         }
 
-        // d_input: grad_mat [B*Hout*Wout, Cout] x weight_mat [Cout, Cin*kH*kW] -> [B*Hout*Wout, Cin*kH*kW]
-        Tensor w_mat(oc, ic * kH * kW);
-        std::copy(w->val.data.begin(), w->val.data.end(), w_mat.data.begin());
-        Tensor d_col = grad_mat.matmul(w_mat);
+        if (Tensor* gin = grad_of(in)) {
+            // d_input: grad_mat [B*Hout*Wout, Cout] x weight_mat [Cout, Cin*kH*kW] -> [B*Hout*Wout, Cin*kH*kW]
+            Tensor w_mat(oc, ic * kH * kW);
+            std::copy(w->val.data.begin(), w->val.data.end(), w_mat.data.begin());
+            Tensor d_col = grad_mat.matmul(w_mat);
 
-        // col2im to get input gradient
-        Tensor d_input = ADConv2D::col2im(d_col, B, C, H, W, kH, kW, str, pad, Hout, Wout);
-        for (size_t i = 0; i < input->grad.data.size(); ++i) {
-            input->grad.data[i] += d_input.data[i];
-        }
-    });
-
-    // Backward for weight
-    out->deps.emplace_back(w, [input, out, w, ic, oc, kH, kW, str, pad, B, C, H, W, Hout, Wout]() {
-        Tensor grad_mat(B * Hout * Wout, oc);
-        for (int b = 0; b < B; ++b) {
-            for (int c = 0; c < oc; ++c) {
-                for (int oh = 0; oh < Hout; ++oh) {
-                    for (int ow = 0; ow < Wout; ++ow) {
-                        int mat_row = b * Hout * Wout + oh * Wout + ow;
-                        int grad_idx = ((b * oc + c) * Hout + oh) * Wout + ow;
-                        grad_mat(mat_row, c) = out->grad.data[grad_idx];
-                    }
-                }
+            // col2im to get input gradient
+            Tensor d_input = ADConv2D::col2im(d_col, B, C, H, W, kH, kW, str, pad, Hout, Wout);
+            for (size_t i = 0; i < gin->data.size(); ++i) {
+                gin->data[i] += d_input.data[i];
             }
         }
 
-        Tensor col = ADConv2D::im2col(input->val, B, C, H, W, kH, kW, str, pad, Hout, Wout);
-        // d_weight: grad_mat^T [Cout, B*Hout*Wout] x col [B*Hout*Wout, Cin*kH*kW] = [Cout, Cin*kH*kW]
-        Tensor grad_matT = grad_mat.transpose();
-        Tensor dw = grad_matT.matmul(col);
-        for (size_t i = 0; i < w->grad.data.size(); ++i) {
-            w->grad.data[i] += dw.data[i];
+        if (Tensor* gw = grad_of(w)) {
+            Tensor col = ADConv2D::im2col(in->val, B, C, H, W, kH, kW, str, pad, Hout, Wout);
+            // d_weight: grad_mat^T [Cout, B*Hout*Wout] x col [B*Hout*Wout, Cin*kH*kW] = [Cout, Cin*kH*kW]
+            Tensor dw(oc, ic * kH * kW);
+            Tensor::gemm(true, false, 1.0f, grad_mat, col, 0.0f, dw);
+            for (size_t i = 0; i < gw->data.size(); ++i) {
+                gw->data[i] += dw.data[i];
+            }
         }
-    });
 
-    // Backward for bias
-    out->deps.emplace_back(bi, [out, bi, oc, B, Hout, Wout]() {
-        for (int b = 0; b < B; ++b) {
-            for (int c = 0; c < oc; ++c) {
-                float sum = 0.0f;
-                for (int oh = 0; oh < Hout; ++oh) {
-                    for (int ow = 0; ow < Wout; ++ow) {
-                        int idx = ((b * oc + c) * Hout + oh) * Wout + ow;
-                        sum += out->grad.data[idx];
+        if (Tensor* gb = grad_of(bi)) {
+            for (int b = 0; b < B; ++b) {
+                for (int c = 0; c < oc; ++c) {
+                    float sum = 0.0f;
+                    for (int oh = 0; oh < Hout; ++oh) {
+                        for (int ow = 0; ow < Wout; ++ow) {
+                            int idx = ((b * oc + c) * Hout + oh) * Wout + ow;
+                            sum += out->grad.data[idx];
+                        }
                     }
+                    gb->data[c] += sum;
                 }
-                bi->grad.data[c] += sum;
             }
         }
-    });
+    }, input, weight, bias);
 
     return out;
 }
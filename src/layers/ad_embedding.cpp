@@ -12,21 +12,13 @@ ADEmbedding::ADEmbedding(int vocab_size_, int embed_dim_)
     std::uniform_real_distribution<float> dist(-r, r);
     for (auto &v : tW.data) v = dist(gen);
     weights = make_ad(tW);
-    register_parameter(weights);
+    register_parameter(weights, "embedding");
 }
 
 std::shared_ptr<ADTensor> ADEmbedding::forward(const std::vector<int>& tokens) const {
-    int seq_len = static_cast<int>(tokens.size());
-    // Build one-hot matrix [vocab_size x seq_len]
-    Tensor X(vocab_size, seq_len);
-    for (int j = 0; j < seq_len; ++j) {
-        int id = tokens[j];
+    for (int id : tokens) {
         if (id < 0 || id >= vocab_size) throw std::out_of_range("Token ID out of range");
-        for (int i = 0; i < vocab_size; ++i) {
-            X.data[i * seq_len + j] = (i == id ? 1.0f : 0.0f);
-        }
     }
-    auto X_ad = make_ad(X);
-    // Multiply: [embed_dim x vocab_size] * [vocab_size x seq_len] -> [embed_dim x seq_len]
-    return matmul(weights, X_ad);
+    // Pick token columns: [embed_dim x vocab_size] -> [embed_dim x seq_len]
+    return gather_cols(weights, tokens);
 }
\ No newline at end of file
@@ -14,35 +14,21 @@ ADFeedForward::ADFeedForward(int embed_dim, int hidden_dim) {
     for (auto &v : tW2.data) v = dist2(gen);
     tb2.fill(0.0f);
 
-    W1 = make_ad(tW1); register_parameter(W1);
-    b1 = make_ad(tb1); register_parameter(b1);
-    W2 = make_ad(tW2); register_parameter(W2);
-    b2 = make_ad(tb2); register_parameter(b2);
+    W1 = make_ad(tW1); register_parameter(W1, "W1");
+    b1 = make_ad(tb1); register_parameter(b1, "b1");
+    W2 = make_ad(tW2); register_parameter(W2, "W2");
+    b2 = make_ad(tb2); register_parameter(b2, "b2");
 }
 
 std::shared_ptr<ADTensor> ADFeedForward::forward(const std::shared_ptr<ADTensor>& x) {
-    int seq_len = x->val.cols;
-    if (seq_len != cached_seq_len) {
-        cached_ones1 = Tensor(1, seq_len);
-        cached_ones1.data.assign(seq_len, 1.0f);
-        cached_ones2 = Tensor(1, seq_len);
-        cached_ones2.data.assign(seq_len, 1.0f);
-        cached_seq_len = seq_len;
-    }
-    auto lin1 = matmul(W1, x);
-    auto ones_row1 = make_ad(cached_ones1);
-    auto b1_mat = matmul(b1, ones_row1);
-    auto h1 = add(lin1, b1_mat);
+    auto h1 = add_bias_broadcast(matmul(W1, x), b1);
     // GELU
     auto x3 = mul(mul(h1, h1), h1);
     auto inner = add(h1, scalar_mul(x3, 0.044715f));
     auto tanh_in = scalar_mul(inner, 0.79788456f);
     auto tanh_out = tanh_ad(tanh_in);
-    auto one = make_ad(Tensor(h1->val.rows, h1->val.cols));
+    auto one = make_const(Tensor(h1->val.rows, h1->val.cols));
     one->val.fill(1.0f);
     auto gelu = mul(scalar_mul(h1, 0.5f), add(one, tanh_out));
-    auto lin2 = matmul(W2, gelu);
-    auto ones_row2 = make_ad(cached_ones2);
-    auto b2_mat = matmul(b2, ones_row2);
-    return add(lin2, b2_mat);
+    return add_bias_broadcast(matmul(W2, gelu), b2);
 }
\ No newline at end of file
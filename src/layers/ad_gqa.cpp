@@ -2,7 +2,6 @@
 #include <random>
 #include <stdexcept>
 #include <cmath>
-#include <limits>
 
 ADGQA::ADGQA(int embed_dim_, int num_heads_, int num_kv_heads_, bool causal_)
     : embed_dim(embed_dim_), num_heads(num_heads_), num_kv_heads(num_kv_heads_), causal(causal_) {
@@ -38,10 +37,10 @@ ADGQA::ADGQA(int embed_dim_, int num_heads_, int num_kv_heads_, bool causal_)
     for (auto& v : tWv.data) v = dist_kv(gen);
     for (auto& v : tWo.data) v = dist_q(gen);
 
-    W_q = make_ad(tWq); register_parameter(W_q);
-    W_k = make_ad(tWk); register_parameter(W_k);
-    W_v = make_ad(tWv); register_parameter(W_v);
-    W_o = make_ad(tWo); register_parameter(W_o);
+    W_q = make_ad(tWq); register_parameter(W_q, "W_q");
+    W_k = make_ad(tWk); register_parameter(W_k, "W_k");
+    W_v = make_ad(tWv); register_parameter(W_v, "W_v");
+    W_o = make_ad(tWo); register_parameter(W_o, "W_o");
 }
 
 std::shared_ptr<ADTensor> ADGQA::forward(const std::shared_ptr<ADTensor>& input) {
@@ -50,70 +49,10 @@ std::shared_ptr<ADTensor> ADGQA::forward(const std::shared_ptr<ADTensor>& input)
     auto V = matmul(W_v, input);  // [kv_dim x seq_len]
 
     int seq_len = input->val.cols;
-    std::vector<std::shared_ptr<ADTensor>> heads;
-    heads.reserve(num_heads);
-
-    for (int h = 0; h < num_heads; ++h) {
-        int q_offset = h * head_dim;
-        // KV head index: multiple Q heads share the same KV head
-        int kv_head = h / kv_group_size;
-        int kv_offset = kv_head * head_dim;
-
-        auto Qh = slice(Q, q_offset, head_dim);
-        auto Kh = slice(K, kv_offset, head_dim);
-        auto Vh = slice(V, kv_offset, head_dim);
-
-        auto Qh_T = transpose(Qh);
-        auto scores = matmul(Qh_T, Kh);
-        float scale = 1.0f / std::sqrt((float)head_dim);
-        auto scores_scaled = scalar_mul(scores, scale);
-
-        // ALiBi bias + causal mask
-        {
-            Tensor bias_t(seq_len, seq_len);
-            for (int i = 0; i < seq_len; ++i) {
-                for (int j = 0; j < seq_len; ++j) {
-                    if (causal && j > i) {
-                        bias_t.data[i * seq_len + j] = -std::numeric_limits<float>::infinity();
-                    } else {
-                        bias_t.data[i * seq_len + j] = -std::abs(j - i) * alibi_slopes[h];
-                    }
-                }
-            }
-            auto bias_ad = make_ad(bias_t);
-            scores_scaled = add(scores_scaled, bias_ad);
-        }
-
-        // Row-wise softmax
-        Tensor row_max_t(seq_len, 1);
-        for (int i = 0; i < seq_len; ++i) {
-            float mx = scores_scaled->val.data[i * seq_len];
-            for (int j = 1; j < seq_len; ++j) {
-                mx = std::max(mx, scores_scaled->val.data[i * seq_len + j]);
-            }
-            row_max_t.data[i] = mx;
-        }
-        Tensor ones_row_t(1, seq_len);
-        for (int j = 0; j < seq_len; ++j) ones_row_t.data[j] = 1.0f;
-        auto ones_row = make_ad(ones_row_t);
-        auto row_max_ad = make_ad(row_max_t);
-        auto max_broadcast = matmul(row_max_ad, ones_row);
-        auto scores_shifted = sub(scores_scaled, max_broadcast);
-        auto scores_exp = exp_ad(scores_shifted);
-
-        Tensor ones_col_t(seq_len, 1);
-        for (int i = 0; i < seq_len; ++i) ones_col_t.data[i] = 1.0f;
-        auto ones_col = make_ad(ones_col_t);
-        auto denom_col = matmul(scores_exp, ones_col);
-        auto denom = matmul(denom_col, ones_row);
-        auto denom_recip = reciprocal(denom);
-        auto attn = mul(scores_exp, denom_recip);
-        auto attn_T = transpose(attn);
-        auto head_out = matmul(Vh, attn_T);
-        heads.push_back(head_out);
-    }
-
-    auto concat_out = concat(heads);
+    float scale = 1.0f / std::sqrt((float)head_dim);
+    // Query head h reads KV head h / kv_group_size in place; ALiBi and the
+    // causal mask are applied inside the kernel
+    auto concat_out = attention_ad(Q, K, V, num_heads, seq_len, causal, scale, &alibi_slopes);
     auto out = matmul(W_o, concat_out);
     return out;
 }
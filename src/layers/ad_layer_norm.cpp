@@ -1,53 +1,86 @@
 #include "layers/ad_layer_norm.hpp"
 #include <stdexcept>
 #include <cmath>
+#include <vector>
+
+// Fused layer norm over the rows of each column: one node whose backward
+// needs only the per-column mean and 1/std saved here
+static std::shared_ptr<ADTensor> layer_norm_ad(const std::shared_ptr<ADTensor>& x,
+                                               const std::shared_ptr<ADTensor>& gamma,
+                                               const std::shared_ptr<ADTensor>& beta,
+                                               float eps) {
+    int rows = x->val.rows, cols = x->val.cols;
+    const float* xd = x->val.data.data();
+    std::vector<float> mean(cols, 0.0f), inv_std(cols, 0.0f);
+    for (int i = 0; i < rows; ++i)
+        for (int j = 0; j < cols; ++j) mean[j] += xd[i * cols + j];
+    for (int j = 0; j < cols; ++j) mean[j] /= rows;
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            float d = xd[i * cols + j] - mean[j];
+            inv_std[j] += d * d;
+        }
+    }
+    for (int j = 0; j < cols; ++j) inv_std[j] = 1.0f / std::sqrt(inv_std[j] / rows + eps);
+
+    Tensor y(rows, cols);
+    for (int i = 0; i < rows; ++i) {
+        float g = gamma->val.data[i], b = beta->val.data[i];
+        for (int j = 0; j < cols; ++j)
+            y.data[i * cols + j] = g * (xd[i * cols + j] - mean[j]) * inv_std[j] + b;
+    }
+    auto out = make_op_result(std::move(y));
+    record_backward(out, [x = x.get(), gamma = gamma.get(), beta = beta.get(), out = out.get(),
+                          mean = std::move(mean), inv_std = std::move(inv_std), rows, cols]() {
+        const float* xd = x->val.data.data();
+        const float* go = out->grad.data.data();
+        Tensor* gg = grad_of(gamma);
+        Tensor* gb = grad_of(beta);
+        for (int i = 0; i < rows; ++i) {
+            float sg = 0.0f, sb = 0.0f;
+            for (int j = 0; j < cols; ++j) {
+                float xhat = (xd[i * cols + j] - mean[j]) * inv_std[j];
+                sg += go[i * cols + j] * xhat;
+                sb += go[i * cols + j];
+            }
+            if (gg) gg->data[i] += sg;
+            if (gb) gb->data[i] += sb;
+        }
+        Tensor* gx = grad_of(x);
+        if (!gx) return;
+        // dx = inv_std / N * (N * dxhat - sum(dxhat) - xhat * sum(dxhat * xhat))
+        std::vector<float> s1(cols, 0.0f), s2(cols, 0.0f);
+        for (int i = 0; i < rows; ++i) {
+            float g = gamma->val.data[i];
+            for (int j = 0; j < cols; ++j) {
+                float dxhat = go[i * cols + j] * g;
+                s1[j] += dxhat;
+                s2[j] += dxhat * (xd[i * cols + j] - mean[j]) * inv_std[j];
+            }
+        }
+        float inv_n = 1.0f / rows;
+        for (int i = 0; i < rows; ++i) {
+            float g = gamma->val.data[i];
+            for (int j = 0; j < cols; ++j) {
+                float xhat = (xd[i * cols + j] - mean[j]) * inv_std[j];
+                float dxhat = go[i * cols + j] * g;
+                gx->data[i * cols + j] += inv_std[j] * (dxhat - inv_n * (s1[j] + xhat * s2[j]));
+            }
+        }
+    }, x, gamma, beta);
+    return out;
+}
 
 ADLayerNorm::ADLayerNorm(int dim_, float eps_)
     : dim(dim_), eps(eps_) {
     Tensor tg(dim, 1), tb(dim, 1);
     tg.fill(1.0f);
     tb.fill(0.0f);
-    gamma = make_ad(tg); register_parameter(gamma);
-    beta  = make_ad(tb); register_parameter(beta);
+    gamma = make_ad(tg); register_parameter(gamma, "gamma");
+    beta  = make_ad(tb); register_parameter(beta, "beta");
 }
 
 std::shared_ptr<ADTensor> ADLayerNorm::forward(const std::shared_ptr<ADTensor>& x) {
-    int rows = dim;
-    int cols = x->val.cols;
-    // Cache ones tensors when dimensions change
-    if (cols != cached_cols) {
-        cached_ones_row = Tensor(1, rows);
-        cached_ones_row.data.assign(rows, 1.0f);
-        cached_ones_col = Tensor(rows, 1);
-        cached_ones_col.data.assign(rows, 1.0f);
-        cached_ones_cols = Tensor(1, cols);
-        cached_ones_cols.data.assign(cols, 1.0f);
-        cached_cols = cols;
-    }
-    // sum over rows: mean = (1/rows) * sum_i x[i, j]
-    auto ones1 = make_ad(cached_ones_row);
-    auto sum1 = matmul(ones1, x);
-    auto mean = scalar_mul(sum1, 1.0f / rows);
-    // broadcast mean
-    auto ones2 = make_ad(cached_ones_col);
-    auto mean_b = matmul(ones2, mean);
-    auto x_cent = sub(x, mean_b);
-    // variance
-    auto x2 = mul(x_cent, x_cent);
-    auto sum2 = matmul(ones1, x2);
-    auto var = scalar_mul(sum2, 1.0f / rows);
-    // add eps
-    Tensor eps_t(1, cols);
-    eps_t.data.assign(cols, eps);
-    auto eps_ad = make_ad(eps_t);
-    auto var_eps = add(var, eps_ad);
-    auto std = sqrt_ad(var_eps);
-    auto inv_std = reciprocal(std);
-    auto inv_std_b = matmul(ones2, inv_std);
-    auto normed = mul(x_cent, inv_std_b);
-    // scale and shift
-    auto ones3 = make_ad(cached_ones_cols);
-    auto gamma_b = matmul(gamma, ones3);
-    auto beta_b  = matmul(beta,  ones3);
-    return add(mul(normed, gamma_b), beta_b);
-}
\ No newline at end of file
+    if (x->val.rows != dim) throw std::runtime_error("ADLayerNorm: input rows != dim");
+    return layer_norm_ad(x, gamma, beta, eps);
+}
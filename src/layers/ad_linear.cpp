@@ -1,6 +1,7 @@
 #include "layers/ad_linear.hpp"
 #include <random>
 #include <cmath>
+#include <stdexcept>
 
 ADLinear::ADLinear(int input_dim, int output_dim) {
     Tensor tW(output_dim, input_dim);
@@ -11,21 +12,20 @@ ADLinear::ADLinear(int input_dim, int output_dim) {
     for (auto &v : tW.data) v = dist(gen);
     tb.fill(0.0f);
     W = make_ad(tW);
-    register_parameter(W);
+    register_parameter(W, "W");
     b = make_ad(tb);
-    register_parameter(b);
+    register_parameter(b, "b");
 }
 
 std::shared_ptr<ADTensor> ADLinear::forward(
     const std::shared_ptr<ADTensor>& x) const {
-    auto y = matmul(W, x);
-    int seq_len = x->val.cols;
-    if (seq_len != cached_seq_len) {
-        cached_ones_row = Tensor(1, seq_len);
-        cached_ones_row.data.assign(seq_len, 1.0f);
-        cached_seq_len = seq_len;
-    }
-    auto ones_row = make_ad(cached_ones_row);
-    auto b_mat = matmul(b, ones_row);
-    return add(y, b_mat);
+    if (x->val.rows != W->val.cols) throw std::runtime_error("ADLinear: input rows != input_dim");
+    return add_bias_broadcast(matmul(W, x), b);
+}
+
+std::shared_ptr<ADTensor> ADLinear::forward_rows(
+    const std::shared_ptr<ADTensor>& x) const {
+    if (x->val.cols != W->val.cols) throw std::runtime_error("ADLinear: input cols != input_dim");
+    // y = x W^T + b^T
+    return add(matmul(x, W, false, true), broadcast_row(b, x->val.rows));
 }
\ No newline at end of file
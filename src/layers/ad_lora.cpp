@@ -20,19 +20,19 @@ ADLoRA::ADLoRA(int input_dim_, int output_dim_, int rank_, float alpha_)
     std::uniform_real_distribution<float> dist_a(-r_a, r_a);
     for (auto& v : tA.data) v = dist_a(gen);
     A = make_ad(tA);
-    register_parameter(A);
+    register_parameter(A, "A");
 
     // LoRA B: up-projection, initialized to zero (so initial output = W*x)
     Tensor tB(output_dim, rank);
     tB.fill(0.0f);
     B = make_ad(tB);
-    register_parameter(B);
+    register_parameter(B, "B");
 
     // Bias
     Tensor tb(output_dim, 1);
     tb.fill(0.0f);
     bias = make_ad(tb);
-    register_parameter(bias);
+    register_parameter(bias, "bias");
 }
 
 std::shared_ptr<ADTensor> ADLoRA::forward(const std::shared_ptr<ADTensor>& x) {
@@ -49,10 +49,5 @@ std::shared_ptr<ADTensor> ADLoRA::forward(const std::shared_ptr<ADTensor>& x) {
     auto combined = add(base, lora_out);
 
     // Add bias
-    int seq_len = x->val.cols;
-    Tensor ones_row(1, seq_len);
-    ones_row.data.assign(seq_len, 1.0f);
-    auto ones = make_ad(ones_row);
-    auto bias_broadcast = matmul(bias, ones);
-    return add(combined, bias_broadcast);
+    return add_bias_broadcast(combined, bias);
 }
@@ -1,8 +1,10 @@
 #include "layers/ad_moe.hpp"
+#include "thread_pool.hpp"
 #include <random>
 #include <cmath>
 #include <algorithm>
 #include <numeric>
+#include <string>
 
 ADMoE::ADMoE(int embed_dim_, int hidden_dim, int num_experts_, int top_k_)
     : embed_dim(embed_dim_), num_experts(num_experts_), top_k(top_k_) {
@@ -13,11 +15,12 @@ ADMoE::ADMoE(int embed_dim_, int hidden_dim, int num_experts_, int top_k_)
     std::uniform_real_distribution<float> dist(-r, r);
     for (auto &v : tW.data) v = dist(gen);
     tb.fill(0.0f);
-    gate_W = make_ad(tW); register_parameter(gate_W);
-    gate_b = make_ad(tb); register_parameter(gate_b);
+    gate_W = make_ad(tW); register_parameter(gate_W, "gate_W");
+    gate_b = make_ad(tb); register_parameter(gate_b, "gate_b");
 
     experts.reserve(num_experts);
     for (int i = 0; i < num_experts; ++i) {
+        ParameterScope scope("expert" + std::to_string(i));
         experts.emplace_back(embed_dim, hidden_dim);
     }
 }
@@ -25,36 +28,10 @@ ADMoE::ADMoE(int embed_dim_, int hidden_dim, int num_experts_, int top_k_)
 ADMoE::MoEOutput ADMoE::forward(const std::shared_ptr<ADTensor>& x) {
     int seq_len = x->val.cols;
 
-    auto gate_logits = matmul(gate_W, x);
-    Tensor ones_t(1, seq_len);
-    ones_t.data.assign(seq_len, 1.0f);
-    auto ones = make_ad(ones_t);
-    auto b_broad = matmul(gate_b, ones);
-    gate_logits = add(gate_logits, b_broad);
+    auto gate_logits = add_bias_broadcast(matmul(gate_W, x), gate_b);
 
     // softmax over experts per position
-    Tensor row_max_t(1, seq_len);
-    for (int j = 0; j < seq_len; ++j) {
-        float mx = gate_logits->val(0, j);
-        for (int e = 1; e < num_experts; ++e)
-            mx = std::max(mx, gate_logits->val(e, j));
-        row_max_t.data[j] = mx;
-    }
-    Tensor ones_e(num_experts, 1);
-    ones_e.data.assign(num_experts, 1.0f);
-    auto ones_e_ad = make_ad(ones_e);
-    auto max_ad = make_ad(row_max_t);
-    auto max_broad = matmul(ones_e_ad, max_ad);
-    auto shifted = sub(gate_logits, max_broad);
-    auto exp_vals = exp_ad(shifted);
-
-    Tensor ones_sum_t(1, num_experts);
-    ones_sum_t.data.assign(num_experts, 1.0f);
-    auto ones_sum = make_ad(ones_sum_t);
-    auto denom = matmul(ones_sum, exp_vals);  // [1 x seq_len]
-    auto denom_broad = matmul(ones_e_ad, denom);  // [num_experts x seq_len]
-    auto denom_inv = reciprocal(denom_broad);
-    auto gate_probs = mul(exp_vals, denom_inv);  // [num_experts x seq_len]
+    auto gate_probs = softmax_cols_ad(gate_logits);  // [num_experts x seq_len]
 
     // top-k mask: zero out non-selected experts
     Tensor mask_t(num_experts, seq_len);
@@ -70,23 +47,24 @@ ADMoE::MoEOutput ADMoE::forward(const std::shared_ptr<ADTensor>& x) {
             mask_t(eidxs[k], j) = 1.0f;
         }
     }
-    auto mask_ad = make_ad(mask_t);
+    auto mask_ad = make_const(mask_t);
     auto masked_probs = mul(gate_probs, mask_ad);  // zero out non-top-k
 
-    auto masked_sum = matmul(ones_sum, masked_probs);
-    auto masked_sum_broad = matmul(ones_e_ad, masked_sum);
+    auto masked_sum_broad = broadcast_row(sum_cols(masked_probs), num_experts);
     auto masked_sum_inv = reciprocal(masked_sum_broad);
     auto routing_weights = mul(masked_probs, masked_sum_inv);
 
     // weighted combination of expert outputs
+    // Experts run concurrently on the shared pool, then combine in order
+    std::vector<std::shared_ptr<ADTensor>> expert_outs(num_experts);
+    parallel::parallel_for(0, num_experts, 1, [&](int lo, int hi) {
+        for (int e = lo; e < hi; ++e) expert_outs[e] = experts[e].forward(x);
+    });
     std::shared_ptr<ADTensor> output = nullptr;
     for (int e = 0; e < num_experts; ++e) {
-        auto expert_out = experts[e].forward(x);
+        auto& expert_out = expert_outs[e];
         auto w_e = slice(routing_weights, e, 1);
-        Tensor ones_dim_t(embed_dim, 1);
-        ones_dim_t.data.assign(embed_dim, 1.0f);
-        auto ones_dim = make_ad(ones_dim_t);
-        auto w_broad = matmul(ones_dim, w_e);
+        auto w_broad = broadcast_row(w_e, embed_dim);
         auto weighted = mul(expert_out, w_broad);
         if (output == nullptr) {
             output = weighted;
@@ -96,10 +74,7 @@ ADMoE::MoEOutput ADMoE::forward(const std::shared_ptr<ADTensor>& x) {
     }
 
     // load-balancing aux loss: num_experts * sum(f_e^2)
-    Tensor ones_seq_t(seq_len, 1);
-    ones_seq_t.data.assign(seq_len, 1.0f);
-    auto ones_seq = make_ad(ones_seq_t);
-    auto load_per_expert = matmul(routing_weights, ones_seq);  // [num_experts x 1]
+    auto load_per_expert = sum_rows(routing_weights);  // [num_experts x 1]
     auto load_scaled = scalar_mul(load_per_expert, 1.0f / seq_len);
     auto load_sq = mul(load_scaled, load_scaled);
     auto aux = sum(load_sq);
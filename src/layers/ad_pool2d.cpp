@@ -46,14 +46,15 @@ std::shared_ptr<ADTensor> ADMaxPool2D::forward(const std::shared_ptr<ADTensor>&
         }
     }
 
-    auto out = std::make_shared<ADTensor>(out_val);
-    out->deps.emplace_back(input, [input, out, max_indices]() {
+    auto out = make_op_result(std::move(out_val));
+    record_backward(out, [in = input.get(), out = out.get(), max_indices = std::move(max_indices)]() {
+        Tensor* gin = grad_of(in);
         for (size_t i = 0; i < max_indices.size(); ++i) {
             if (max_indices[i] >= 0) {
-                input->grad.data[max_indices[i]] += out->grad.data[i];
+                gin->data[max_indices[i]] += out->grad.data[i];
             }
         }
-    });
+    }, input);
 
     return out;
 }
@@ -96,9 +97,10 @@ std::shared_ptr<ADTensor> ADAvgPool2D::forward(const std::shared_ptr<ADTensor>&
         }
     }
 
-    auto out = std::make_shared<ADTensor>(out_val);
+    auto out = make_op_result(std::move(out_val));
     int ks = kernel_size, str = this->stride, pad = padding;
-    out->deps.emplace_back(input, [input, out, B, C, H, W, Hout, Wout, ks, str, pad]() {
+    record_backward(out, [in = input.get(), out = out.get(), B, C, H, W, Hout, Wout, ks, str, pad]() {
+        Tensor* gin = grad_of(in);
         for (int b = 0; b < B; ++b) {
             for (int c = 0; c < C; ++c) {
                 for (int oh = 0; oh < Hout; ++oh) {
@@ -118,7 +120,7 @@ std::shared_ptr<ADTensor> ADAvgPool2D::forward(const std::shared_ptr<ADTensor>&
                                 int ih = oh * str - pad + kh;
                                 int iw = ow * str - pad + kw;
                                 if (ih >= 0 && ih < H && iw >= 0 && iw < W) {
-                                    input->grad.data[((b * C + c) * H + ih) * W + iw] += grad;
+                                    gin->data[((b * C + c) * H + ih) * W + iw] += grad;
                                 }
                             }
                         }
@@ -126,7 +128,7 @@ std::shared_ptr<ADTensor> ADAvgPool2D::forward(const std::shared_ptr<ADTensor>&
                 }
             }
         }
-    });
+    }, input);
 
     return out;
 }
@@ -1,6 +1,7 @@
 #include "layers/ad_positional_encoding.hpp"
 #include <random>
 #include <cmath>
+#include <numeric>
 #include <stdexcept>
 
 ADPositionalEncoding::ADPositionalEncoding(int embed_dim_, int max_len_)
@@ -12,18 +13,15 @@ ADPositionalEncoding::ADPositionalEncoding(int embed_dim_, int max_len_)
     std::uniform_real_distribution<float> dist(-r, r);
     for (auto &v : pw.data) v = dist(gen);
     pweights = make_ad(pw);
-    register_parameter(pweights);
+    register_parameter(pweights, "positions");
 }
 
-std::shared_ptr<ADTensor> ADPositionalEncoding::forward(int seq_len) const {
+std::shared_ptr<ADTensor> ADPositionalEncoding::forward(int seq_len, int batch) const {
     if (seq_len > max_len) throw std::out_of_range("Sequence length exceeds max_len");
-    // Build one-hot selector of shape [max_len x seq_len]
-    Tensor sel(max_len, seq_len);
-    sel.data.assign(max_len * seq_len, 0.0f);
-    for (int pos = 0; pos < seq_len; ++pos) {
-        sel.data[pos * seq_len + pos] = 1.0f;
-    }
-    auto sel_ad = make_ad(sel);
-    // Select positional embeddings: [embed_dim x max_len] * [max_len x seq_len] -> [embed_dim x seq_len]
-    return matmul(pweights, sel_ad);
+    // Select positional embeddings: [embed_dim x max_len] -> [embed_dim x seq_len]
+    std::vector<int> positions(static_cast<size_t>(seq_len) * batch);
+    for (int b = 0; b < batch; ++b)
+        std::iota(positions.begin() + static_cast<size_t>(b) * seq_len,
+                  positions.begin() + static_cast<size_t>(b + 1) * seq_len, 0);
+    return gather_cols(pweights, positions);
 }
\ No newline at end of file
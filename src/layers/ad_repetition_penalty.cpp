@@ -32,6 +32,6 @@ std::shared_ptr<ADTensor> ADRepetitionPenalty::apply(
 
     // Element-wise multiply: logits * penalty_mask
     // This is a non-AD constant mask applied to AD logits
-    auto penalty_ad = make_ad(penalty_t);
+    auto penalty_ad = make_const(penalty_t);
     return mul(logits, penalty_ad);
 }
@@ -1,55 +1,66 @@
 #include "layers/ad_rmsnorm.hpp"
 #include <cmath>
+#include <stdexcept>
+#include <vector>
+
+// Fused RMS norm over the rows of each column; backward keeps only 1/rms
+static std::shared_ptr<ADTensor> rms_norm_ad(const std::shared_ptr<ADTensor>& x,
+                                             const std::shared_ptr<ADTensor>& gamma,
+                                             float eps) {
+    int rows = x->val.rows, cols = x->val.cols;
+    const float* xd = x->val.data.data();
+    std::vector<float> inv_rms(cols, 0.0f);
+    for (int i = 0; i < rows; ++i)
+        for (int j = 0; j < cols; ++j) inv_rms[j] += xd[i * cols + j] * xd[i * cols + j];
+    for (int j = 0; j < cols; ++j) inv_rms[j] = 1.0f / std::sqrt(inv_rms[j] / rows + eps);
+
+    Tensor y(rows, cols);
+    for (int i = 0; i < rows; ++i) {
+        float g = gamma->val.data[i];
+        for (int j = 0; j < cols; ++j)
+            y.data[i * cols + j] = g * xd[i * cols + j] * inv_rms[j];
+    }
+    auto out = make_op_result(std::move(y));
+    record_backward(out, [x = x.get(), gamma = gamma.get(), out = out.get(),
+                          inv_rms = std::move(inv_rms), rows, cols]() {
+        const float* xd = x->val.data.data();
+        const float* go = out->grad.data.data();
+        if (Tensor* gg = grad_of(gamma)) {
+            for (int i = 0; i < rows; ++i) {
+                float s = 0.0f;
+                for (int j = 0; j < cols; ++j) s += go[i * cols + j] * xd[i * cols + j] * inv_rms[j];
+                gg->data[i] += s;
+            }
+        }
+        Tensor* gx = grad_of(x);
+        if (!gx) return;
+        // dx = inv_rms * (dxn - x * inv_rms^2 * mean(dxn * x)), dxn = dy * gamma
+        std::vector<float> s(cols, 0.0f);
+        for (int i = 0; i < rows; ++i) {
+            float g = gamma->val.data[i];
+            for (int j = 0; j < cols; ++j) s[j] += go[i * cols + j] * g * xd[i * cols + j];
+        }
+        for (int j = 0; j < cols; ++j) s[j] *= inv_rms[j] * inv_rms[j] / rows;
+        for (int i = 0; i < rows; ++i) {
+            float g = gamma->val.data[i];
+            for (int j = 0; j < cols; ++j) {
+                float xv = xd[i * cols + j];
+                gx->data[i * cols + j] += inv_rms[j] * (go[i * cols + j] * g - xv * s[j]);
+            }
+        }
+    }, x, gamma);
+    return out;
+}
 
 ADRMSNorm::ADRMSNorm(int dim, float eps)
     : dim_(dim), eps_(eps) {
     Tensor tg(dim, 1);
     tg.fill(1.0f);
     gamma = make_ad(tg);
-    register_parameter(gamma);
+    register_parameter(gamma, "gamma");
 }
 
 std::shared_ptr<ADTensor> ADRMSNorm::forward(const std::shared_ptr<ADTensor>& x) {
-    int rows = dim_;
-    int cols = x->val.cols;
-
-    if (cols != cached_cols) {
-        cached_ones_row = Tensor(1, rows);
-        cached_ones_row.data.assign(rows, 1.0f);
-        cached_ones_col = Tensor(rows, 1);
-        cached_ones_col.data.assign(rows, 1.0f);
-        cached_ones_cols = Tensor(1, cols);
-        cached_ones_cols.data.assign(cols, 1.0f);
-        cached_cols = cols;
-    }
-
-    // x^2
-    auto x2 = mul(x, x);
-
-    // mean(x^2) per column: [1 x cols]
-    auto ones1 = make_ad(cached_ones_row);
-    auto sum_x2 = matmul(ones1, x2);
-    auto mean_x2 = scalar_mul(sum_x2, 1.0f / rows);
-
-    // add eps
-    Tensor eps_t(1, cols);
-    eps_t.data.assign(cols, eps_);
-    auto eps_ad = make_ad(eps_t);
-    auto mean_x2_eps = add(mean_x2, eps_ad);
-
-    // rsqrt = 1 / sqrt(mean(x^2) + eps)
-    auto rms = sqrt_ad(mean_x2_eps);
-    auto inv_rms = reciprocal(rms);
-
-    // broadcast inv_rms to [rows x cols]
-    auto ones2 = make_ad(cached_ones_col);
-    auto inv_rms_b = matmul(ones2, inv_rms);
-
-    // normalize: x * inv_rms
-    auto normed = mul(x, inv_rms_b);
-
-    // scale by gamma
-    auto ones3 = make_ad(cached_ones_cols);
-    auto gamma_b = matmul(gamma, ones3);
-    return mul(normed, gamma_b);
+    if (x->val.rows != dim_) throw std::runtime_error("ADRMSNorm: input rows != dim");
+    return rms_norm_ad(x, gamma, eps_);
 }
@@ -10,17 +10,18 @@ static std::shared_ptr<ADTensor> swish_ad(const std::shared_ptr<ADTensor>& a) {
         float sig = 1.0f / (1.0f + std::exp(-x));
         v.data[i] = x * sig;
     }
-    auto out = std::make_shared<ADTensor>(v);
-    out->deps.emplace_back(a, [a, out]() {
-        for (size_t i = 0; i < a->grad.data.size(); ++i) {
+    auto out = make_op_result(std::move(v));
+    record_backward(out, [a = a.get(), out = out.get()]() {
+        Tensor* ga = grad_of(a);
+        for (size_t i = 0; i < ga->data.size(); ++i) {
             float x = a->val.data[i];
             float sig = 1.0f / (1.0f + std::exp(-x));
             // d/dx [x * sig(x)] = sig(x) + x * sig(x) * (1 - sig(x))
             //                    = sig(x) * (1 + x * (1 - sig(x)))
             float grad = sig * (1.0f + x * (1.0f - sig));
-            a->grad.data[i] += grad * out->grad.data[i];
+            ga->data[i] += grad * out->grad.data[i];
         }
-    });
+    }, a);
     return out;
 }
 
@@ -39,9 +40,9 @@ ADSwiGLU::ADSwiGLU(int embed_dim, int hidden_dim) {
     std::uniform_real_distribution<float> dist2(-r2, r2);
     for (auto& v : tWd.data) v = dist2(gen);
 
-    W_gate = make_ad(tWg); register_parameter(W_gate);
-    W_up   = make_ad(tWu); register_parameter(W_up);
-    W_down = make_ad(tWd); register_parameter(W_down);
+    W_gate = make_ad(tWg); register_parameter(W_gate, "W_gate");
+    W_up   = make_ad(tWu); register_parameter(W_up, "W_up");
+    W_down = make_ad(tWd); register_parameter(W_down, "W_down");
 }
 
 std::shared_ptr<ADTensor> ADSwiGLU::forward(const std::shared_ptr<ADTensor>& x) {
@@ -1,17 +1,22 @@
 #include "layers/ad_transformer.hpp"
+#include <string>
 
 // AD Transformer Block
 ADTransformerBlock::ADTransformerBlock(const TransformerConfig& cfg)
     : use_rmsnorm(cfg.use_rmsnorm),
-      mha(cfg.embed_dim, cfg.n_heads),
+      mha(cfg.embed_dim, cfg.n_heads, true, cfg.n_kv_heads,
+          cfg.use_rope ? cfg.max_len : 0),
       use_moe(cfg.use_moe) {
     // Normalization layers
-    if (cfg.use_rmsnorm) {
-        rn1 = std::make_unique<ADRMSNorm>(cfg.embed_dim);
-        rn2 = std::make_unique<ADRMSNorm>(cfg.embed_dim);
-    } else {
-        ln1 = std::make_unique<ADLayerNorm>(cfg.embed_dim);
-        ln2 = std::make_unique<ADLayerNorm>(cfg.embed_dim);
+    {
+        ParameterScope scope("norm1");
+        if (cfg.use_rmsnorm) rn1 = std::make_unique<ADRMSNorm>(cfg.embed_dim);
+        else ln1 = std::make_unique<ADLayerNorm>(cfg.embed_dim);
+    }
+    {
+        ParameterScope scope("norm2");
+        if (cfg.use_rmsnorm) rn2 = std::make_unique<ADRMSNorm>(cfg.embed_dim);
+        else ln2 = std::make_unique<ADLayerNorm>(cfg.embed_dim);
     }
 
     // Feed-forward variant
@@ -37,10 +42,11 @@ std::shared_ptr<ADTensor> ADTransformerBlock::norm2(const std::shared_ptr<ADTens
 
 std::shared_ptr<ADTensor> ADTransformerBlock::forward(
     const std::shared_ptr<ADTensor>& x,
-    std::shared_ptr<ADTensor>* aux_loss) {
+    std::shared_ptr<ADTensor>* aux_loss,
+    int seq_len) {
     // Pre-norm & Attention
     auto x1 = norm1(x);
-    auto a = mha.forward(x1);
+    auto a = mha.forward(x1, seq_len);
     auto x2 = add(a, x);
     // Pre-norm & FeedForward (or MoE or SwiGLU)
     auto x3 = norm2(x2);
@@ -76,6 +82,7 @@ ADTransformer::ADTransformer(int num_layers, int embed_dim, int hidden_dim, int
     cfg.num_experts = num_experts;
     cfg.moe_top_k = moe_top_k;
     for (int i = 0; i < num_layers; ++i) {
+        ParameterScope scope("block" + std::to_string(i));
         blocks.emplace_back(cfg);
     }
 }
@@ -83,16 +90,18 @@ ADTransformer::ADTransformer(int num_layers, int embed_dim, int hidden_dim, int
 // Config-based constructor
 ADTransformer::ADTransformer(const TransformerConfig& cfg) {
     for (int i = 0; i < cfg.num_layers; ++i) {
+        ParameterScope scope("block" + std::to_string(i));
         blocks.emplace_back(cfg);
     }
 }
 
 std::shared_ptr<ADTensor> ADTransformer::forward(
     const std::shared_ptr<ADTensor>& x,
-    std::shared_ptr<ADTensor>* aux_loss) {
+    std::shared_ptr<ADTensor>* aux_loss,
+    int seq_len) {
     auto out = x;
     for (auto& block : blocks) {
-        out = block.forward(out, aux_loss);
+        out = block.forward(out, aux_loss, seq_len);
     }
     return out;
 }
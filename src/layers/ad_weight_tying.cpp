@@ -1,11 +1,16 @@
 #include "layers/ad_weight_tying.hpp"
+#include <stdexcept>
 
-ADWeightTying::ADWeightTying(const std::shared_ptr<ADTensor>& embedding_weights)
-    : shared_weights(embedding_weights) {}
+ADWeightTying::ADWeightTying(const std::shared_ptr<ADTensor>& embedding_weights,
+                             bool embedding_layout_)
+    : shared_weights(embedding_weights), embedding_layout(embedding_layout_) {}
 
 std::shared_ptr<ADTensor> ADWeightTying::forward(const std::shared_ptr<ADTensor>& input) {
     // Embedding weights shape: [vocab_size x embed_dim]
     // We need: [vocab_size x embed_dim] @ [embed_dim x seq_len] = [vocab_size x seq_len]
     // The embedding weights are stored as an AD tensor, so matmul handles gradients
-    return matmul(shared_weights, input);
+    int embed_dim = embedding_layout ? shared_weights->val.rows : shared_weights->val.cols;
+    if (input->val.rows != embed_dim)
+        throw std::runtime_error("ADWeightTying: input rows != embed_dim");
+    return matmul(shared_weights, input, embedding_layout, false);
 }
@@ -1,4 +1,6 @@
 #include "layers/attention.hpp"
+#include "gemm.hpp"
+#include "thread_pool.hpp"
 #include <cmath>
 #include <vector>
 #include <algorithm>
@@ -14,8 +16,7 @@ MultiHeadAttention::MultiHeadAttention(int embed_dim_, int num_heads_, bool caus
       W_k(embed_dim_, embed_dim_),
       W_v(embed_dim_, embed_dim_),
       W_o(embed_dim_, embed_dim_),
-      k_cache(embed_dim_, 0),
-      v_cache(embed_dim_, 0)
+      cache(embed_dim_, 0)
 {
     if (embed_dim % num_heads != 0) {
         throw std::invalid_argument("embed_dim must be divisible by num_heads");
@@ -30,100 +31,157 @@ MultiHeadAttention::MultiHeadAttention(int embed_dim_, int num_heads_, bool caus
     for (auto &w : W_o.data) w = dist(gen);
 }
 
+void MultiHeadAttention::reserve_cache(int capacity, bool sliding) {
+    cache.reserve(embed_dim, capacity, sliding);
+}
+
 void MultiHeadAttention::clear_cache() {
-    k_cache = Tensor(embed_dim, 0);
-    v_cache = Tensor(embed_dim, 0);
+    cache.clear();
 }
 
-static Tensor hcat(const Tensor& a, const Tensor& b) {
-    int rows = a.rows;
-    int new_cols = a.cols + b.cols;
-    Tensor out(rows, new_cols);
-    for (int r = 0; r < rows; ++r) {
-        for (int c = 0; c < a.cols; ++c)
-            out.data[r * new_cols + c] = a.data[r * a.cols + c];
-        for (int c = 0; c < b.cols; ++c)
-            out.data[r * new_cols + a.cols + c] = b.data[r * b.cols + c];
-    }
+// Columns [c0, c0 + n) of t
+static Tensor col_range(const Tensor& t, int c0, int n) {
+    Tensor out(t.rows, n);
+    for (int r = 0; r < t.rows; ++r)
+        for (int c = 0; c < n; ++c)
+            out.data[r * n + c] = t.data[r * t.cols + c0 + c];
     return out;
 }
 
-Tensor MultiHeadAttention::forward(const Tensor& input, bool training, bool use_cache) {
-    int q_len = input.cols;
+void attend_segments(const float* Q, int ldq, int q_len,
+                     const std::vector<KVSegment>& segs,
+                     int num_heads, int num_kv_heads, int head_dim, int q_pos,
+                     bool mask, int window, const float* alibi,
+                     float dropout_prob, float* out, int ldo) {
     static thread_local std::mt19937 _rng(std::random_device{}());
     float _keep_prob = 1.0f - dropout_prob;
     std::bernoulli_distribution _dist(_keep_prob);
-    Tensor Q = W_q.matmul(input); // [embed_dim x q_len]
-    Tensor K_new = W_k.matmul(input);
-    Tensor V_new = W_v.matmul(input);
-
-    Tensor K_full = [&]() -> Tensor {
-        if (use_cache && k_cache.cols > 0) return hcat(k_cache, K_new);
-        return K_new;
-    }();
-    Tensor V_full = [&]() -> Tensor {
-        if (use_cache && v_cache.cols > 0) return hcat(v_cache, V_new);
-        return V_new;
-    }();
-    if (use_cache) {
-        k_cache = K_full;
-        v_cache = V_full;
-    }
+    int kv_len = 0;
+    for (const auto& seg : segs) kv_len += seg.len;
+    float scale = 1.0f / std::sqrt((float)head_dim);
+    int group = num_heads / num_kv_heads;
 
-    int kv_len = K_full.cols;
-    int pos_offset = kv_len - q_len;
-    Tensor concat_out(embed_dim, q_len);
-    std::vector<float> score_mat(q_len * kv_len);
-    std::vector<float> attn_weights(q_len * kv_len);
+    std::vector<float> attn_weights(static_cast<size_t>(q_len) * kv_len);
     for (int h = 0; h < num_heads; ++h) {
-        int offset = h * head_dim;
+        size_t offset = static_cast<size_t>(h) * head_dim;
+        size_t kv_offset = static_cast<size_t>(h / group) * head_dim;
+        // scores[i][j] = scale * q_i . k_j
+        int col = 0;
+        for (const auto& seg : segs) {
+            gemm::sgemm(true, false, q_len, seg.len, head_dim, scale,
+                        Q + offset * ldq, ldq,
+                        seg.k + kv_offset * seg.ld, seg.ld,
+                        0.0f, attn_weights.data() + col, kv_len);
+            col += seg.len;
+        }
         for (int i = 0; i < q_len; ++i) {
-            int abs_i = pos_offset + i;
-            for (int j = 0; j < kv_len; ++j) {
-                float sum = 0.0f;
-                for (int d = 0; d < head_dim; ++d) {
-                    float q = Q.data[(offset + d) * q_len + i];
-                    float k = K_full.data[(offset + d) * kv_len + j];
-                    sum += q * k;
-                }
-                float scaled = sum / std::sqrt((float)head_dim);
-                if (causal && j > abs_i) {
-                    scaled = -std::numeric_limits<float>::infinity();
-                }
-                score_mat[i * kv_len + j] = scaled;
-            }
-            float max_score = score_mat[i * kv_len + 0];
-            for (int j = 1; j < kv_len; ++j) {
-                max_score = std::max(max_score, score_mat[i * kv_len + j]);
+            float* w = attn_weights.data() + static_cast<size_t>(i) * kv_len;
+            int limit = mask ? std::min(kv_len, q_pos + i + 1) : kv_len;
+            int first = (mask && window > 0) ? std::max(0, q_pos + i + 1 - window) : 0;
+            if (alibi) {
+                for (int j = first; j < limit; ++j)
+                    w[j] -= alibi[h] * std::abs(q_pos + i - j);
             }
+            float max_score = -std::numeric_limits<float>::infinity();
+            for (int j = first; j < limit; ++j) max_score = std::max(max_score, w[j]);
             float sum_exp = 0.0f;
-            for (int j = 0; j < kv_len; ++j) {
-                float e = std::exp(score_mat[i * kv_len + j] - max_score);
-                attn_weights[i * kv_len + j] = e;
-                sum_exp += e;
-            }
-            for (int j = 0; j < kv_len; ++j) {
-                attn_weights[i * kv_len + j] /= sum_exp;
+            for (int j = first; j < limit; ++j) {
+                w[j] = std::exp(w[j] - max_score);
+                sum_exp += w[j];
             }
-            if (training && dropout_prob > 0.0f) {
-                for (int j = 0; j < kv_len; ++j) {
+            for (int j = first; j < limit; ++j) w[j] /= sum_exp;
+            std::fill(w, w + first, 0.0f);
+            std::fill(w + limit, w + kv_len, 0.0f);
+            if (dropout_prob > 0.0f) {
+                for (int j = first; j < limit; ++j) {
                     bool keep = _dist(_rng);
-                    float& w = attn_weights[i * kv_len + j];
-                    w = keep ? (w / _keep_prob) : 0.0f;
+                    w[j] = keep ? (w[j] / _keep_prob) : 0.0f;
                 }
             }
         }
-        for (int d = 0; d < head_dim; ++d) {
-            for (int i = 0; i < q_len; ++i) {
-                float val = 0.0f;
-                for (int j = 0; j < kv_len; ++j) {
-                    val += attn_weights[i * kv_len + j] *
-                           V_full.data[(offset + d) * kv_len + j];
-                }
-                concat_out.data[(offset + d) * q_len + i] = val;
-            }
+        // out_h = sum over segments of V_seg * P_seg^T
+        col = 0;
+        for (const auto& seg : segs) {
+            gemm::sgemm(false, true, head_dim, q_len, seg.len, 1.0f,
+                        seg.v + kv_offset * seg.ld, seg.ld,
+                        attn_weights.data() + col, kv_len,
+                        col == 0 ? 0.0f : 1.0f,
+                        out + offset * ldo, ldo);
+            col += seg.len;
+        }
+    }
+}
+
+Tensor MultiHeadAttention::forward(const Tensor& input, bool training, bool use_cache) {
+    int q_len = input.cols;
+    if (use_cache && cache.sliding() && q_len > 1 &&
+        cache.length() + q_len > cache.capacity()) {
+        // Once the ring wraps, each query may only see the window current at
+        // its own position: fill the free slots in one pass, then feed the
+        // remaining columns one at a time
+        int head = std::max(0, cache.capacity() - cache.length());
+        Tensor out(embed_dim, q_len);
+        for (int c0 = 0; c0 < q_len;) {
+            int n = c0 < head ? head : 1;
+            Tensor part = forward(col_range(input, c0, n), training, true);
+            for (int r = 0; r < embed_dim; ++r)
+                for (int c = 0; c < n; ++c)
+                    out.data[r * q_len + c0 + c] = part.data[r * n + c];
+            c0 += n;
         }
+        return out;
+    }
+
+    Tensor Q = W_q.matmul(input); // [embed_dim x q_len]
+    Tensor K_new = W_k.matmul(input);
+    Tensor V_new = W_v.matmul(input);
+
+    KVSegment seg{K_new.data.data(), V_new.data.data(), q_len, q_len};
+    int pos_offset = 0;
+    if (use_cache) {
+        pos_offset = cache.length();
+        cache.append(K_new, V_new);
+        seg = KVSegment{cache.keys(), cache.values(), cache.capacity(), cache.size()};
     }
+    // Until the ring wraps column j holds position j. After that this is a
+    // single query that follows every cached position, so nothing is masked.
+    bool mask = causal && !(use_cache && cache.wrapped());
+    Tensor concat_out(embed_dim, q_len);
+    attend_segments(Q.data.data(), q_len, q_len, {seg}, num_heads, num_heads, head_dim,
+                    pos_offset, mask, 0, nullptr, training ? dropout_prob : 0.0f,
+                    concat_out.data.data(), q_len);
     Tensor output = W_o.matmul(concat_out);
     return output;
-}
\ No newline at end of file
+}
+
+Tensor MultiHeadAttention::forward(const Tensor& input,
+                                   const std::vector<PagedSpan>& spans, int layer) {
+    int n_cols = input.cols;
+    // Projections for every sequence in the batch at once
+    Tensor Q = W_q.matmul(input);
+    Tensor K_new = W_k.matmul(input);
+    Tensor V_new = W_v.matmul(input);
+    Tensor concat_out(embed_dim, n_cols);
+    parallel::parallel_for(0, static_cast<int>(spans.size()), 1, [&](int lo, int hi) {
+        for (int s = lo; s < hi; ++s) {
+            const PagedSpan& span = spans[s];
+            PagedKVCache& paged = *span.cache;
+            paged.write(layer, span.pos, K_new, V_new, span.col, span.len);
+            // One segment per live block, read where it lives in the pool
+            KVBlockPool& pool = paged.pool();
+            int bs = pool.block_size();
+            int base = paged.first_block() * bs;
+            int kv_len = span.pos + span.len;
+            std::vector<KVSegment> segs;
+            for (int p = base; p < kv_len; p += bs) {
+                int b = paged.blocks()[p / bs];
+                segs.push_back({pool.keys(layer, b), pool.values(layer, b), bs,
+                                std::min(bs, kv_len - p)});
+            }
+            attend_segments(Q.data.data() + span.col, n_cols, span.len, segs, num_heads,
+                            num_heads, head_dim, span.pos - base, causal, paged.window(),
+                            nullptr, 0.0f, concat_out.data.data() + span.col, n_cols);
+        }
+    });
+    return W_o.matmul(concat_out);
+}
@@ -0,0 +1,70 @@
+#include "layers/kv_cache.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+KVCache::KVCache(int dim, int capacity, bool sliding) {
+    reserve(dim, capacity, sliding);
+}
+
+void KVCache::reserve(int dim, int capacity, bool sliding) {
+    if (dim < 0 || capacity < 0) {
+        throw std::invalid_argument("KVCache: negative dimension");
+    }
+    if (sliding && capacity == 0) {
+        throw std::invalid_argument("KVCache: sliding window needs a capacity");
+    }
+    dim_ = dim;
+    capacity_ = capacity;
+    sliding_ = sliding;
+    length_ = 0;
+    k_.assign(static_cast<size_t>(dim) * capacity, 0.0f);
+    v_.assign(static_cast<size_t>(dim) * capacity, 0.0f);
+}
+
+void KVCache::clear() {
+    length_ = 0;
+}
+
+void KVCache::grow(int capacity) {
+    std::vector<float> k(static_cast<size_t>(dim_) * capacity);
+    std::vector<float> v(static_cast<size_t>(dim_) * capacity);
+    for (int r = 0; r < dim_; ++r) {
+        std::copy_n(k_.begin() + static_cast<size_t>(r) * capacity_, length_,
+                    k.begin() + static_cast<size_t>(r) * capacity);
+        std::copy_n(v_.begin() + static_cast<size_t>(r) * capacity_, length_,
+                    v.begin() + static_cast<size_t>(r) * capacity);
+    }
+    k_ = std::move(k);
+    v_ = std::move(v);
+    capacity_ = capacity;
+}
+
+void KVCache::append(const Tensor& k, const Tensor& v, int c0, int n) {
+    if (k.rows != dim_ || v.rows != dim_ || k.cols != v.cols) {
+        throw std::invalid_argument("KVCache::append: shape mismatch");
+    }
+    if (c0 < 0 || n < 0 || c0 + n > k.cols) {
+        throw std::out_of_range("KVCache::append: column range out of bounds");
+    }
+    if (sliding_) {
+        // Only the last capacity_ of the new columns survive
+        int skip = std::max(0, n - capacity_);
+        length_ += skip;
+        c0 += skip;
+        n -= skip;
+    } else if (length_ + n > capacity_) {
+        grow(std::max(2 * capacity_, length_ + n));
+    }
+    for (int r = 0; r < dim_; ++r) {
+        const float* ks = k.data.data() + static_cast<size_t>(r) * k.cols + c0;
+        const float* vs = v.data.data() + static_cast<size_t>(r) * v.cols + c0;
+        float* kd = k_.data() + static_cast<size_t>(r) * capacity_;
+        float* vd = v_.data() + static_cast<size_t>(r) * capacity_;
+        for (int t = 0; t < n; ++t) {
+            int s = slot(length_ + t);
+            kd[s] = ks[t];
+            vd[s] = vs[t];
+        }
+    }
+    length_ += n;
+}
@@ -0,0 +1,179 @@
+#include "layers/paged_kv_cache.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+KVBlockPool::KVBlockPool(int num_layers, int dim, int block_size, int num_blocks)
+    : num_layers_(num_layers), dim_(dim), block_size_(block_size),
+      num_blocks_(num_blocks),
+      block_elems_(static_cast<size_t>(dim) * block_size) {
+    if (num_layers <= 0 || dim <= 0 || block_size <= 0 || num_blocks <= 0) {
+        throw std::invalid_argument("KVBlockPool: all sizes must be positive");
+    }
+    data_.assign(block_elems_ * 2 * num_layers * num_blocks, 0.0f);
+    refs_.assign(num_blocks, 0);
+    // Hand out low block ids first
+    for (int b = num_blocks - 1; b >= 0; --b) free_.push_back(b);
+}
+
+int KVBlockPool::allocate() {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (free_.empty()) {
+        throw std::runtime_error("KVBlockPool: out of blocks");
+    }
+    int b = free_.back();
+    free_.pop_back();
+    refs_[b] = 1;
+    return b;
+}
+
+void KVBlockPool::retain(int block) {
+    std::lock_guard<std::mutex> lock(mu_);
+    ++refs_.at(block);
+}
+
+void KVBlockPool::release(int block) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (refs_.at(block) <= 0) {
+        throw std::logic_error("KVBlockPool: release of a free block");
+    }
+    if (--refs_[block] == 0) free_.push_back(block);
+}
+
+int KVBlockPool::ref_count(int block) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return refs_.at(block);
+}
+
+int KVBlockPool::free_blocks() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return static_cast<int>(free_.size());
+}
+
+void KVBlockPool::copy_block(int src, int dst) {
+    size_t span = block_elems_ * 2 * num_layers_;
+    std::copy_n(data_.begin() + offset(0, src, 0), span,
+                data_.begin() + offset(0, dst, 0));
+}
+
+PagedKVCache::PagedKVCache(KVBlockPool& pool, int window)
+    : pool_(&pool), window_(window) {
+    if (window < 0) {
+        throw std::invalid_argument("PagedKVCache: negative window");
+    }
+}
+
+PagedKVCache::~PagedKVCache() {
+    clear();
+}
+
+PagedKVCache::PagedKVCache(PagedKVCache&& other) noexcept
+    : pool_(other.pool_), blocks_(std::move(other.blocks_)),
+      length_(other.length_), window_(other.window_),
+      first_block_(other.first_block_) {
+    other.blocks_.clear();
+    other.length_ = 0;
+    other.first_block_ = 0;
+}
+
+PagedKVCache& PagedKVCache::operator=(PagedKVCache&& other) noexcept {
+    if (this != &other) {
+        clear();
+        pool_ = other.pool_;
+        blocks_ = std::move(other.blocks_);
+        length_ = other.length_;
+        window_ = other.window_;
+        first_block_ = other.first_block_;
+        other.blocks_.clear();
+        other.length_ = 0;
+        other.first_block_ = 0;
+    }
+    return *this;
+}
+
+PagedKVCache PagedKVCache::fork() const {
+    PagedKVCache copy(*pool_, window_);
+    for (int b : blocks_) {
+        if (b >= 0) pool_->retain(b);
+    }
+    copy.blocks_ = blocks_;
+    copy.length_ = length_;
+    copy.first_block_ = first_block_;
+    return copy;
+}
+
+int PagedKVCache::extend(int n) {
+    int bs = pool_->block_size();
+    int pos = length_;
+    if (n <= 0) return pos;
+    if (window_ > 0) {
+        // The first new query sees positions from pos - window + 1 on
+        int keep_from = std::max(0, pos - window_ + 1);
+        for (; first_block_ < keep_from / bs; ++first_block_) {
+            pool_->release(blocks_[first_block_]);
+            blocks_[first_block_] = -1;
+        }
+    }
+    // Copy-on-write: the tail block is about to receive new columns
+    if (length_ % bs != 0 && pool_->ref_count(blocks_.back()) > 1) {
+        int fresh = pool_->allocate();
+        pool_->copy_block(blocks_.back(), fresh);
+        pool_->release(blocks_.back());
+        blocks_.back() = fresh;
+    }
+    int needed = (length_ + n + bs - 1) / bs;
+    while (static_cast<int>(blocks_.size()) < needed) {
+        blocks_.push_back(pool_->allocate());
+    }
+    length_ += n;
+    return pos;
+}
+
+void PagedKVCache::write(int layer, int pos, const Tensor& k, const Tensor& v,
+                         int c0, int n) {
+    int dim = pool_->dim();
+    int bs = pool_->block_size();
+    if (k.rows != dim || v.rows != dim || k.cols != v.cols) {
+        throw std::invalid_argument("PagedKVCache::write: shape mismatch");
+    }
+    if (layer < 0 || layer >= pool_->num_layers() ||
+        pos < first_block_ * bs || pos + n > length_ || c0 < 0 || c0 + n > k.cols) {
+        throw std::out_of_range("PagedKVCache::write: position out of range");
+    }
+    for (int t = 0; t < n;) {
+        int p = pos + t;
+        int b = blocks_[p / bs];
+        int col = p % bs;
+        int run = std::min(n - t, bs - col);
+        float* kd = pool_->keys(layer, b);
+        float* vd = pool_->values(layer, b);
+        for (int r = 0; r < dim; ++r) {
+            std::copy_n(k.data.data() + static_cast<size_t>(r) * k.cols + c0 + t, run,
+                        kd + static_cast<size_t>(r) * bs + col);
+            std::copy_n(v.data.data() + static_cast<size_t>(r) * v.cols + c0 + t, run,
+                        vd + static_cast<size_t>(r) * bs + col);
+        }
+        t += run;
+    }
+}
+
+void PagedKVCache::truncate(int len) {
+    int bs = pool_->block_size();
+    if (len < first_block_ * bs || len > length_) {
+        throw std::out_of_range("PagedKVCache::truncate: length out of range");
+    }
+    int keep = (len + bs - 1) / bs;
+    while (static_cast<int>(blocks_.size()) > keep) {
+        pool_->release(blocks_.back());
+        blocks_.pop_back();
+    }
+    length_ = len;
+}
+
+void PagedKVCache::clear() {
+    for (int b : blocks_) {
+        if (b >= 0) pool_->release(b);
+    }
+    blocks_.clear();
+    length_ = 0;
+    first_block_ = 0;
+}
@@ -29,4 +29,20 @@ Tensor PositionalEncoding::forward(int seq_len) const {
         }
     }
     return out;
-}
\ No newline at end of file
+}
+
+Tensor PositionalEncoding::forward(const std::vector<int>& positions) const {
+    int n = static_cast<int>(positions.size());
+    Tensor out(embed_dim, n);
+    for (int c = 0; c < n; ++c) {
+        if (positions[c] < 0 || positions[c] >= max_len) {
+            throw std::out_of_range("Position exceeds maximum positional encoding length");
+        }
+    }
+    for (int d = 0; d < embed_dim; ++d) {
+        for (int c = 0; c < n; ++c) {
+            out.data[d * n + c] = pe.data[d * max_len + positions[c]];
+        }
+    }
+    return out;
+}
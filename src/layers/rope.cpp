@@ -54,13 +54,14 @@ Tensor RoPE::apply(const Tensor& x, int pos_offset) const {
 std::shared_ptr<ADTensor> RoPE::apply_ad(const std::shared_ptr<ADTensor>& x,
                                            int pos_offset) const {
     Tensor out_val = apply(x->val, pos_offset);
-    auto out = std::make_shared<ADTensor>(out_val);
+    auto out = make_op_result(std::move(out_val));
 
     int half = head_dim_ / 2;
     int seq_len = x->val.cols;
 
     // Backward: inverse rotation (transpose of rotation matrix = negate sin)
-    out->deps.emplace_back(x, [this, x, out, half, seq_len, pos_offset]() {
+    record_backward(out, [this, x = x.get(), out = out.get(), half, seq_len, pos_offset]() {
+        Tensor* gx = grad_of(x);
         for (int pos = 0; pos < seq_len; ++pos) {
             int abs_pos = pos_offset + pos;
             for (int d = 0; d < half; ++d) {
@@ -71,10 +72,63 @@ std::shared_ptr<ADTensor> RoPE::apply_ad(const std::shared_ptr<ADTensor>& x,
                 float g_odd  = out->grad.data[(d + half) * seq_len + pos];
 
                 // Inverse rotation for gradient
-                x->grad.data[d * seq_len + pos]          += g_even * cos_val + g_odd * sin_val;
-                x->grad.data[(d + half) * seq_len + pos] += -g_even * sin_val + g_odd * cos_val;
+                gx->data[d * seq_len + pos]          += g_even * cos_val + g_odd * sin_val;
+                gx->data[(d + half) * seq_len + pos] += -g_even * sin_val + g_odd * cos_val;
             }
         }
-    });
+    }, x);
+    return out;
+}
+
+void RoPE::rotate(float* x, int rows, int cols, const int* positions,
+                  bool inverse) const {
+    if (rows % head_dim_ != 0) {
+        throw std::invalid_argument("RoPE: rows must be a multiple of head_dim");
+    }
+    int half = head_dim_ / 2;
+    float sign = inverse ? -1.0f : 1.0f;
+    for (int c = 0; c < cols; ++c) {
+        if (positions[c] < 0 || positions[c] >= max_len_) {
+            throw std::out_of_range("RoPE: position exceeds max_len");
+        }
+    }
+    for (int h = 0; h < rows / head_dim_; ++h) {
+        for (int d = 0; d < half; ++d) {
+            float* xe = x + static_cast<size_t>(h * head_dim_ + d) * cols;
+            float* xo = xe + static_cast<size_t>(half) * cols;
+            const float* cos_row = cos_table_.data() + static_cast<size_t>(d) * max_len_;
+            const float* sin_row = sin_table_.data() + static_cast<size_t>(d) * max_len_;
+            for (int c = 0; c < cols; ++c) {
+                float cos_val = cos_row[positions[c]];
+                float sin_val = sign * sin_row[positions[c]];
+                float e = xe[c], o = xo[c];
+                xe[c] = e * cos_val - o * sin_val;
+                xo[c] = e * sin_val + o * cos_val;
+            }
+        }
+    }
+}
+
+std::shared_ptr<ADTensor> RoPE::apply_heads_ad(const std::shared_ptr<ADTensor>& x,
+                                               int seq_len) const {
+    int rows = x->val.rows, cols = x->val.cols;
+    if (seq_len <= 0) seq_len = cols;
+    if (cols % seq_len != 0) {
+        throw std::invalid_argument("RoPE: columns must be a multiple of seq_len");
+    }
+    std::vector<int> positions(cols);
+    for (int c = 0; c < cols; ++c) positions[c] = c % seq_len;
+    Tensor out_val = x->val;
+    rotate(out_val.data.data(), rows, cols, positions.data());
+    auto out = make_op_result(std::move(out_val));
+    // Backward: rotate the gradient back
+    record_backward(out, [this, x = x.get(), out = out.get(), rows, cols,
+                          positions = std::move(positions)]() {
+        Tensor* gx = grad_of(x);
+        if (!gx) return;
+        Tensor g = out->grad;
+        rotate(g.data.data(), rows, cols, positions.data(), true);
+        for (size_t i = 0; i < g.data.size(); ++i) gx->data[i] += g.data[i];
+    }, x);
     return out;
 }
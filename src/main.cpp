@@ -5,6 +5,7 @@
 #include "layers/ad_linear.hpp"
 #include "optimizer.hpp"
 #include "autodiff.hpp"
+#include "thread_pool.hpp"
 #include "lr_scheduler.hpp"
 #include <iostream>
 #include <fstream>
@@ -17,191 +18,36 @@
 #include <string>
 #include <limits>
 #include <cstdint>
+#include <memory>
 #include "timer.hpp"
 #include "memory_pool.hpp"
 #include "quantization.hpp"
-#include "loss.hpp"
-#include "layers/embedding.hpp"
-#include "layers/positional_encoding.hpp"
-#include "transformer.hpp"
-#include "layers/linear.hpp"
+#include "inference_model.hpp"
+#include "generation.hpp"
+#include "checkpoint.hpp"
 
-static bool save_checkpoint(const std::string& path) {
-    auto& params = get_parameters();
-    std::ofstream out(path, std::ios::binary);
-    if (!out) { std::cerr << "Error: cannot open checkpoint file for writing: " << path << "\n"; return false; }
-    uint32_t num = params.size();
-    out.write(reinterpret_cast<const char*>(&num), sizeof(num));
-    for (auto& p : params) {
-        uint32_t r = (uint32_t)p->val.rows;
-        uint32_t c = (uint32_t)p->val.cols;
-        out.write(reinterpret_cast<const char*>(&r), sizeof(r));
-        out.write(reinterpret_cast<const char*>(&c), sizeof(c));
-        out.write(reinterpret_cast<const char*>(p->val.data.data()), r * c * sizeof(float));
+// Wait until queued checkpoints are on disk; false if one failed
+static bool finish_checkpoints(ckpt::AsyncWriter& writer) {
+    try {
+        writer.wait();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return false;
     }
     return true;
 }
-static bool load_checkpoint(const std::string& path) {
-    auto& params = get_parameters();
-    std::ifstream in(path, std::ios::binary);
-    if (!in) { std::cerr << "Error: cannot open checkpoint file for reading: " << path << "\n"; return false; }
-    uint32_t num = 0;
-    in.read(reinterpret_cast<char*>(&num), sizeof(num));
-    if (num != params.size()) {
-        std::cerr << "Warning: checkpoint parameter count mismatch (" << num << " vs " << params.size() << "), attempting partial load\n";
-    }
-    uint32_t to_load = std::min<uint32_t>(num, (uint32_t)params.size());
-    int shape_mismatches = 0;
-    for (uint32_t i = 0; i < to_load; ++i) {
-        auto& p = params[i];
-        uint32_t r = 0, c = 0;
-        in.read(reinterpret_cast<char*>(&r), sizeof(r));
-        in.read(reinterpret_cast<char*>(&c), sizeof(c));
-        if (r != (uint32_t)p->val.rows || c != (uint32_t)p->val.cols) {
-            std::cerr << "Warning: checkpoint param shape mismatch (" << r << "x" << c
-                      << " vs " << p->val.rows << "x" << p->val.cols << "), skipping\n";
-            in.seekg((std::streamoff)r * c * sizeof(float), std::ios::cur);
-            ++shape_mismatches;
-            if (shape_mismatches > 3) {
-                std::cerr << "Error: too many shape mismatches (>3), aborting checkpoint load\n";
-                return false;
-            }
-        } else {
-            in.read(reinterpret_cast<char*>(p->val.data.data()), r * c * sizeof(float));
-        }
+// map: adopt the file's pages instead of copying, for modes that only read
+// the weights
+static bool load_checkpoint(const std::string& path, bool map = false) {
+    try {
+        ckpt::load_parameters(path, map);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return false;
     }
     return true;
 }
 
-static int sample_next_token(const std::vector<float>& logits_in,
-                             int top_k, float top_p, float temperature,
-                             std::mt19937& rng) {
-    int V = (int)logits_in.size();
-    std::vector<float> logit_v(V);
-    for (int i = 0; i < V; ++i) logit_v[i] = logits_in[i] / temperature;
-
-    float max_logit = *std::max_element(logit_v.begin(), logit_v.end());
-
-    if (top_k > 0) {
-        int k = std::min(top_k, V);
-        std::vector<int> idxs(V);
-        std::iota(idxs.begin(), idxs.end(), 0);
-        std::partial_sort(idxs.begin(), idxs.begin() + k, idxs.end(),
-                          [&](int a, int b) { return logit_v[a] > logit_v[b]; });
-        std::vector<float> weights(V, 0.0f);
-        for (int j = 0; j < k; ++j)
-            weights[idxs[j]] = std::exp(logit_v[idxs[j]] - max_logit);
-        std::discrete_distribution<int> dist(weights.begin(), weights.end());
-        return dist(rng);
-    } else if (top_p > 0.0f) {
-        std::vector<float> probs(V);
-        for (int i = 0; i < V; ++i) probs[i] = std::exp(logit_v[i] - max_logit);
-        float sum_probs = std::accumulate(probs.begin(), probs.end(), 0.0f);
-        std::vector<int> idxs(V);
-        std::iota(idxs.begin(), idxs.end(), 0);
-        std::sort(idxs.begin(), idxs.end(), [&](int a, int b) { return probs[a] > probs[b]; });
-        std::vector<float> weights(V, 0.0f);
-        float cum = 0.0f;
-        for (int j = 0; j < V; ++j) {
-            int i = idxs[j]; cum += probs[i]; weights[i] = probs[i];
-            if (cum / sum_probs >= top_p) break;
-        }
-        std::discrete_distribution<int> dist(weights.begin(), weights.end());
-        return dist(rng);
-    } else {
-        // Greedy
-        return std::max_element(logit_v.begin(), logit_v.end()) - logit_v.begin();
-    }
-}
-
-struct GenerateConfig {
-    int max_new_tokens;
-    int seq_len;
-    int top_k;
-    float top_p;
-    float temperature;
-    int eos_id;
-    int beam_width;
-};
-
-// Beam search: explore multiple hypotheses in parallel
-static std::vector<int> beam_search_cached(
-    const std::vector<int>& prompt_tokens,
-    Embedding& embed_layer,
-    PositionalEncoding& posenc,
-    Transformer& transformer,
-    const Tensor& out_W,
-    const Tensor& out_b,
-    int vocab_size,
-    const GenerateConfig& cfg) {
-
-    struct Beam {
-        std::vector<int> tokens;
-        float score;
-    };
-
-    int beam_width = cfg.beam_width;
-    std::vector<Beam> beams = {{prompt_tokens, 0.0f}};
-
-    for (int step = 0; step < cfg.max_new_tokens; ++step) {
-        std::vector<Beam> candidates;
-        for (auto& beam : beams) {
-            if (cfg.eos_id >= 0 && !beam.tokens.empty() && beam.tokens.back() == cfg.eos_id) {
-                candidates.push_back(beam);
-                continue;
-            }
-            // Run inference for this beam's full sequence (non-cached for simplicity)
-            int context_len = std::min((int)beam.tokens.size(), cfg.seq_len);
-            std::vector<int> input_ids(beam.tokens.end() - context_len, beam.tokens.end());
-            Tensor x = embed_layer.forward(input_ids);
-            Tensor pos = posenc.forward(context_len);
-            for (size_t i = 0; i < x.data.size(); ++i) x.data[i] += pos.data[i];
-            Tensor h = transformer.forward(x, false, false);
-            int last_idx = context_len - 1;
-            Tensor h_last(h.rows, 1);
-            for (int r = 0; r < h.rows; ++r) h_last.data[r] = h(r, last_idx);
-            Tensor logits = out_W.matmul(h_last);
-            for (int i = 0; i < vocab_size; ++i) logits.data[i] += out_b.data[i];
-
-            // Log-softmax
-            float max_l = *std::max_element(logits.data.begin(), logits.data.begin() + vocab_size);
-            float sum_exp = 0.0f;
-            for (int i = 0; i < vocab_size; ++i) sum_exp += std::exp(logits.data[i] - max_l);
-            float log_sum = max_l + std::log(sum_exp);
-
-            // Expand top beam_width tokens
-            std::vector<int> idxs(vocab_size);
-            std::iota(idxs.begin(), idxs.end(), 0);
-            std::partial_sort(idxs.begin(), idxs.begin() + beam_width, idxs.end(),
-                              [&](int a, int b) { return logits.data[a] > logits.data[b]; });
-            for (int k = 0; k < beam_width; ++k) {
-                int tok = idxs[k];
-                float log_prob = logits.data[tok] - log_sum;
-                Beam new_beam;
-                new_beam.tokens = beam.tokens;
-                new_beam.tokens.push_back(tok);
-                new_beam.score = beam.score + log_prob;
-                candidates.push_back(std::move(new_beam));
-            }
-        }
-        // Keep top beam_width candidates
-        std::partial_sort(candidates.begin(),
-                          candidates.begin() + std::min(beam_width, (int)candidates.size()),
-                          candidates.end(),
-                          [](const Beam& a, const Beam& b) { return a.score > b.score; });
-        if ((int)candidates.size() > beam_width) candidates.resize(beam_width);
-        beams = std::move(candidates);
-
-        // Check if all beams ended
-        bool all_done = true;
-        for (auto& b : beams) {
-            if (cfg.eos_id < 0 || b.tokens.back() != cfg.eos_id) { all_done = false; break; }
-        }
-        if (all_done) break;
-    }
-    return beams[0].tokens;
-}
-
 static std::vector<int> generate_tokens(
     const std::vector<int>& prompt_tokens,
     ADEmbedding& ad_embed,
@@ -212,6 +58,7 @@ static std::vector<int> generate_tokens(
     int vocab_size,
     const GenerateConfig& cfg,
     std::mt19937& rng) {
+    NoGradGuard no_grad;
     std::vector<int> output_tokens = prompt_tokens;
     for (int step = 0; step < cfg.max_new_tokens; ++step) {
         int context_len = std::min((int)output_tokens.size(), cfg.seq_len);
@@ -220,13 +67,7 @@ static std::vector<int> generate_tokens(
         auto pos_ad = ad_posenc.forward(context_len);
         auto x_ad = add(embed_ad, pos_ad);
         auto h_ad = ad_transformer.forward(x_ad);
-        auto Wt = transpose(W_embed);
-        auto logits_ad = matmul(Wt, h_ad);
-        Tensor ones_bias_t(1, context_len);
-        ones_bias_t.data.assign(context_len, 1.0f);
-        auto ones_bias = make_ad(ones_bias_t);
-        auto b_mat = matmul(b_lm, ones_bias);
-        logits_ad = add(logits_ad, b_mat);
+        auto logits_ad = add_bias_broadcast(matmul(W_embed, h_ad, true, false), b_lm);
         Tensor logits = logits_ad->val;
         int last_idx = context_len - 1;
         std::vector<float> logit_v(vocab_size);
@@ -238,89 +79,28 @@ static std::vector<int> generate_tokens(
     return output_tokens;
 }
 
-// 12 params per block: ln1(gamma,beta), mha(Wq,Wk,Wv,Wo), ln2(gamma,beta), ff(W1,b1,W2,b2)
-static void sync_ad_to_inference(
-    const std::vector<std::shared_ptr<ADTensor>>& params,
-    int embed_param_idx,       // index of embedding weight param
-    int block_start_idx,       // index where first block's params start
-    int lm_bias_idx,           // index of b_lm param
-    int num_layers,
-    Embedding& embed,
-    Transformer& transformer,
-    Tensor& out_W,
-    Tensor& out_b) {
-    embed.weights = params[embed_param_idx]->val;
-    int params_per_block = 12;
-    for (int layer = 0; layer < num_layers; ++layer) {
-        int base = block_start_idx + layer * params_per_block;
-        auto& block = transformer.blocks[layer];
-        block.ln1.gamma = params[base+0]->val;
-        block.ln1.beta  = params[base+1]->val;
-        block.mha.W_q = params[base+2]->val;
-        block.mha.W_k = params[base+3]->val;
-        block.mha.W_v = params[base+4]->val;
-        block.mha.W_o = params[base+5]->val;
-        block.ln2.gamma = params[base+6]->val;
-        block.ln2.beta  = params[base+7]->val;
-        block.ff.fc1.weights = params[base+8]->val;
-        block.ff.fc1.bias    = params[base+9]->val;
-        block.ff.fc2.weights = params[base+10]->val;
-        block.ff.fc2.bias    = params[base+11]->val;
-    }
-    out_W = params[embed_param_idx]->val.transpose();
-    out_b = params[lm_bias_idx]->val;
+// Load the speculative draft model: its training graph exists only while
+// the checkpoint is read, and the returned model keeps the tensors alive
+static std::unique_ptr<InferenceModel> load_draft(const std::string& path, int V,
+                                                  const TransformerConfig& dcfg) {
+    clear_parameters();
+    ADEmbedding ad_embed(V, dcfg.embed_dim);
+    ADPositionalEncoding ad_posenc(dcfg.embed_dim, dcfg.max_len);
+    ADTransformer ad_transformer(dcfg);
+    Tensor tb_lm(V, 1); tb_lm.data.assign(V, 0.0f);
+    register_parameter(make_ad(tb_lm), "lm_bias");
+    std::unique_ptr<InferenceModel> draft;
+    if (load_checkpoint(path, true)) draft.reset(new InferenceModel(dcfg, get_parameters()));
+    clear_parameters();
+    return draft;
 }
 
-static std::vector<int> generate_tokens_cached(
-    const std::vector<int>& prompt_tokens,
-    Embedding& embed_layer,
-    PositionalEncoding& posenc,
-    Transformer& transformer,
-    const Tensor& out_W,
-    const Tensor& out_b,
-    int vocab_size,
-    const GenerateConfig& cfg,
-    std::mt19937& rng) {
-    transformer.clear_cache();
-    std::vector<int> output_tokens = prompt_tokens;
-
-    // prefill
-    {
-        Tensor x = embed_layer.forward(prompt_tokens);
-        Tensor pos = posenc.forward((int)prompt_tokens.size());
-        for (size_t i = 0; i < x.data.size(); ++i) x.data[i] += pos.data[i];
-        Tensor h = transformer.forward(x, false, true);
-        int last_idx = (int)prompt_tokens.size() - 1;
-        Tensor h_last(h.rows, 1);
-        for (int r = 0; r < h.rows; ++r) h_last.data[r] = h(r, last_idx);
-        Tensor logits = out_W.matmul(h_last);
-        for (int i = 0; i < vocab_size; ++i) logits.data[i] += out_b.data[i];
-        std::vector<float> logit_v(vocab_size);
-        for (int i = 0; i < vocab_size; ++i) logit_v[i] = logits.data[i];
-        int next_id = sample_next_token(logit_v, cfg.top_k, cfg.top_p, cfg.temperature, rng);
-        output_tokens.push_back(next_id);
-        if (cfg.eos_id >= 0 && next_id == cfg.eos_id)
-            return output_tokens;
-    }
-
-    // decode one token at a time
-    for (int step = 1; step < cfg.max_new_tokens; ++step) {
-        int token = output_tokens.back();
-        Tensor x = embed_layer.forward({token});
-        int pos_idx = (int)output_tokens.size() - 1;
-        Tensor pos = posenc.forward(pos_idx + 1);
-        for (int r = 0; r < x.rows; ++r)
-            x.data[r] += pos(r, pos_idx);
-        Tensor h = transformer.forward(x, false, true);
-        Tensor logits = out_W.matmul(h);
-        for (int i = 0; i < vocab_size; ++i) logits.data[i] += out_b.data[i];
-        std::vector<float> logit_v(vocab_size);
-        for (int i = 0; i < vocab_size; ++i) logit_v[i] = logits.data[i];
-        int next_id = sample_next_token(logit_v, cfg.top_k, cfg.top_p, cfg.temperature, rng);
-        output_tokens.push_back(next_id);
-        if (cfg.eos_id >= 0 && next_id == cfg.eos_id) break;
-    }
-    return output_tokens;
+static void print_acceptance(const SpeculativeStats& stats) {
+    if (stats.proposed == 0) return;
+    std::cout << "[speculative] accepted " << stats.accepted << "/" << stats.proposed
+              << " draft tokens ("
+              << 100.0f * stats.accepted / stats.proposed << "%) over "
+              << stats.rounds << " target passes\n";
 }
 
 static std::string sparkline(const std::vector<float>& data) {
@@ -354,12 +134,16 @@ int main(int argc, char** argv) {
     int seq_len = 32;
     int epochs = 5;
     int batch_size = 16;
+    int num_threads = 1;
     float lr = 1e-3f;
     std::string resume_file;
     std::string save_file = "checkpoint.bin";
+    int save_every = 0;
     std::string valid_file;
     int patience = 2;
     long pool_size_mb = 0;
+    int pool_threads = 0;
+    bool pin_threads = false;
     bool qat_enabled = false;
     int qat_bits = 8;
     std::string ptq_out;
@@ -379,7 +163,17 @@ int main(int argc, char** argv) {
     int warmup_steps = 0;
     std::string lr_schedule = "constant";
     int grad_accum_steps = 1;
+    int kv_heads = 0;
     int beam_width = 0;
+    int kv_window = 0;
+    int max_batch = 8;
+    bool prompts_per_line = false;
+    std::string draft_file;
+    int draft_embed_dim = 0;
+    int draft_hidden_dim = 0;
+    int draft_heads = 0;
+    int draft_layers = 0;
+    int spec_k = 4;
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -402,6 +196,8 @@ int main(int argc, char** argv) {
             seq_len = std::stoi(argv[++i]);
         } else if (arg == "--batch_size" && i + 1 < argc) {
             batch_size = std::stoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            num_threads = std::max(1, std::stoi(argv[++i]));
         } else if (arg == "--epochs" && i + 1 < argc) {
             epochs = std::stoi(argv[++i]);
         } else if (arg == "--lr" && i + 1 < argc) {
@@ -410,6 +206,8 @@ int main(int argc, char** argv) {
             resume_file = argv[++i];
         } else if (arg == "--save" && i + 1 < argc) {
             save_file = argv[++i];
+        } else if (arg == "--save_every" && i + 1 < argc) {
+            save_every = std::max(0, std::stoi(argv[++i]));
         } else if (arg == "--valid" && i + 1 < argc) {
             valid_file = argv[++i];
         } else if (arg == "--patience" && i + 1 < argc) {
@@ -437,6 +235,10 @@ int main(int argc, char** argv) {
             ptq_out = argv[++i];
         } else if (arg == "--pool_size_mb" && i + 1 < argc) {
             pool_size_mb = std::stol(argv[++i]);
+        } else if (arg == "--pool_threads" && i + 1 < argc) {
+            pool_threads = std::stoi(argv[++i]);
+        } else if (arg == "--pin_threads") {
+            pin_threads = true;
         } else if (arg == "--timer") {
             Timer::enabled = true;
         } else if (arg == "--moe") {
@@ -453,6 +255,8 @@ int main(int argc, char** argv) {
             use_swiglu = true;
         } else if (arg == "--rope") {
             use_rope = true;
+        } else if (arg == "--kv_heads" && i + 1 < argc) {
+            kv_heads = std::stoi(argv[++i]);
         } else if (arg == "--warmup_steps" && i + 1 < argc) {
             warmup_steps = std::stoi(argv[++i]);
         } else if (arg == "--lr_schedule" && i + 1 < argc) {
@@ -461,6 +265,26 @@ int main(int argc, char** argv) {
             grad_accum_steps = std::stoi(argv[++i]);
         } else if (arg == "--beam_width" && i + 1 < argc) {
             beam_width = std::stoi(argv[++i]);
+        } else if (arg == "--kv_window" && i + 1 < argc) {
+            kv_window = std::stoi(argv[++i]);
+        } else if (arg == "--max_batch" && i + 1 < argc) {
+            max_batch = std::stoi(argv[++i]);
+        } else if (arg == "--prompts" && i + 1 < argc) {
+            mode = "generate";
+            generate_file = argv[++i];
+            prompts_per_line = true;
+        } else if (arg == "--draft" && i + 1 < argc) {
+            draft_file = argv[++i];
+        } else if (arg == "--draft_embed_dim" && i + 1 < argc) {
+            draft_embed_dim = std::stoi(argv[++i]);
+        } else if (arg == "--draft_hidden_dim" && i + 1 < argc) {
+            draft_hidden_dim = std::stoi(argv[++i]);
+        } else if (arg == "--draft_heads" && i + 1 < argc) {
+            draft_heads = std::stoi(argv[++i]);
+        } else if (arg == "--draft_layers" && i + 1 < argc) {
+            draft_layers = std::stoi(argv[++i]);
+        } else if (arg == "--spec_k" && i + 1 < argc) {
+            spec_k = std::stoi(argv[++i]);
         } else if (arg == "--help") {
             std::cout << "Usage: deepseek_ai [--train data.txt] [--generate prompt.txt] [options]\n"
                       << "Modes:\n"
@@ -476,11 +300,13 @@ int main(int argc, char** argv) {
                       << "  --rmsnorm            use RMSNorm instead of LayerNorm (LLaMA-style)\n"
                       << "  --swiglu             use SwiGLU activation instead of GELU (LLaMA-style)\n"
                       << "  --rope               use Rotary Position Embeddings (LLaMA-style)\n"
+                      << "  --kv_heads N         key/value heads for grouped-query attention (default: n_heads)\n"
                       << "\nTraining:\n"
                       << "  --vocab PATH         vocabulary file (default: input_files/vocab.txt)\n"
                       << "  --bpe-codes PATH     BPE merges file for true BPE (optional)\n"
                       << "  --seq_len N          training sequence length (default: 32)\n"
                       << "  --batch_size N       mini-batch size (default: 16)\n"
+                      << "  --threads N          data-parallel training threads (default: 1)\n"
                       << "  --epochs N           number of training epochs (default: 5)\n"
                       << "  --lr FLOAT           learning rate (default: 1e-3)\n"
                       << "  --lr_schedule TYPE   LR schedule: constant|cosine (default: constant)\n"
@@ -488,6 +314,7 @@ int main(int argc, char** argv) {
                       << "  --grad_accum N       gradient accumulation steps (default: 1)\n"
                       << "  --resume PATH        checkpoint file to load (default: none)\n"
                       << "  --save PATH          checkpoint file to save (default: checkpoint.bin)\n"
+                      << "  --save_every N       also checkpoint every N optimizer steps (default: 0, epoch ends only)\n"
                       << "  --valid PATH         validation data file (default: none)\n"
                       << "  --patience N         early stopping patience (default: 2 epochs)\n"
                       << "\nGeneration:\n"
@@ -496,6 +323,15 @@ int main(int argc, char** argv) {
                       << "  --top_p FLOAT        top-p (nucleus) sampling (0=greedy)\n"
                       << "  --temperature FLOAT  sampling temperature (default: 1.0)\n"
                       << "  --beam_width N       beam search width (0=disabled, default: 0)\n"
+                      << "  --kv_window N        keep only the last N positions in the KV cache (0=max_len)\n"
+                      << "  --prompts PATH       generate for each line of PATH in one continuous batch\n"
+                      << "  --max_batch N        sequences decoded together (default: 8)\n"
+                      << "  --draft PATH         draft checkpoint for speculative decoding (default: none)\n"
+                      << "  --draft_embed_dim N  draft embedding dimension (default: same as model)\n"
+                      << "  --draft_hidden_dim N draft hidden dimension (default: same as model)\n"
+                      << "  --draft_heads N      draft attention heads (default: same as model)\n"
+                      << "  --draft_layers N     draft transformer layers (default: same as model)\n"
+                      << "  --spec_k N           tokens the draft proposes per target pass (default: 4)\n"
                       << "\nQuantization:\n"
                       << "  --qat                enable quantization-aware training (fake quant)\n"
                       << "  --qat-bits N         bits for quantization (default: 8)\n"
@@ -507,6 +343,8 @@ int main(int argc, char** argv) {
                       << "  --moe_aux_weight F   aux loss weight (default: 0.01)\n"
                       << "\nMisc:\n"
                       << "  --pool_size_mb N     memory pool size in MB (default: 0=disabled)\n"
+                      << "  --pool_threads N     compute thread pool size (default: 0=all cores)\n"
+                      << "  --pin_threads        pin compute pool workers to cores (Linux)\n"
                       << "  --timer              enable performance timers\n";
             return 0;
         } else {
@@ -527,6 +365,15 @@ int main(int argc, char** argv) {
     tcfg.use_rmsnorm = use_rmsnorm;
     tcfg.use_swiglu = use_swiglu;
     tcfg.use_rope = use_rope;
+    tcfg.n_kv_heads = kv_heads;
+    tcfg.max_len = max_len;
+
+    // The draft shares the block variants; only its size may differ
+    TransformerConfig dcfg = tcfg;
+    if (draft_embed_dim > 0) dcfg.embed_dim = draft_embed_dim;
+    if (draft_hidden_dim > 0) dcfg.hidden_dim = draft_hidden_dim;
+    if (draft_heads > 0) dcfg.n_heads = draft_heads;
+    if (draft_layers > 0) dcfg.num_layers = draft_layers;
 
     quant::g_qat_enabled = qat_enabled;
     quant::g_qat_bits = qat_bits;
@@ -541,6 +388,10 @@ int main(int argc, char** argv) {
         UnifiedMemoryManager::instance().init(static_cast<size_t>(pool_size_mb) * 1024 * 1024);
         std::cout << "Initialized on-chip memory pool of size " << pool_size_mb << " MB\n";
     }
+    if (pool_threads > 0 || pin_threads) {
+        parallel::set_num_threads(pool_threads);
+        if (pin_threads) parallel::set_pinning(true);
+    }
     if (mode == "cli") {
         Tokenizer tokenizer(vocab_file, bpe_codes_file);
         int V = (int)tokenizer.vocab_size();
@@ -549,25 +400,26 @@ int main(int argc, char** argv) {
         ADTransformer ad_transformer(tcfg);
         auto W_embed = ad_embed.get_weights();
         Tensor tb_lm(V, 1); tb_lm.data.assign(V, 0.0f);
-        auto b_lm = make_ad(tb_lm); register_parameter(b_lm);
+        auto b_lm = make_ad(tb_lm); register_parameter(b_lm, "lm_bias");
         if (!resume_file.empty()) {
-            if (!load_checkpoint(resume_file)) return 1;
+            if (!load_checkpoint(resume_file, true)) return 1;
             std::cout << "Loaded checkpoint from " << resume_file << "\n";
         } else {
-            if (!load_checkpoint(save_file)) return 1;
+            if (!load_checkpoint(save_file, true)) return 1;
             std::cout << "Loaded checkpoint from " << save_file << "\n";
         }
-        Embedding inf_embed(V, embed_dim);
-        PositionalEncoding inf_posenc(embed_dim, max_len);
-        Transformer inf_transformer(num_layers, embed_dim, hidden_dim, n_heads);
-        Tensor out_W(V, embed_dim), out_b(V, 1);
-        auto& params = get_parameters();
-        // param layout: embed(0), blocks start at 1, b_lm is last
-        sync_ad_to_inference(params, 0, 1, (int)params.size()-1, num_layers,
-                             inf_embed, inf_transformer, out_W, out_b);
+        // Reads the trained tensors in place: embed, posenc, blocks, b_lm
+        InferenceModel model(tcfg, get_parameters());
         std::mt19937 gen(std::random_device{}());
         GenerateConfig cfg{max_new_tokens, seq_len, top_k, top_p, temperature,
                            tokenizer.to_id("</s>"), beam_width};
+        std::unique_ptr<InferenceModel> draft;
+        if (!draft_file.empty()) {
+            draft = load_draft(draft_file, V, dcfg);
+            if (!draft) return 1;
+            std::cout << "Loaded draft model from " << draft_file << "\n";
+        }
+        BatchScheduler scheduler(model, max_batch, 16, 0, kv_window);
         std::string line;
         while (true) {
             std::cout << ">> " << std::flush;
@@ -576,11 +428,16 @@ int main(int argc, char** argv) {
             auto tokens = tokenizer.encode(line);
             std::vector<int> output_tokens;
             if (beam_width > 0) {
-                output_tokens = beam_search_cached(tokens, inf_embed, inf_posenc,
-                    inf_transformer, out_W, out_b, V, cfg);
+                output_tokens = beam_search(model, tokens, cfg);
+            } else if (draft) {
+                SpeculativeStats stats;
+                output_tokens = speculative_generate(model, *draft, tokens, cfg,
+                                                     spec_k, gen, &stats);
+                print_acceptance(stats);
             } else {
-                output_tokens = generate_tokens_cached(tokens, inf_embed, inf_posenc,
-                    inf_transformer, out_W, out_b, V, cfg, gen);
+                int id = scheduler.submit(tokens, cfg, gen());
+                scheduler.run();
+                output_tokens = scheduler.result(id);
             }
             std::cout << tokenizer.decode(output_tokens) << std::endl;
         }
@@ -589,47 +446,69 @@ int main(int argc, char** argv) {
     if (mode == "generate") {
         Tokenizer tokenizer(vocab_file, bpe_codes_file);
         int V = (int)tokenizer.vocab_size();
-        std::string prompt;
+        // One request per prompt: the whole file, or each line with --prompts
+        std::vector<std::string> prompts;
         if (!generate_file.empty()) {
             std::ifstream gin(generate_file);
             if (!gin) { std::cerr << "Cannot open prompt file: " << generate_file << "\n"; return 1; }
-            std::ostringstream gss; gss << gin.rdbuf(); prompt = gss.str();
+            if (prompts_per_line) {
+                std::string pl;
+                while (std::getline(gin, pl)) {
+                    if (!pl.empty()) prompts.push_back(pl);
+                }
+            } else {
+                std::ostringstream gss; gss << gin.rdbuf(); prompts.push_back(gss.str());
+            }
         } else {
             std::cerr << "No prompt file provided for generation\n"; return 1;
         }
-        auto tokens = tokenizer.encode(prompt);
         ADEmbedding ad_embed(V, embed_dim);
         ADPositionalEncoding ad_posenc(embed_dim, max_len);
         ADTransformer ad_transformer(tcfg);
         auto W_embed = ad_embed.get_weights();
         Tensor tb_lm(V, 1); tb_lm.data.assign(V, 0.0f);
-        auto b_lm = make_ad(tb_lm); register_parameter(b_lm);
+        auto b_lm = make_ad(tb_lm); register_parameter(b_lm, "lm_bias");
         if (!resume_file.empty()) {
-            if (!load_checkpoint(resume_file)) return 1;
+            if (!load_checkpoint(resume_file, true)) return 1;
             std::cout << "Loaded checkpoint from " << resume_file << "\n";
         } else {
-            if (!load_checkpoint(save_file)) return 1;
+            if (!load_checkpoint(save_file, true)) return 1;
             std::cout << "Loaded checkpoint from " << save_file << "\n";
         }
-        Embedding inf_embed(V, embed_dim);
-        PositionalEncoding inf_posenc(embed_dim, max_len);
-        Transformer inf_transformer(num_layers, embed_dim, hidden_dim, n_heads);
-        Tensor out_W(V, embed_dim), out_b(V, 1);
-        auto& params = get_parameters();
-        sync_ad_to_inference(params, 0, 1, (int)params.size()-1, num_layers,
-                             inf_embed, inf_transformer, out_W, out_b);
+        // Reads the trained tensors in place: embed, posenc, blocks, b_lm
+        InferenceModel model(tcfg, get_parameters());
         std::mt19937 gen(std::random_device{}());
         GenerateConfig cfg{max_new_tokens, seq_len, top_k, top_p, temperature,
                            tokenizer.to_id("</s>"), beam_width};
-        std::vector<int> output_tokens;
         if (beam_width > 0) {
-            output_tokens = beam_search_cached(tokens, inf_embed, inf_posenc,
-                inf_transformer, out_W, out_b, V, cfg);
-        } else {
-            output_tokens = generate_tokens_cached(tokens, inf_embed, inf_posenc,
-                inf_transformer, out_W, out_b, V, cfg, gen);
+            for (const auto& prompt : prompts) {
+                auto output_tokens = beam_search(model, tokenizer.encode(prompt), cfg);
+                std::cout << tokenizer.decode(output_tokens) << std::endl;
+            }
+            return 0;
+        }
+        if (!draft_file.empty()) {
+            auto draft = load_draft(draft_file, V, dcfg);
+            if (!draft) return 1;
+            std::cout << "Loaded draft model from " << draft_file << "\n";
+            SpeculativeStats stats;
+            for (const auto& prompt : prompts) {
+                auto output_tokens = speculative_generate(model, *draft,
+                                                          tokenizer.encode(prompt), cfg,
+                                                          spec_k, gen, &stats);
+                std::cout << tokenizer.decode(output_tokens) << std::endl;
+            }
+            print_acceptance(stats);
+            return 0;
         }
-        std::cout << tokenizer.decode(output_tokens) << std::endl;
+        // All prompts decode together in one continuous batch
+        BatchScheduler scheduler(model, max_batch, 16, 0, kv_window);
+        std::vector<int> ids;
+        for (const auto& prompt : prompts)
+            ids.push_back(scheduler.submit(tokenizer.encode(prompt), cfg, gen()));
+        scheduler.run();
+        for (int id : ids)
+            std::cout << tokenizer.decode(scheduler.result(id)) << std::endl;
         return 0;
     }
     if (mode != "train" || data_file.empty()) {
@@ -642,7 +521,7 @@ int main(int argc, char** argv) {
               << " n_heads=" << n_heads << " num_layers=" << num_layers << "\n"
               << "max_len=" << max_len << " seq_len=" << seq_len
               << " batch_size=" << batch_size << " epochs=" << epochs
-              << " lr=" << lr << "\n"
+              << " lr=" << lr << " threads=" << num_threads << "\n"
               << "Validation file: " << (valid_file.empty() ? std::string("none") : valid_file) << "\n"
               << "Early stopping patience: " << patience << "\n";
     if (use_moe) {
@@ -715,117 +594,163 @@ int main(int argc, char** argv) {
     Tensor tb_lm(Vocab, 1);
     tb_lm.data.assign(Vocab, 0.0f);
     auto b_lm = make_ad(tb_lm);
-    register_parameter(b_lm);
+    register_parameter(b_lm, "lm_bias");
     AdamW optimizer(lr);
+    // Training progress; a checkpoint written by this loop carries it along
+    // with the AdamW moments, so --resume continues mid-epoch exactly
+    ckpt::TrainingState progress;
+    bool resumed = false;
     if (!resume_file.empty()) {
         if (!load_checkpoint(resume_file)) return 1;
+        try {
+            resumed = ckpt::load_training(resume_file, optimizer, progress);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
         std::cout << "Loaded checkpoint from " << resume_file << "\n";
+        if (resumed && progress.finished(epochs, patience, !valid_file.empty())) {
+            std::cout << "Checkpoint is from a run that already finished after epoch "
+                      << progress.epoch - 1 << "; nothing to train\n";
+        } else if (resumed) {
+            std::cout << "Resuming at epoch " << progress.epoch << ", batch "
+                      << progress.batches_done << " (step " << progress.global_step << ")\n";
+        }
     }
 
-    std::vector<int> starts;
+    // Each epoch visits a fresh shuffle of these, drawn from the RNG state the
+    // epoch starts with
+    std::vector<int> sequence_starts;
     for (int s = 0; s + seq_len < N; s += seq_len) {
-        starts.push_back(s);
+        sequence_starts.push_back(s);
     }
+    std::vector<int> starts;
 
     // Compute total training steps for LR scheduler
-    int batches_per_epoch = ((int)starts.size() + batch_size - 1) / batch_size;
+    int batches_per_epoch = ((int)sequence_starts.size() + batch_size - 1) / batch_size;
     int total_optimizer_steps = batches_per_epoch * epochs;
     if (grad_accum_steps > 1) {
         total_optimizer_steps = (batches_per_epoch / grad_accum_steps) * epochs;
     }
     LRScheduler lr_sched(lr, warmup_steps, total_optimizer_steps, lr * 0.1f);
+    lr_sched.set_step(progress.scheduler_step);
 
     std::vector<float> loss_history;
     std::vector<float> val_history;
-    std::mt19937 rng(1234);
-    int no_improve = 0;
-    float best_val_loss = std::numeric_limits<float>::infinity();
-    int global_step = 0;
+    std::mt19937 rng = progress.rng;
+    int no_improve = progress.no_improve;
+    float best_val_loss = progress.best_val_loss;
+    int global_step = progress.global_step;
+    // Checkpoints are written in the background, atomically
+    ckpt::AsyncWriter checkpoint_writer;
+
+    // Forward + backward over starts[lo, hi) packed as [embed_dim x (B * seq_len)]:
+    // one graph and B-times-wider projection GEMMs per step. Returns the
+    // summed loss. Runs on the calling thread's tape.
+    auto train_slice = [&](size_t lo, size_t hi) -> float {
+        int B = (int)(hi - lo);
+        std::vector<int> input_ids, target_ids;
+        input_ids.reserve((size_t)B * seq_len);
+        target_ids.reserve((size_t)B * seq_len);
+        for (size_t idx = lo; idx < hi; ++idx) {
+            int start = starts[idx];
+            input_ids.insert(input_ids.end(), data_tokens.begin() + start,
+                             data_tokens.begin() + start + seq_len);
+            target_ids.insert(target_ids.end(), data_tokens.begin() + start + 1,
+                              data_tokens.begin() + start + seq_len + 1);
+        }
+        auto embed_ad = ad_embed.forward(input_ids);
+        auto pos_ad   = ad_posenc.forward(seq_len, B);
+        auto x_ad     = add(embed_ad, pos_ad);
+        std::shared_ptr<ADTensor> h_ad;
+        std::shared_ptr<ADTensor> moe_aux_loss;
+        {
+            Timer t("ADTransformer forward");
+            h_ad = ad_transformer.forward(x_ad, use_moe ? &moe_aux_loss : nullptr, seq_len);
+        }
+        auto logits_ad = add_bias_broadcast(matmul(W_embed, h_ad, true, false), b_lm);
+        auto loss_ad = cross_entropy_ad(logits_ad, target_ids);
+        if (use_moe && moe_aux_loss) {
+            // The balance loss is computed once over the slice; weight it
+            // per sequence as the unbatched loop did
+            auto weighted_aux = scalar_mul(moe_aux_loss, moe_aux_weight * B);
+            loss_ad = add(loss_ad, weighted_aux);
+        }
+        loss_ad->backward();
+        clear_tape();
+        return loss_ad->val.data[0];
+    };
+    allocate_grad_shards(num_threads);
 
-    for (int epoch = 1; epoch <= epochs; ++epoch) {
+    bool stop_early = progress.finished(epochs, patience, !valid_file.empty());
+    for (int epoch = progress.epoch; !stop_early && epoch <= epochs; ++epoch) {
+        std::mt19937 epoch_rng = rng;
+        starts = sequence_starts;
         std::shuffle(starts.begin(), starts.end(), rng);
         float total_loss = 0.0f;
         int count = 0;
         int accum_count = 0;
+        size_t first_batch = 0;
+        if (resumed && epoch == progress.epoch) {
+            first_batch = (size_t)progress.batches_done * batch_size;
+            total_loss = progress.loss_sum;
+            count = progress.loss_count;
+        }
+        // Record a resumable point; called only between optimizer steps
+        auto mark_progress = [&](int at_epoch, long long batches_done, const std::mt19937& at_rng) {
+            progress.epoch = at_epoch;
+            progress.batches_done = batches_done;
+            progress.global_step = global_step;
+            progress.scheduler_step = lr_sched.current_step();
+            progress.rng = at_rng;
+            progress.loss_sum = batches_done > 0 ? total_loss : 0.0f;
+            progress.loss_count = batches_done > 0 ? count : 0;
+            progress.best_val_loss = best_val_loss;
+            progress.no_improve = no_improve;
+        };
+        auto save_progress = [&]() {
+            try {
+                ckpt::save_training(checkpoint_writer, save_file, optimizer, progress);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+            }
+        };
+        mark_progress(epoch, (long long)(first_batch / batch_size), epoch_rng);
 
-        for (size_t batch_start = 0; batch_start < starts.size(); batch_start += batch_size) {
+        for (size_t batch_start = first_batch; batch_start < starts.size(); batch_start += batch_size) {
             if (accum_count == 0) {
                 optimizer.zero_grad();
             }
             size_t batch_end = std::min(batch_start + batch_size, starts.size());
-            for (size_t idx = batch_start; idx < batch_end; ++idx) {
-                int start = starts[idx];
-                std::vector<int> input_ids(data_tokens.begin() + start,
-                                           data_tokens.begin() + start + seq_len);
-                std::vector<int> target_ids(data_tokens.begin() + start + 1,
-                                            data_tokens.begin() + start + seq_len + 1);
-                auto embed_ad = ad_embed.forward(input_ids);
-                auto pos_ad   = ad_posenc.forward(seq_len);
-                auto x_ad     = add(embed_ad, pos_ad);
-                std::shared_ptr<ADTensor> h_ad;
-                std::shared_ptr<ADTensor> moe_aux_loss;
-                {
-                    Timer t("ADTransformer forward");
-                    h_ad = ad_transformer.forward(x_ad, use_moe ? &moe_aux_loss : nullptr);
-                }
-                auto Wt = transpose(W_embed);
-                auto logits_ad = matmul(Wt, h_ad);
-                Tensor ones_bias_t(1, seq_len);
-                ones_bias_t.data.assign(seq_len, 1.0f);
-                auto ones_bias = make_ad(ones_bias_t);
-                auto b_mat = matmul(b_lm, ones_bias);
-                logits_ad = add(logits_ad, b_mat);
-                int V = (int)tokenizer.vocab_size();
-                Tensor target_tensor(V, seq_len);
-                target_tensor.data.assign(V * seq_len, 0.0f);
-                for (int t = 0; t < seq_len; ++t) {
-                    int id = target_ids[t];
-                    if (id >= 0 && id < V) {
-                        target_tensor.data[id * seq_len + t] = 1.0f;
-                    }
-                }
-                auto target_ad = make_ad(target_tensor);
-                // cross-entropy via log-sum-exp
-                auto prod_ad = mul(logits_ad, target_ad);
-                auto sum1_ad = sum(prod_ad);
-                Tensor max_per_col(1, seq_len);
-                for (int col = 0; col < seq_len; ++col) {
-                    float mx = logits_ad->val.data[0 * seq_len + col];
-                    for (int row = 1; row < V; ++row) {
-                        mx = std::max(mx, logits_ad->val.data[row * seq_len + col]);
-                    }
-                    max_per_col.data[col] = mx;
-                }
-                Tensor ones_col_v(V, 1);
-                ones_col_v.data.assign(V, 1.0f);
-                auto ones_col_ad = make_ad(ones_col_v);
-                auto max_ad = make_ad(max_per_col);
-                auto max_broadcast = matmul(ones_col_ad, max_ad);
-                auto shifted_logits = sub(logits_ad, max_broadcast);
-                Tensor ones_row_t(1, V);
-                ones_row_t.data.assign(V, 1.0f);
-                auto ones_row = make_ad(ones_row_t);
-                auto exp_shifted = exp_ad(shifted_logits);
-                auto denom_row = matmul(ones_row, exp_shifted);
-                auto log_denoms = log_ad(denom_row);
-                auto log_sum_exp = add(log_denoms, max_ad);
-                auto sum2_ad = sum(log_sum_exp);
-                auto loss_ad = sub(sum2_ad, sum1_ad);
-                if (use_moe && moe_aux_loss) {
-                    auto weighted_aux = scalar_mul(moe_aux_loss, moe_aux_weight);
-                    loss_ad = add(loss_ad, weighted_aux);
+            int B = (int)(batch_end - batch_start);
+            // Data parallel: worker w takes a contiguous slice of the batch as
+            // a pool task with its own tape, writing parameter grads into
+            // shard w (worker 0, this thread, writes grad directly)
+            int workers = std::min(num_threads, B);
+            std::vector<float> losses(workers, 0.0f);
+            auto run_worker = [&](int w) {
+                tape::ContextScope own_tape(tape::Context{nullptr, true, w});
+                losses[w] = train_slice(batch_start + (size_t)B * w / workers,
+                                        batch_start + (size_t)B * (w + 1) / workers);
+            };
+            parallel::TaskGroup group;
+            for (int w = 1; w < workers; ++w) group.run([&run_worker, w] { run_worker(w); });
+            run_worker(0);
+            group.wait();
+            if (workers > 1) reduce_grad_shards();
+            float loss = std::accumulate(losses.begin(), losses.end(), 0.0f);
+            if (std::isnan(loss) || std::isinf(loss)) {
+                std::cerr << "Error: NaN/Inf detected in loss at batch " << batch_start
+                          << ", halting training\n";
+                // The weights and optimizer are still those of the last step
+                if (!save_file.empty()) {
+                    save_progress();
+                    finish_checkpoints(checkpoint_writer);
                 }
-                loss_ad->backward();
-                float loss = loss_ad->val.data[0];
-                if (std::isnan(loss) || std::isinf(loss)) {
-                    std::cerr << "Error: NaN/Inf detected in loss at batch " << batch_start
-                              << ", halting training\n";
-                    if (!save_file.empty()) save_checkpoint(save_file);
-                    return 1;
-                }
-                total_loss += loss;
-                ++count;
+                return 1;
             }
+            total_loss += loss;
+            count += B;
             ++accum_count;
 
             // Step optimizer after accumulating enough gradients
@@ -839,6 +764,9 @@ int main(int argc, char** argv) {
                 optimizer.step();
                 ++global_step;
                 accum_count = 0;
+                mark_progress(epoch, (long long)(batch_start / batch_size) + 1, epoch_rng);
+                if (save_every > 0 && !save_file.empty() && global_step % save_every == 0)
+                    save_progress();
             }
         }
         // Handle leftover accumulated gradients at epoch end
@@ -861,41 +789,28 @@ int main(int argc, char** argv) {
             std::cout << "Epoch " << epoch << ": Avg XEnt loss = " << avg_loss << "\n";
         }
         loss_history.push_back(avg_loss);
-        if (!save_file.empty()) {
-            if (!save_checkpoint(save_file))
-                std::cerr << "Error: failed saving checkpoint to " << save_file << "\n";
-            else
-                std::cout << "Saved checkpoint to " << save_file << "\n";
-        }
         if (!valid_file.empty()) {
+            NoGradGuard no_grad;
             float val_loss = 0.0f;
             int val_count = 0;
-            for (int vs : val_starts) {
-                std::vector<int> inp(val_tokens.begin() + vs,
-                                     val_tokens.begin() + vs + seq_len);
-                std::vector<int> tgt(val_tokens.begin() + vs + 1,
-                                     val_tokens.begin() + vs + seq_len + 1);
+            for (size_t vb = 0; vb < val_starts.size(); vb += batch_size) {
+                size_t ve = std::min(vb + batch_size, val_starts.size());
+                int B = (int)(ve - vb);
+                std::vector<int> inp, tgt;
+                for (size_t idx = vb; idx < ve; ++idx) {
+                    int vs = val_starts[idx];
+                    inp.insert(inp.end(), val_tokens.begin() + vs,
+                               val_tokens.begin() + vs + seq_len);
+                    tgt.insert(tgt.end(), val_tokens.begin() + vs + 1,
+                               val_tokens.begin() + vs + seq_len + 1);
+                }
                 auto embed_v = ad_embed.forward(inp);
-                auto pos_v   = ad_posenc.forward(seq_len);
+                auto pos_v   = ad_posenc.forward(seq_len, B);
                 auto x_v     = add(embed_v, pos_v);
-                auto h_v     = ad_transformer.forward(x_v);
-                auto Wt_v = transpose(W_embed);
-                auto logits_v = matmul(Wt_v, h_v);
-                Tensor ones_row_v_t(1, seq_len);
-                ones_row_v_t.data.assign(seq_len, 1.0f);
-                auto ones_row_v = make_ad(ones_row_v_t);
-                auto b_mat_v = matmul(b_lm, ones_row_v);
-                logits_v = add(logits_v, b_mat_v);
-                int V = (int)tokenizer.vocab_size();
-                std::vector<float> temp_grad(V);
-                for (int t = 0; t < seq_len; ++t) {
-                    std::vector<float> logit_t(V);
-                    for (int i = 0; i < V; ++i) {
-                        logit_t[i] = logits_v->val.data[i * seq_len + t];
-                    }
-                    val_loss += softmax_cross_entropy(logit_t, tgt[t], temp_grad);
-                    ++val_count;
-                }
+                auto h_v     = ad_transformer.forward(x_v, nullptr, seq_len);
+                auto logits_v = add_bias_broadcast(matmul(W_embed, h_v, true, false), b_lm);
+                val_loss += cross_entropy_ad(logits_v, tgt)->val.data[0];
+                val_count += B * seq_len;
             }
             float avg_val = val_loss / val_count;
             std::cout << "Validation loss = " << avg_val << "\n";
@@ -909,15 +824,26 @@ int main(int argc, char** argv) {
             }
             if (no_improve >= patience) {
                 std::cout << "Early stopping at epoch " << epoch << "\n";
-                break;
+                stop_early = true;
             }
         }
+        // The next epoch starts from the RNG as this one left it
+        mark_progress(epoch + 1, 0, rng);
+        if (!save_file.empty()) save_progress();
+        if (stop_early) break;
         std::cout << "Train trend: " << sparkline(loss_history) << "\n";
         if (!val_history.empty()) {
             std::cout << "Valid trend: " << sparkline(val_history) << "\n";
         }
     }
     std::cout << "Training complete.\n";
+    if (!save_file.empty()) {
+        if (!finish_checkpoints(checkpoint_writer)) return 1;
+        if (checkpoint_writer.written() > 0)
+            std::cout << "Saved checkpoint to " << save_file << " ("
+                      << checkpoint_writer.written() << " written, "
+                      << checkpoint_writer.skipped() << " skipped while the disk was busy)\n";
+    }
     if (!ptq_out.empty()) {
         std::ofstream oq(ptq_out, std::ios::binary);
         if (!oq) {
@@ -44,6 +44,8 @@ void UnifiedMemoryManager::init(std::size_t max_on_chip_bytes) {
 
 void* UnifiedMemoryManager::allocate(std::size_t bytes) {
     std::lock_guard<std::mutex> lock(mu_);
+    in_use_ += bytes;
+    if (in_use_ > peak_) peak_ = in_use_;
     if (pool_ && allocated_on_chip_ + bytes <= max_on_chip_) {
         void* ptr = pool_ + allocated_on_chip_;
         allocations_[ptr] = bytes;
@@ -61,6 +63,7 @@ void UnifiedMemoryManager::deallocate(void* ptr, std::size_t /*bytes*/) {
     std::lock_guard<std::mutex> lock(mu_);
     auto it = allocations_.find(ptr);
     if (it != allocations_.end()) {
+        in_use_ -= it->second;
         bool is_pool = pool_ && (ptr >= pool_ && ptr < pool_ + max_on_chip_);
         if (!is_pool) {
             // Only free heap (fallback) allocations; pool memory uses a bump
@@ -70,4 +73,18 @@ void UnifiedMemoryManager::deallocate(void* ptr, std::size_t /*bytes*/) {
         }
         allocations_.erase(it);
     }
-}
\ No newline at end of file
+}
+std::size_t UnifiedMemoryManager::bytes_in_use() {
+    std::lock_guard<std::mutex> lock(mu_);
+    return in_use_;
+}
+
+std::size_t UnifiedMemoryManager::peak_bytes() {
+    std::lock_guard<std::mutex> lock(mu_);
+    return peak_;
+}
+
+void UnifiedMemoryManager::reset_peak() {
+    std::lock_guard<std::mutex> lock(mu_);
+    peak_ = in_use_;
+}
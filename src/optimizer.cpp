@@ -1,5 +1,6 @@
 #include "optimizer.hpp"
 #include <cmath>
+#include <stdexcept>
 #include "quantization.hpp"
 
 SGD::SGD(float lr_) : lr(lr_) {}
@@ -8,7 +9,7 @@ void SGD::step() {
     auto& params = get_parameters();
     for (auto& p : params) {
         Tensor& val = p->val;
-        Tensor& grad = p->grad;
+        Tensor& grad = p->ensure_grad();
         for (size_t i = 0, n = val.data.size(); i < n; ++i) {
             val.data[i] -= lr * grad.data[i];
         }
@@ -60,7 +61,7 @@ void AdamW::step() {
     }
     t += 1;
     for (size_t i = 0; i < Np; ++i) {
-        Tensor& grad = params[i]->grad;
+        Tensor& grad = params[i]->ensure_grad();
         Tensor& val  = params[i]->val;
         Tensor& mi   = m[i];
         Tensor& vi   = v[i];
@@ -89,4 +90,18 @@ void AdamW::step() {
 void AdamW::zero_grad() {
     auto& params = get_parameters();
     for (auto& p : params) p->grad.fill(0.0f);
-}
\ No newline at end of file
+}
+
+void AdamW::restore(int steps, std::vector<Tensor> m_, std::vector<Tensor> v_) {
+    auto& params = get_parameters();
+    if (m_.size() != v_.size() || (!m_.empty() && m_.size() != params.size()))
+        throw std::invalid_argument("AdamW::restore: one moment pair per parameter expected");
+    for (size_t i = 0; i < m_.size(); ++i) {
+        size_t n = params[i]->val.data.size();
+        if (m_[i].data.size() != n || v_[i].data.size() != n)
+            throw std::invalid_argument("AdamW::restore: moment size does not match parameter");
+    }
+    t = steps;
+    m = std::move(m_);
+    v = std::move(v_);
+}
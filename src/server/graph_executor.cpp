@@ -1,8 +1,11 @@
 #include "server/graph_executor.hpp"
 #include "autodiff.hpp"
+#include "thread_pool.hpp"
 #include <queue>
 #include <algorithm>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 
 namespace server {
 
@@ -87,8 +90,9 @@ GraphResult GraphExecutor::execute(const GraphDef& graph) {
     GraphResult result;
     auto total_start = std::chrono::high_resolution_clock::now();
 
-    // Clear global parameter registry for fresh execution
+    // Clear global parameter registry and this thread's tape for fresh execution
     clear_parameters();
+    clear_tape();
 
     // Topological sort
     std::string sort_error;
@@ -97,8 +101,6 @@ GraphResult GraphExecutor::execute(const GraphDef& graph) {
         result.error = sort_error;
         return result;
     }
-    result.execution_order = order;
-
     // Build lookup maps
     std::unordered_map<std::string, const NodeDef*> node_map;
     for (auto& node : graph.nodes)
@@ -106,17 +108,59 @@ GraphResult GraphExecutor::execute(const GraphDef& graph) {
 
     // edge: target_node.target_port -> (source_node, source_port)
     std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>> incoming;
+    std::unordered_map<std::string, std::vector<std::string>> upstream;
     for (auto& edge : graph.edges) {
         std::string key = edge.target_node + "." + edge.target_port;
         incoming[key].push_back({edge.source_node, edge.source_port});
+        upstream[edge.target_node].push_back(edge.source_node);
     }
 
+    // Create the modules before scheduling: whether a node runs backward()
+    // decides its wave
+    std::unordered_map<std::string, std::unique_ptr<ModuleWrapper>> modules;
+    std::unordered_map<std::string, std::string> create_errors;
+    for (auto& node_id : order) {
+        try {
+            modules[node_id] = registry_.create(node_map[node_id]->type, node_map[node_id]->config);
+        } catch (const std::exception& e) {
+            create_errors[node_id] = e.what();
+        }
+    }
+
+    // Group nodes into waves: a node runs one wave after its latest input,
+    // so the nodes of a wave are independent and run concurrently. A node
+    // that runs backward() clears the shared tape when it finishes, under
+    // any sibling still recording, so each gets a wave of its own after its
+    // level's other nodes.
+    std::unordered_map<std::string, int> level;
+    std::vector<std::vector<std::string>> levels;
+    for (auto& node_id : order) {
+        int lv = 0;
+        for (auto& src : upstream[node_id]) lv = std::max(lv, level[src] + 1);
+        level[node_id] = lv;
+        if (lv >= static_cast<int>(levels.size())) levels.resize(lv + 1);
+        levels[lv].push_back(node_id);
+    }
+    std::vector<std::vector<std::string>> waves;
+    for (auto& nodes : levels) {
+        std::vector<std::string> concurrent, alone;
+        for (auto& node_id : nodes) {
+            auto it = modules.find(node_id);
+            bool backward = it != modules.end() && it->second->runs_backward();
+            (backward ? alone : concurrent).push_back(node_id);
+        }
+        if (!concurrent.empty()) waves.push_back(std::move(concurrent));
+        for (auto& node_id : alone) waves.push_back({node_id});
+    }
+    for (auto& wave : waves)
+        result.execution_order.insert(result.execution_order.end(), wave.begin(), wave.end());
+
     // Store outputs per node
     std::unordered_map<std::string, std::unordered_map<std::string, PortValue>> node_outputs;
 
-    // Execute in topological order
-    for (auto& node_id : order) {
-        NodeResult nr;
+    // Runs one node; reads node_outputs of earlier waves only
+    auto run_node = [&](const std::string& node_id, NodeResult& nr,
+                        std::unordered_map<std::string, PortValue>& outputs) {
         nr.node_id = node_id;
         auto* node_def = node_map[node_id];
         nr.node_type = node_def->type;
@@ -124,8 +168,9 @@ GraphResult GraphExecutor::execute(const GraphDef& graph) {
         auto node_start = std::chrono::high_resolution_clock::now();
 
         try {
-            // Create module instance
-            auto module = registry_.create(node_def->type, node_def->config);
+            auto err = create_errors.find(node_id);
+            if (err != create_errors.end()) throw std::runtime_error(err->second);
+            auto& module = modules.at(node_id);
 
             // Gather inputs from upstream
             std::unordered_map<std::string, PortValue> inputs;
@@ -148,10 +193,7 @@ GraphResult GraphExecutor::execute(const GraphDef& graph) {
             }
 
             // Execute
-            auto outputs = module->execute(inputs);
-
-            // Store outputs
-            node_outputs[node_id] = outputs;
+            outputs = module->execute(inputs);
 
             // Serialize outputs for response
             nr.outputs = json::object();
@@ -166,10 +208,28 @@ GraphResult GraphExecutor::execute(const GraphDef& graph) {
         auto node_end = std::chrono::high_resolution_clock::now();
         nr.execution_time_ms = std::chrono::duration<double, std::milli>(
             node_end - node_start).count();
+    };
+
+    // Execute wave by wave on the shared pool. Tasks bind this thread's tape,
+    // so the nodes of a wave record onto one tape from several workers.
+    for (auto& wave : waves) {
+        std::vector<NodeResult> wave_results(wave.size());
+        std::vector<std::unordered_map<std::string, PortValue>> wave_outputs(wave.size());
+        parallel::TaskGroup group;
+        for (size_t i = 0; i < wave.size(); ++i) {
+            group.run([&, i] { run_node(wave[i], wave_results[i], wave_outputs[i]); });
+        }
+        group.wait();
 
-        result.node_results.push_back(std::move(nr));
+        for (size_t i = 0; i < wave.size(); ++i) {
+            if (wave_results[i].error.empty())
+                node_outputs[wave[i]] = std::move(wave_outputs[i]);
+            result.node_results.push_back(std::move(wave_results[i]));
+        }
     }
 
+    clear_tape();
+
     auto total_end = std::chrono::high_resolution_clock::now();
     result.total_time_ms = std::chrono::duration<double, std::milli>(
         total_end - total_start).count();
@@ -462,47 +462,11 @@ public:
         auto logits = get_input<std::shared_ptr<ADTensor>>(inputs, "logits");
         auto targets = get_input<std::vector<int>>(inputs, "targets");
 
-        int vocab_size = logits->val.rows;
         int seq_len = logits->val.cols;
+        auto loss = scalar_mul(cross_entropy_ad(logits, targets),
+                               1.0f / static_cast<float>(seq_len));
 
-        Tensor target_tensor(vocab_size, seq_len);
-        target_tensor.fill(0.0f);
-        for (int t = 0; t < seq_len && t < static_cast<int>(targets.size()); t++) {
-            int target_id = targets[t];
-            if (target_id >= 0 && target_id < vocab_size)
-                target_tensor(target_id, t) = 1.0f;
-        }
-        auto target_ad = make_ad(target_tensor);
-
-        // log-sum-exp for numerical stability
-        Tensor max_vals(1, seq_len);
-        for (int j = 0; j < seq_len; j++) {
-            float mx = logits->val(0, j);
-            for (int i = 1; i < vocab_size; i++)
-                mx = std::max(mx, logits->val(i, j));
-            max_vals(0, j) = mx;
-        }
-
-        Tensor ones_col(vocab_size, 1);
-        ones_col.fill(1.0f);
-        auto max_ad = make_ad(ones_col.matmul(max_vals));
-        auto shifted = sub(logits, max_ad);
-        auto exp_vals = exp_ad(shifted);
-
-        Tensor ones_row(1, vocab_size);
-        ones_row.fill(1.0f);
-        auto ones_ad = make_ad(ones_row);
-        auto sum_exp = matmul(ones_ad, exp_vals);
-
-        auto log_sum = log_ad(sum_exp);
-        auto log_sum_broadcast = matmul(make_ad(ones_col), log_sum);
-        auto log_probs = sub(shifted, log_sum_broadcast);
-
-        auto target_log_probs = mul(target_ad, log_probs);
-        auto total = sum(target_log_probs);
-        auto neg_loss = scalar_mul(total, -1.0f / static_cast<float>(seq_len));
-
-        return {{"loss", PortValue(neg_loss)}};
+        return {{"loss", PortValue(loss)}};
     }
 };
 
@@ -529,6 +493,7 @@ public:
         loss->backward();
         return {};
     }
+    bool runs_backward() const override { return true; }
 };
 
 class TextInputWrapper : public ModuleWrapper {
@@ -835,8 +800,11 @@ public:
 
 class ADWeightTyingWrapper : public ModuleWrapper {
     std::unique_ptr<ADWeightTying> wt;
+    bool embedding_layout;
 public:
-    ADWeightTyingWrapper(const json&) {}
+    // embedding_layout: weights come from ADEmbedding's "weights" port
+    ADWeightTyingWrapper(const json& config)
+        : embedding_layout(config.value("embedding_layout", true)) {}
 
     std::string type_name() const override { return "ADWeightTying"; }
     std::string category() const override { return "linear"; }
@@ -852,13 +820,13 @@ public:
     std::vector<PortDescriptor> output_ports() const override {
         return {{"output", PortType::AD_TENSOR}};
     }
-    json default_config() const override { return json::object(); }
+    json default_config() const override { return {{"embedding_layout", true}}; }
 
     std::unordered_map<std::string, PortValue> execute(
         const std::unordered_map<std::string, PortValue>& inputs) override {
         auto weights = get_input<std::shared_ptr<ADTensor>>(inputs, "weights");
         auto input = get_input<std::shared_ptr<ADTensor>>(inputs, "input");
-        wt = std::make_unique<ADWeightTying>(weights);
+        wt = std::make_unique<ADWeightTying>(weights, embedding_layout);
         auto out = wt->forward(input);
         return {{"output", PortValue(out)}};
     }
@@ -5,7 +5,7 @@
 
 namespace server {
 
-static json compute_stats(const std::vector<float, UnifiedMemoryAllocator<float>>& data) {
+static json compute_stats(const TensorStorage& data) {
     if (data.empty()) return {{"min", 0}, {"max", 0}, {"mean", 0}, {"std", 0}};
 
     float mn = data[0], mx = data[0], sum = 0;
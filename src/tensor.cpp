@@ -1,7 +1,5 @@
 #include "tensor.hpp"
-#if defined(__ARM_NEON__)
-#include <arm_neon.h>
-#endif
+#include "gemm.hpp"
 #ifdef USE_ACCELERATE
 #include <Accelerate/Accelerate.h>
 #endif
@@ -33,6 +31,15 @@ Tensor::Tensor(int r, int c) : rows(r), cols(c), shape({r, c}), data(r * c, 0.0f
 
 Tensor::Tensor(int size) : Tensor(size, 1) {}
 
+Tensor Tensor::adopt(float* ptr, const std::vector<int>& shape,
+                     std::shared_ptr<void> owner) {
+    Tensor t(std::vector<int>{0});
+    t.shape = shape;
+    t.sync_rows_cols();
+    t.data = TensorStorage::view(ptr, static_cast<size_t>(compute_numel(shape)), std::move(owner));
+    return t;
+}
+
 void Tensor::fill(float value) {
     std::fill(data.begin(), data.end(), value);
 }
@@ -54,48 +61,35 @@ Tensor Tensor::matmul(const Tensor& other) const {
     assert(ndim() == 2 && other.ndim() == 2);
     assert(cols == other.rows);
     Tensor result(rows, other.cols);
-#ifdef USE_ACCELERATE
-    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
-                rows, other.cols, cols,
-                1.0f,
-                data.data(), cols,
-                other.data.data(), other.cols,
-                0.0f,
-                result.data.data(), other.cols);
+    gemm(false, false, 1.0f, *this, other, 0.0f, result);
     return result;
+}
+
+void Tensor::gemm(bool trans_a, bool trans_b, float alpha,
+                  const Tensor& A, const Tensor& B, float beta, Tensor& C) {
+    assert(A.ndim() == 2 && B.ndim() == 2 && C.ndim() == 2);
+    int M = trans_a ? A.cols : A.rows;
+    int K = trans_a ? A.rows : A.cols;
+    int N = trans_b ? B.rows : B.cols;
+    assert((trans_b ? B.cols : B.rows) == K);
+    assert(C.rows == M && C.cols == N);
+#ifdef USE_ACCELERATE
+    cblas_sgemm(CblasRowMajor,
+                trans_a ? CblasTrans : CblasNoTrans,
+                trans_b ? CblasTrans : CblasNoTrans,
+                M, N, K,
+                alpha,
+                A.data.data(), A.cols,
+                B.data.data(), B.cols,
+                beta,
+                C.data.data(), C.cols);
 #else
-    const int B = 32;
-    for (int ii = 0; ii < rows; ii += B) {
-        int iMax = std::min(ii + B, rows);
-        for (int kk = 0; kk < cols; kk += B) {
-            int kMax = std::min(kk + B, cols);
-            for (int jj = 0; jj < other.cols; jj += B) {
-                int jMax = std::min(jj + B, other.cols);
-                for (int i = ii; i < iMax; ++i) {
-                    for (int k = kk; k < kMax; ++k) {
-                        const float a = (*this)(i, k);
-                        float* res_ptr = &result.data[i * other.cols + jj];
-                        const float* other_ptr = &other.data[k * other.cols + jj];
-                        int len = jMax - jj;
-                        int j = 0;
-#if defined(__ARM_NEON__)
-                        float32x4_t va = vdupq_n_f32(a);
-                        for (; j + 4 <= len; j += 4) {
-                            float32x4_t vb = vld1q_f32(other_ptr + j);
-                            float32x4_t vr = vld1q_f32(res_ptr + j);
-                            vr = vmlaq_f32(vr, vb, va);
-                            vst1q_f32(res_ptr + j, vr);
-                        }
-#endif
-                        for (; j < len; ++j) {
-                            res_ptr[j] += a * other_ptr[j];
-                        }
-                    }
-                }
-            }
-        }
-    }
-    return result;
+    ::gemm::sgemm(trans_a, trans_b, M, N, K,
+                  alpha,
+                  A.data.data(), A.cols,
+                  B.data.data(), B.cols,
+                  beta,
+                  C.data.data(), C.cols);
 #endif
 }
 
@@ -0,0 +1,321 @@
+#include "thread_pool.hpp"
+#include "autodiff.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace parallel {
+namespace detail {
+
+struct GroupState {
+    tape::Context ctx;
+    int pending = 0;  // guarded by mu
+    std::mutex mu;
+    std::condition_variable done;
+    std::exception_ptr error;
+};
+
+} // namespace detail
+
+namespace {
+
+using detail::GroupState;
+
+struct Task {
+    std::function<void()> fn;
+    GroupState* group = nullptr;
+};
+
+// One per spawning thread. The owner pushes and pops at the back; thieves
+// take the oldest task from the front.
+struct TaskQueue {
+    std::mutex mu;
+    std::deque<Task> tasks;
+    std::atomic<int> size{0};  // lets thieves skip empty queues unlocked
+};
+
+// Upper bound on threads that can spawn tasks at once; beyond it a thread
+// runs its tasks inline
+constexpr int kMaxQueues = 512;
+
+void run_task(Task& t) {
+    GroupState* g = t.group;
+    {
+        tape::ContextScope scope(g->ctx);
+        try {
+            t.fn();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(g->mu);
+            if (!g->error) g->error = std::current_exception();
+        }
+    }
+    t.fn = nullptr;  // drop captures before the group can be released
+    // Decrement under the lock so a waiter cannot free the group while the
+    // last task is still signalling it
+    std::lock_guard<std::mutex> lock(g->mu);
+    if (--g->pending == 0) g->done.notify_all();
+}
+
+class Scheduler {
+public:
+    static Scheduler& instance() {
+        // Intentionally leaked, like UnifiedMemoryManager, so workers never
+        // race static destruction at exit
+        static auto* inst = new Scheduler();
+        return *inst;
+    }
+
+    int size() const { return n_threads_.load(); }
+    bool pinned() const { return pin_.load(); }
+
+    void configure(int n, bool pin) {
+        std::lock_guard<std::mutex> lock(config_mu_);
+        if (n <= 0) n = hardware_threads();
+        stop_workers();
+        pin_.store(pin);
+        n_threads_.store(n);
+        start_workers(n - 1, pin);
+    }
+
+    // Task queue owned by the calling thread, or nullptr if none is free
+    TaskQueue* local_queue();
+    void release_queue(int idx) {
+        std::lock_guard<std::mutex> lock(slots_mu_);
+        free_slots_.push_back(idx);
+    }
+
+    void submit(TaskQueue& q, Task&& t) {
+        {
+            std::lock_guard<std::mutex> lock(q.mu);
+            q.tasks.push_back(std::move(t));
+            q.size.fetch_add(1);
+        }
+        queued_.fetch_add(1);
+        if (sleepers_.load() > 0) {
+            { std::lock_guard<std::mutex> lock(sleep_mu_); }
+            wake_.notify_one();
+        }
+    }
+
+    // Pop the newest task if it belongs to g. Groups nest, so while the
+    // owner waits on g any of g's unstarted tasks sit at the back.
+    bool pop_own(TaskQueue& q, GroupState* g, Task& out) {
+        std::lock_guard<std::mutex> lock(q.mu);
+        if (q.tasks.empty() || q.tasks.back().group != g) return false;
+        out = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        q.size.fetch_sub(1);
+        queued_.fetch_sub(1);
+        return true;
+    }
+
+    bool steal(Task& out, int start) {
+        int n = n_queues_.load();
+        for (int i = 0; i < n; ++i) {
+            TaskQueue& q = queues_[(start + i) % n];
+            if (q.size.load() == 0) continue;
+            std::lock_guard<std::mutex> lock(q.mu);
+            if (q.tasks.empty()) continue;
+            out = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            q.size.fetch_sub(1);
+            queued_.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    Scheduler() {
+        int n = hardware_threads();
+        n_threads_.store(n);
+        start_workers(n - 1, false);
+    }
+
+    static int hardware_threads() {
+        unsigned hc = std::thread::hardware_concurrency();
+        return hc > 0 ? static_cast<int>(hc) : 1;
+    }
+
+    void start_workers(int n, bool pin) {
+        stop_ = false;
+        for (int i = 0; i < n; ++i) {
+            workers_.emplace_back([this, i, pin] { worker_loop(i, pin); });
+        }
+    }
+
+    void stop_workers() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mu_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& w : workers_) w.join();
+        workers_.clear();
+    }
+
+    void worker_loop(int id, bool pin) {
+#ifdef __linux__
+        if (pin) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET((id + 1) % hardware_threads(), &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+#else
+        (void)pin;
+#endif
+        Task t;
+        for (;;) {
+            if (steal(t, id)) {
+                run_task(t);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mu_);
+            sleepers_.fetch_add(1);
+            wake_.wait(lock, [&] { return stop_ || queued_.load() > 0; });
+            sleepers_.fetch_sub(1);
+            if (stop_) return;
+        }
+    }
+
+    std::mutex config_mu_;
+    std::vector<std::thread> workers_;
+    std::atomic<int> n_threads_{1};
+    std::atomic<bool> pin_{false};
+
+    std::mutex sleep_mu_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::atomic<int> sleepers_{0};
+    std::atomic<int> queued_{0};
+
+    std::mutex slots_mu_;
+    std::vector<int> free_slots_;
+    std::atomic<int> n_queues_{0};
+    TaskQueue queues_[kMaxQueues];
+};
+
+// Returns the calling thread's queue slot when the thread exits
+struct QueueSlot {
+    int idx = -1;
+    ~QueueSlot() {
+        if (idx >= 0) Scheduler::instance().release_queue(idx);
+    }
+};
+
+thread_local QueueSlot t_slot;
+
+TaskQueue* Scheduler::local_queue() {
+    if (t_slot.idx < 0) {
+        std::lock_guard<std::mutex> lock(slots_mu_);
+        if (!free_slots_.empty()) {
+            t_slot.idx = free_slots_.back();
+            free_slots_.pop_back();
+        } else if (n_queues_.load() < kMaxQueues) {
+            t_slot.idx = n_queues_.fetch_add(1);
+        } else {
+            return nullptr;
+        }
+    }
+    return &queues_[t_slot.idx];
+}
+
+} // namespace
+
+int num_threads() {
+    return Scheduler::instance().size();
+}
+
+void set_num_threads(int n) {
+    Scheduler& s = Scheduler::instance();
+    s.configure(n, s.pinned());
+}
+
+void set_pinning(bool pin) {
+    Scheduler& s = Scheduler::instance();
+    s.configure(s.size(), pin);
+}
+
+bool pinning() {
+    return Scheduler::instance().pinned();
+}
+
+TaskGroup::TaskGroup() : state_(new detail::GroupState()) {
+    state_->ctx = tape::capture();
+}
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+void TaskGroup::run(std::function<void()> fn) {
+    Scheduler& s = Scheduler::instance();
+    {
+        std::lock_guard<std::mutex> lock(state_->mu);
+        ++state_->pending;
+    }
+    Task t{std::move(fn), state_.get()};
+    TaskQueue* q = s.size() > 1 ? s.local_queue() : nullptr;
+    if (q) s.submit(*q, std::move(t));
+    else run_task(t);
+}
+
+void TaskGroup::wait() {
+    Scheduler& s = Scheduler::instance();
+    GroupState* g = state_.get();
+    TaskQueue* q = s.size() > 1 ? s.local_queue() : nullptr;
+    Task t;
+    for (;;) {
+        if (q && s.pop_own(*q, g, t)) {
+            run_task(t);
+            continue;
+        }
+        // Whatever is left was stolen and is running elsewhere
+        std::unique_lock<std::mutex> lock(g->mu);
+        g->done.wait(lock, [&] { return g->pending == 0; });
+        break;
+    }
+    std::exception_ptr err;
+    {
+        std::lock_guard<std::mutex> lock(g->mu);
+        std::swap(err, g->error);
+    }
+    if (err) std::rethrow_exception(err);
+}
+
+void parallel_for(int begin, int end, int grain,
+                  const std::function<void(int, int)>& fn) {
+    if (end <= begin) return;
+    int n = end - begin;
+    grain = std::max(1, grain);
+    int threads = num_threads();
+    // A few chunks per thread so stealing can even out uneven work
+    int chunks = std::min((n + grain - 1) / grain, threads * 4);
+    if (threads <= 1 || chunks <= 1) {
+        fn(begin, end);
+        return;
+    }
+    int step = (n + chunks - 1) / chunks;
+    TaskGroup group;
+    for (int lo = begin + step; lo < end; lo += step) {
+        int hi = std::min(end, lo + step);
+        group.run([&fn, lo, hi] { fn(lo, hi); });
+    }
+    fn(begin, begin + step);
+    group.wait();
+}
+
+} // namespace parallel
@@ -1,4 +1,5 @@
 #include "transformer.hpp"
+#include <stdexcept>
 
 TransformerBlock::TransformerBlock(int input_dim, int hidden_dim,
                                    int n_heads)
@@ -21,6 +22,16 @@ Tensor TransformerBlock::forward(const Tensor& input, bool training, bool use_ca
     return ff_out + out1;           // Residual connection
 }
 
+Tensor TransformerBlock::forward(const Tensor& input,
+                                 const std::vector<PagedSpan>& spans, int layer) {
+    Tensor out1 = mha.forward(ln1.forward(input), spans, layer) + input;
+    return ff.forward(ln2.forward(out1)) + out1;
+}
+
+void TransformerBlock::reserve_cache(int capacity, bool sliding) {
+    mha.reserve_cache(capacity, sliding);
+}
+
 void TransformerBlock::clear_cache() {
     mha.clear_cache();
 }
@@ -40,6 +51,43 @@ Tensor Transformer::forward(const Tensor& input, bool training, bool use_cache)
     return output;
 }
 
+Tensor Transformer::forward(const Tensor& input, PagedKVCache& paged) {
+    return forward(input, std::vector<PagedKVCache*>{&paged}, {input.cols});
+}
+
+Tensor Transformer::forward(const Tensor& input, const std::vector<PagedKVCache*>& seqs,
+                            const std::vector<int>& lens) {
+    if (seqs.size() != lens.size()) {
+        throw std::invalid_argument("Transformer: one length per sequence expected");
+    }
+    std::vector<PagedSpan> spans;
+    int col = 0;
+    for (size_t i = 0; i < seqs.size(); ++i) {
+        const KVBlockPool& pool = seqs[i]->pool();
+        if (pool.num_layers() != static_cast<int>(blocks.size()) ||
+            pool.dim() != input.rows) {
+            throw std::invalid_argument("Transformer: KV block pool shape mismatch");
+        }
+        spans.push_back({seqs[i], col, lens[i], 0});
+        col += lens[i];
+    }
+    if (col != input.cols) {
+        throw std::invalid_argument("Transformer: sequence lengths do not cover the input");
+    }
+    for (auto& span : spans) span.pos = span.cache->extend(span.len);
+    Tensor output = input;
+    for (size_t l = 0; l < blocks.size(); ++l) {
+        output = blocks[l].forward(output, spans, static_cast<int>(l));
+    }
+    return output;
+}
+
+void Transformer::reserve_cache(int capacity, bool sliding) {
+    for (auto& block : blocks) {
+        block.reserve_cache(capacity, sliding);
+    }
+}
+
 void Transformer::clear_cache() {
     for (auto& block : blocks) {
         block.clear_cache();
@@ -7,6 +7,7 @@
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <stdexcept>
 
 static bool almost_eq(float a, float b, float eps = 1e-4f) {
     return std::fabs(a - b) <= eps;
@@ -67,6 +68,28 @@ int main() {
         }
     }
 
+    // ADLinear: a row-major batch goes through forward_rows, even when the
+    // batch size equals input_dim and the shape alone is ambiguous
+    {
+        clear_parameters();
+        ADLinear lin(4, 3);
+        Tensor rows_t(4, 4), cols_t(4, 4);  // [B x in] and its transpose
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j) rows_t(i, j) = cols_t(j, i) = 0.1f * (i * 4 + j) - 0.7f;
+        auto by_rows = lin.forward_rows(make_ad(rows_t));  // [B x out]
+        auto by_cols = lin.forward(make_ad(cols_t));       // [out x B]
+        assert(by_rows->val.rows == 4 && by_rows->val.cols == 3);
+        for (int i = 0; i < 4; ++i)
+            for (int o = 0; o < 3; ++o) assert(almost_eq(by_rows->val(i, o), by_cols->val(o, i)));
+        bool threw = false;
+        try {
+            lin.forward(make_ad(Tensor(3, 4)));
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
     // ADEmbedding: lookup produces [embed x seq_len]
     {
         clear_parameters();
@@ -141,6 +164,51 @@ int main() {
             assert(std::isfinite(v));
     }
 
+    // ADLayerNorm: fused input/gamma/beta gradients match finite differences
+    {
+        clear_parameters();
+        int dim = 5, seq_len = 3;
+        ADLayerNorm ln(dim);
+        auto& params = get_parameters();
+        auto gamma = params[0], beta = params[1];
+        for (int i = 0; i < dim; ++i) {
+            gamma->val.data[i] = 0.5f + 0.2f * i;
+            beta->val.data[i] = 0.1f * i - 0.2f;
+        }
+        Tensor x_t(dim, seq_len), w_t(dim, seq_len);
+        for (int i = 0; i < x_t.numel(); ++i) {
+            x_t.data[i] = std::sin(1.3f * i) * 2.0f;
+            w_t.data[i] = std::cos(0.7f * i);
+        }
+        auto w = make_const(w_t);
+        auto loss = [&](const Tensor& xv) {
+            return sum(mul(ln.forward(make_const(xv)), w))->val.data[0];
+        };
+        auto x = make_ad(x_t);
+        sum(mul(ln.forward(x), w))->backward();
+        clear_tape();
+        const float h = 1e-2f;
+        for (int i = 0; i < x_t.numel(); ++i) {
+            Tensor xp = x_t, xm = x_t;
+            xp.data[i] += h;
+            xm.data[i] -= h;
+            float num = (loss(xp) - loss(xm)) / (2 * h);
+            assert(almost_eq(x->grad.data[i], num, 2e-2f));
+        }
+        for (int i = 0; i < dim; ++i) {
+            float g0 = gamma->val.data[i];
+            gamma->val.data[i] = g0 + h;
+            float lp = loss(x_t);
+            gamma->val.data[i] = g0 - h;
+            float lm = loss(x_t);
+            gamma->val.data[i] = g0;
+            assert(almost_eq(gamma->grad.data[i], (lp - lm) / (2 * h), 2e-2f));
+            float sb = 0.0f;
+            for (int j = 0; j < seq_len; ++j) sb += w_t(i, j);
+            assert(almost_eq(beta->grad.data[i], sb));
+        }
+    }
+
     // ADPositionalEncoding: forward shape
     {
         clear_parameters();
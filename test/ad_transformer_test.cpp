@@ -1,7 +1,10 @@
 #include "layers/ad_transformer.hpp"
 #include "autodiff.hpp"
+#include "memory_pool.hpp"
 #include "tensor.hpp"
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 
@@ -128,6 +131,87 @@ int main() {
         for (auto& v : out->val.data) assert(std::isfinite(v));
     }
 
+    // RoPE + grouped-query attention: K/V projections shrink to the KV
+    // heads and gradients reach the input through the rotation
+    {
+        clear_parameters();
+        TransformerConfig cfg = make_cfg(8, 16, 4);
+        cfg.use_rope = true;
+        cfg.n_kv_heads = 2;
+        cfg.max_len = 16;
+        ADTransformerBlock block(cfg);
+        auto& params = get_parameters();
+        assert(params[1]->val.rows == 4 && params[2]->val.rows == 4);
+        Tensor input_t(8, 6);
+        for (int i = 0; i < input_t.numel(); ++i) input_t.data[i] = std::cos(0.3f * i);
+        auto input = make_ad(input_t);
+        register_parameter(input);
+        // Two packed sequences of 3 behave like two separate calls
+        auto out = block.forward(input, nullptr, 3);
+        sum(out)->backward();
+        bool has_nonzero = false;
+        for (auto& v : input->grad.data) {
+            assert(std::isfinite(v));
+            if (std::fabs(v) > 1e-8f) has_nonzero = true;
+        }
+        assert(has_nonzero);
+        Tensor second(8, 3);
+        for (int r = 0; r < 8; ++r)
+            for (int c = 0; c < 3; ++c) second(r, c) = input_t(r, 3 + c);
+        NoGradGuard no_grad;
+        auto alone = block.forward(make_ad(second));
+        for (int r = 0; r < 8; ++r)
+            for (int c = 0; c < 3; ++c)
+                assert(std::fabs(alone->val(r, c) - out->val(r, 3 + c)) < 1e-5f);
+    }
+
+    // no-grad forward matches the recorded forward, records nothing, and
+    // needs less memory and time per forward
+    {
+        clear_parameters();
+        clear_tape();
+        ADTransformer transformer(2, 64, 128, 4);
+        Tensor input_t(64, 48);
+        for (int i = 0; i < input_t.numel(); ++i) input_t.data[i] = 0.01f * (i % 13) - 0.06f;
+        auto input = make_ad(input_t);
+        auto& mem = UnifiedMemoryManager::instance();
+
+        auto run = [&](bool no_grad, size_t& peak, double& best_ms) {
+            peak = 0;
+            best_ms = 1e30;
+            Tensor out_val(1, 1);
+            for (int rep = 0; rep < 3; ++rep) {
+                size_t base = mem.bytes_in_use();
+                mem.reset_peak();
+                auto t0 = std::chrono::steady_clock::now();
+                {
+                    std::unique_ptr<NoGradGuard> guard;
+                    if (no_grad) guard.reset(new NoGradGuard());
+                    auto out = transformer.forward(input);
+                    assert(out->requires_grad == !no_grad);
+                    assert(no_grad ? tape_size() == 0 : tape_size() > 0);
+                    out_val = out->val;
+                }
+                clear_tape();
+                auto t1 = std::chrono::steady_clock::now();
+                peak = std::max(peak, mem.peak_bytes() - base);
+                best_ms = std::min(best_ms, std::chrono::duration<double, std::milli>(t1 - t0).count());
+            }
+            return out_val;
+        };
+
+        size_t peak_grad, peak_nograd;
+        double ms_grad, ms_nograd;
+        Tensor y_grad = run(false, peak_grad, ms_grad);
+        Tensor y_nograd = run(true, peak_nograd, ms_nograd);
+        assert(grad_enabled());
+        for (int i = 0; i < y_grad.numel(); ++i) assert(y_grad.data[i] == y_nograd.data[i]);
+        assert(peak_nograd * 2 < peak_grad);
+        std::cout << "forward peak memory: " << peak_grad / 1024 << " KiB recorded, "
+                  << peak_nograd / 1024 << " KiB no-grad; time: " << ms_grad << " ms vs "
+                  << ms_nograd << " ms\n";
+    }
+
     std::cout << "All AD transformer tests passed." << std::endl;
     return 0;
 }
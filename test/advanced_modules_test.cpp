@@ -10,6 +10,7 @@
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <stdexcept>
 
 static void assert_finite(const Tensor& t, const char* name) {
     for (size_t i = 0; i < t.data.size(); ++i) {
@@ -169,6 +170,31 @@ void test_kv_cache_sliding_window() {
     std::cout << "  [PASS] KV cache sliding window\n";
 }
 
+void test_kv_cache_ring_order() {
+    ADKVCache cache(4);
+    // Positions 0..6 arrive as 3 + 1 + 3 columns; row 1 holds -position
+    int pos = 0;
+    for (int n : {3, 1, 3}) {
+        Tensor k(2, n), v(2, n);
+        for (int t = 0; t < n; ++t, ++pos) {
+            k(0, t) = (float)pos; k(1, t) = -(float)pos;
+            v(0, t) = 10.0f * pos; v(1, t) = 1.0f;
+        }
+        cache.update(make_ad(k), make_ad(v));
+    }
+    Tensor k(2, 1), v(2, 1);
+    k(0, 0) = 7.0f; k(1, 0) = -7.0f; v(0, 0) = 70.0f; v(1, 0) = 1.0f;
+    auto result = cache.update(make_ad(k), make_ad(v));
+    // Window holds positions 4..7 in order even though the ring has wrapped
+    assert(cache.cached_length() == 4);
+    for (int t = 0; t < 4; ++t) {
+        assert(result.keys->val(0, t) == (float)(4 + t));
+        assert(result.keys->val(1, t) == -(float)(4 + t));
+        assert(result.values->val(0, t) == 10.0f * (4 + t));
+    }
+    std::cout << "  [PASS] KV cache ring order\n";
+}
+
 void test_kv_cache_clear() {
     ADKVCache cache(8);
     Tensor k(4, 3), v(4, 3);
@@ -266,6 +292,25 @@ void test_flash_gradient() {
     std::cout << "  [PASS] Flash attention gradient\n";
 }
 
+void test_flash_tiled_gradient() {
+    clear_parameters();
+    ADFlashAttention flash(8, 2, 3);  // seq_len=7 -> three tiles, last partial
+    Tensor x_t(8, 7);
+    for (int i = 0; i < x_t.numel(); ++i) x_t.data[i] = 0.05f * (i % 5) - 0.1f;
+    auto x = make_ad(x_t);
+    sum(flash.forward(x))->backward();
+    bool has_nonzero = false;
+    for (auto& g : x->grad.data) {
+        assert(std::isfinite(g));
+        if (std::fabs(g) > 1e-8f) has_nonzero = true;
+    }
+    assert(has_nonzero);
+    for (auto& p : get_parameters()) {
+        for (auto& g : p->grad.data) assert(std::isfinite(g));
+    }
+    std::cout << "  [PASS] Flash attention gradient through tiles\n";
+}
+
 // ========================== Weight Tying Tests ==========================
 
 void test_weight_tying_basic() {
@@ -320,7 +365,7 @@ void test_weight_tying_with_embedding() {
     clear_parameters();
     ADEmbedding emb(16, 8);  // vocab=16, embed_dim=8
     auto weights = emb.get_weights();
-    ADWeightTying wt(weights);
+    ADWeightTying wt(weights, true);
 
     // Embed some tokens
     auto embedded = emb.forward({1, 2, 3});  // [8 x 3]
@@ -328,6 +373,28 @@ void test_weight_tying_with_embedding() {
     auto logits = wt.forward(embedded);  // [16 x 3]
     assert(logits->val.rows == 16 && logits->val.cols == 3);
     assert_finite(logits->val, "weight_tying_e2e");
+
+    // vocab == embed_dim: both layouts fit the shapes, only the flag says
+    // which one the weights are in
+    ADEmbedding square(6, 6);
+    auto h = square.forward({0, 4});
+    auto sq_logits = ADWeightTying(square.get_weights(), true).forward(h);
+    const Tensor& W = square.get_weights()->val;  // [embed_dim x vocab]
+    for (int v = 0; v < 6; ++v)
+        for (int t = 0; t < 2; ++t) {
+            float ref = 0.0f;
+            for (int d = 0; d < 6; ++d) ref += W(d, v) * h->val(d, t);
+            assert(std::fabs(sq_logits->val(v, t) - ref) < 1e-5f);
+        }
+
+    // A hidden size that matches neither layout is rejected
+    bool threw = false;
+    try {
+        wt.forward(make_ad(Tensor(5, 3)));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
     std::cout << "  [PASS] Weight tying end-to-end with embedding\n";
 }
 
@@ -349,6 +416,7 @@ int main() {
     test_kv_cache_basic();
     test_kv_cache_accumulation();
     test_kv_cache_sliding_window();
+    test_kv_cache_ring_order();
     test_kv_cache_clear();
 
     std::cout << "\n=== Repetition Penalty Tests ===\n";
@@ -360,6 +428,7 @@ int main() {
     test_flash_basic();
     test_flash_larger_than_tile();
     test_flash_gradient();
+    test_flash_tiled_gradient();
 
     std::cout << "\n=== Weight Tying Tests ===\n";
     test_weight_tying_basic();
@@ -3,6 +3,7 @@
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <thread>
 
 int main() {
     // z = x^2 + 3y, dz/dx = 2x, dz/dy = 3
@@ -145,6 +146,202 @@ int main() {
         assert(fabs(c->val(4, 1) - 10.0f) < 1e-6f);
     }
 
+    // gather columns; backward scatter-adds, accumulating repeated ids
+    {
+        Tensor t(2, 4);
+        t.data = {0, 1, 2, 3, 10, 11, 12, 13};
+        auto a = make_ad(t);
+        auto g = gather_cols(a, {3, 1, 3});
+        assert(g->val.rows == 2 && g->val.cols == 3);
+        assert(g->val(0, 0) == 3.0f && g->val(0, 1) == 1.0f && g->val(1, 2) == 13.0f);
+        Tensor w_t(2, 3);
+        w_t.data = {1, 2, 3, 4, 5, 6};
+        sum(mul(g, make_const(w_t)))->backward();
+        assert(a->grad(0, 0) == 0.0f && a->grad(0, 1) == 2.0f && a->grad(0, 3) == 4.0f);
+        assert(a->grad(1, 2) == 0.0f && a->grad(1, 1) == 5.0f && a->grad(1, 3) == 10.0f);
+        bool threw = false;
+        try { gather_cols(a, {4}); } catch (const std::out_of_range&) { threw = true; }
+        assert(threw);
+    }
+
+    // broadcast / reduction ops match the ones-matmul forms they replace
+    {
+        Tensor x_t(2, 3), b_t(2, 1), w_t(2, 3);
+        x_t.data = {1, 2, 3, 4, 5, 6};
+        b_t.data = {10, 20};
+        w_t.data = {1, -1, 2, 0.5f, 3, -2};
+        auto w = make_const(w_t);
+        auto x = make_ad(x_t), b = make_ad(b_t);
+        auto y = add_bias_broadcast(x, b);
+        assert(y->val(0, 2) == 13.0f && y->val(1, 0) == 24.0f);
+        sum(mul(y, w))->backward();
+        for (int i = 0; i < 6; ++i) assert(x->grad.data[i] == w_t.data[i]);
+        assert(fabs(b->grad.data[0] - 2.0f) < 1e-6f && fabs(b->grad.data[1] - 1.5f) < 1e-6f);
+
+        auto x2 = make_ad(x_t);
+        auto r = sum_rows(x2), c = sum_cols(x2), m = mean_cols(x2);
+        assert(r->val.rows == 2 && r->val.cols == 1 && r->val.data[1] == 15.0f);
+        assert(c->val.rows == 1 && c->val.cols == 3 && c->val.data[2] == 9.0f);
+        assert(fabs(m->val.data[0] - 2.5f) < 1e-6f);
+        Tensor wr(2, 1), wc(1, 3);
+        wr.data = {1, 2};
+        wc.data = {1, 2, 3};
+        add(add(sum(mul(r, make_const(wr))), sum(mul(c, make_const(wc)))), sum(m))->backward();
+        // d/dx[i,j] = wr[i] + wc[j] + 1/rows
+        for (int i = 0; i < 2; ++i)
+            for (int j = 0; j < 3; ++j)
+                assert(fabs(x2->grad(i, j) - (wr.data[i] + wc.data[j] + 0.5f)) < 1e-6f);
+
+        auto vc = make_ad(b_t);
+        Tensor vr_t(1, 3);
+        vr_t.data = {1, 2, 3};
+        auto vr = make_ad(vr_t);
+        auto bc = broadcast_col(vc, 3), br = broadcast_row(vr, 2);
+        assert(bc->val.rows == 2 && bc->val.cols == 3 && bc->val(1, 2) == 20.0f);
+        assert(br->val.rows == 2 && br->val.cols == 3 && br->val(1, 2) == 3.0f);
+        sum(add(mul(bc, w), mul(br, w)))->backward();
+        assert(fabs(vc->grad.data[0] - 2.0f) < 1e-6f && fabs(vc->grad.data[1] - 1.5f) < 1e-6f);
+        assert(fabs(vr->grad.data[0] - 1.5f) < 1e-6f && fabs(vr->grad.data[2] + 0.0f) < 1e-6f);
+    }
+
+    // fused softmax (scale, bias, causal) matches the primitive composition in
+    // value and gradient; softmax_cols_ad is the same thing per column
+    {
+        int rows = 3, cols = 4;
+        Tensor x_t(rows, cols), bias(rows, cols), w_t(rows, cols), masked(rows, cols);
+        for (int i = 0; i < rows * cols; ++i) {
+            x_t.data[i] = std::sin(1.7f * i);
+            bias.data[i] = -0.1f * (i % 3);
+            w_t.data[i] = std::cos(0.9f * i);
+        }
+        const float scale = 0.5f;
+        for (int i = 0; i < rows; ++i)
+            for (int j = 0; j < cols; ++j)
+                masked(i, j) = j > i + (cols - rows) ? -1e30f : bias(i, j);
+        auto w = make_const(w_t);
+
+        auto x1 = make_ad(x_t);
+        auto y1 = softmax_ad(x1, true, &bias, scale);
+        sum(mul(y1, w))->backward();
+
+        auto x2 = make_ad(x_t);
+        auto z = add(scalar_mul(x2, scale), make_const(masked));
+        Tensor mx(rows, 1);
+        for (int i = 0; i < rows; ++i) {
+            mx.data[i] = z->val(i, 0);
+            for (int j = 1; j < cols; ++j) mx.data[i] = std::max(mx.data[i], z->val(i, j));
+        }
+        auto e = exp_ad(sub(z, broadcast_col(make_const(mx), cols)));
+        auto y2 = mul(e, reciprocal(broadcast_col(sum_rows(e), cols)));
+        sum(mul(y2, w))->backward();
+
+        assert(y1->val(0, 3) == 0.0f && y1->val(2, 3) > 0.0f);
+        for (int i = 0; i < rows * cols; ++i) {
+            assert(fabs(y1->val.data[i] - y2->val.data[i]) < 1e-5f);
+            assert(fabs(x1->grad.data[i] - x2->grad.data[i]) < 1e-5f);
+        }
+
+        auto x3 = make_ad(x_t);
+        auto y3 = softmax_cols_ad(x3);
+        sum(mul(y3, w))->backward();
+        auto x4 = make_ad(x_t);
+        auto y4 = transpose(softmax_ad(transpose(x4)));
+        sum(mul(y4, w))->backward();
+        for (int i = 0; i < rows * cols; ++i) {
+            assert(fabs(y3->val.data[i] - y4->val.data[i]) < 1e-5f);
+            assert(fabs(x3->grad.data[i] - x4->grad.data[i]) < 1e-5f);
+        }
+        clear_tape();
+    }
+
+    // attention_ad over packed sequences and shared KV heads matches the
+    // per-head slice / softmax / concat composition with an explicit ALiBi
+    // bias, values and gradients; T = 45 spans several causal row blocks
+    for (int variant = 0; variant < 4; ++variant) {
+        const bool causal = variant & 1;
+        const int T = (variant & 2) ? 45 : 5;
+        const int heads = 4, kv_heads = 2, hd = 3, B = 2;
+        const float scale = 0.6f;
+        Tensor q_t(heads * hd, B * T), k_t(kv_heads * hd, B * T), v_t(kv_heads * hd, B * T);
+        Tensor w_t(heads * hd, B * T);
+        for (int i = 0; i < q_t.numel(); ++i) q_t.data[i] = 0.13f * (i % 11) - 0.6f;
+        for (int i = 0; i < k_t.numel(); ++i) k_t.data[i] = 0.07f * (i % 13) - 0.4f;
+        for (int i = 0; i < v_t.numel(); ++i) v_t.data[i] = 0.09f * (i % 7) - 0.3f;
+        for (int i = 0; i < w_t.numel(); ++i) w_t.data[i] = 0.05f * (i % 9) - 0.2f;
+        std::vector<float> slopes = {0.5f, 0.25f, 0.125f, 0.0f};
+        std::vector<Tensor> biases(heads, Tensor(T, T));
+        for (int h = 0; h < heads; ++h)
+            for (int i = 0; i < T; ++i)
+                for (int j = 0; j < T; ++j) biases[h].data[i * T + j] = -std::abs(j - i) * slopes[h];
+        auto w = make_const(w_t);
+
+        auto q1 = make_ad(q_t), k1 = make_ad(k_t), v1 = make_ad(v_t);
+        auto y1 = attention_ad(q1, k1, v1, heads, T, causal, scale, &slopes);
+        sum(mul(y1, w))->backward();
+
+        auto q2 = make_ad(q_t), k2 = make_ad(k_t), v2 = make_ad(v_t);
+        std::vector<std::shared_ptr<ADTensor>> seqs;
+        for (int b = 0; b < B; ++b) {
+            auto qb = slice_cols(q2, b * T, T);
+            auto kb = slice_cols(k2, b * T, T);
+            auto vb = slice_cols(v2, b * T, T);
+            std::vector<std::shared_ptr<ADTensor>> outs;
+            for (int h = 0; h < heads; ++h) {
+                int kh = h / (heads / kv_heads);
+                auto scores = matmul(slice(qb, h * hd, hd), slice(kb, kh * hd, hd), true, false);
+                auto p = softmax_ad(scores, causal, &biases[h], scale);
+                outs.push_back(matmul(slice(vb, kh * hd, hd), p, false, true));
+            }
+            seqs.push_back(concat(outs));
+        }
+        auto y2 = concat_cols(seqs);
+        sum(mul(y2, w))->backward();
+
+        for (int i = 0; i < y1->val.numel(); ++i)
+            assert(fabs(y1->val.data[i] - y2->val.data[i]) < 1e-5f);
+        for (int i = 0; i < q_t.numel(); ++i)
+            assert(fabs(q1->grad.data[i] - q2->grad.data[i]) < 1e-5f);
+        for (int i = 0; i < k_t.numel(); ++i) {
+            assert(fabs(k1->grad.data[i] - k2->grad.data[i]) < 1e-5f);
+            assert(fabs(v1->grad.data[i] - v2->grad.data[i]) < 1e-5f);
+        }
+        clear_tape();
+    }
+
+    // flash_attention_ad matches attention_ad with the same ALiBi slopes for
+    // tiles that do and do not divide seq_len, with and without the mask
+    for (int variant = 0; variant < 4; ++variant) {
+        const bool causal = variant & 1;
+        const int tile = (variant & 2) ? 3 : 4;
+        const int heads = 4, kv_heads = 2, hd = 3, T = 10, B = 2;
+        const float scale = 0.5f;
+        Tensor q_t(heads * hd, B * T), k_t(kv_heads * hd, B * T), v_t(kv_heads * hd, B * T);
+        Tensor w_t(heads * hd, B * T);
+        for (int i = 0; i < q_t.numel(); ++i) q_t.data[i] = 0.11f * (i % 13) - 0.7f;
+        for (int i = 0; i < k_t.numel(); ++i) k_t.data[i] = 0.08f * (i % 11) - 0.4f;
+        for (int i = 0; i < v_t.numel(); ++i) v_t.data[i] = 0.06f * (i % 9) - 0.25f;
+        for (int i = 0; i < w_t.numel(); ++i) w_t.data[i] = 0.04f * (i % 7) - 0.1f;
+        std::vector<float> slopes = {0.5f, 0.25f, 0.125f, 0.0625f};
+        auto w = make_const(w_t);
+
+        auto q1 = make_ad(q_t), k1 = make_ad(k_t), v1 = make_ad(v_t);
+        auto y1 = flash_attention_ad(q1, k1, v1, heads, T, causal, scale, tile, &slopes);
+        sum(mul(y1, w))->backward();
+        auto q2 = make_ad(q_t), k2 = make_ad(k_t), v2 = make_ad(v_t);
+        auto y2 = attention_ad(q2, k2, v2, heads, T, causal, scale, &slopes);
+        sum(mul(y2, w))->backward();
+
+        for (int i = 0; i < y1->val.numel(); ++i)
+            assert(fabs(y1->val.data[i] - y2->val.data[i]) < 1e-5f);
+        for (int i = 0; i < q_t.numel(); ++i)
+            assert(fabs(q1->grad.data[i] - q2->grad.data[i]) < 1e-5f);
+        for (int i = 0; i < k_t.numel(); ++i) {
+            assert(fabs(k1->grad.data[i] - k2->grad.data[i]) < 1e-5f);
+            assert(fabs(v1->grad.data[i] - v2->grad.data[i]) < 1e-5f);
+        }
+        clear_tape();
+    }
+
     // chained ops: f = exp(tanh(x)), df/dx = exp(tanh(x)) * (1 - tanh(x)^2)
     {
         Tensor t(1, 1);
@@ -169,6 +366,112 @@ int main() {
         assert(fabs(analytical - numerical) < 0.1f);
     }
 
+    // matmul with transposed operands matches matmul of explicit transposes,
+    // in value and in gradients, for all four NN/TN/NT/TT combinations
+    for (int variant = 0; variant < 4; ++variant) {
+        bool ta = variant & 1, tb = variant & 2;
+        Tensor a_t(ta ? 4 : 3, ta ? 3 : 4), b_t(tb ? 5 : 4, tb ? 4 : 5), w_t(3, 5);
+        for (int i = 0; i < a_t.numel(); ++i) a_t.data[i] = 0.1f * (i % 7) - 0.3f;
+        for (int i = 0; i < b_t.numel(); ++i) b_t.data[i] = 0.2f * (i % 5) - 0.4f;
+        for (int i = 0; i < w_t.numel(); ++i) w_t.data[i] = 0.05f * i;
+        auto w = make_ad(w_t);
+
+        auto a1 = make_ad(a_t), b1 = make_ad(b_t);
+        auto c1 = matmul(a1, b1, ta, tb);
+        sum(mul(c1, w))->backward();
+
+        auto a2 = make_ad(a_t), b2 = make_ad(b_t);
+        auto c2 = matmul(ta ? transpose(a2) : a2, tb ? transpose(b2) : b2);
+        sum(mul(c2, w))->backward();
+
+        assert(c1->val.rows == 3 && c1->val.cols == 5);
+        for (int i = 0; i < c1->val.numel(); ++i)
+            assert(fabs(c1->val.data[i] - c2->val.data[i]) < 1e-5f);
+        for (int i = 0; i < a_t.numel(); ++i)
+            assert(fabs(a1->grad.data[i] - a2->grad.data[i]) < 1e-5f);
+        for (int i = 0; i < b_t.numel(); ++i)
+            assert(fabs(b1->grad.data[i] - b2->grad.data[i]) < 1e-5f);
+    }
+
+    // tape: constants get no grad and record nothing, a completed backward
+    // releases the tape, and unreached records wait for clear_tape()
+    {
+        clear_tape();
+        Tensor t(2, 2), c_t(2, 2);
+        t.data = {1.0f, 2.0f, 3.0f, 4.0f};
+        c_t.fill(2.0f);
+        auto x = make_ad(t);
+        auto c = make_const(c_t);
+        auto cc = mul(c, c);
+        assert(!cc->requires_grad && tape_size() == 0);
+        auto y = mul(x, cc);
+        auto h = tanh_ad(y);
+        assert(tape_size() == 2 && h->grad.data.empty());
+        sum(y)->backward();
+        assert(tape_size() == 3);   // tanh record never reached
+        assert(c->grad.data.empty());
+        for (int i = 0; i < 4; ++i) assert(fabs(x->grad.data[i] - 4.0f) < 1e-6f);
+        clear_tape();
+        assert(tape_size() == 0);
+        // h survives as a leaf once its step is cleared
+        auto s = sum(h);
+        s->backward();
+        assert(tape_size() == 0 && h->grad.data.size() == 4);
+        assert(fabs(x->grad.data[0] - 4.0f) < 1e-6f);
+    }
+
+    // data-parallel shards: two threads with their own tapes and gradient
+    // shards, reduced, match one thread doing both halves
+    {
+        clear_parameters();
+        Tensor w_t(2, 3);
+        w_t.data = {0.5f, -1.0f, 2.0f, 0.25f, 1.5f, -0.5f};
+        auto w = make_ad(w_t);
+        register_parameter(w);
+        auto step = [&](float shift) {
+            Tensor x_t(3, 2);
+            for (int i = 0; i < 6; ++i) x_t.data[i] = 0.3f * i + shift;
+            sum(tanh_ad(matmul(w, make_const(x_t))))->backward();
+            clear_tape();
+        };
+        step(0.0f);
+        step(1.0f);
+        Tensor serial = w->grad;
+
+        w->grad.fill(0.0f);
+        allocate_grad_shards(2);
+        std::thread worker([&] {
+            GradShardScope shard(1);
+            step(1.0f);
+        });
+        step(0.0f);
+        worker.join();
+        for (float g : w->grad_shards[0].data) assert(g != 0.0f);
+        reduce_grad_shards();
+        for (int i = 0; i < 6; ++i) {
+            assert(fabs(w->grad.data[i] - serial.data[i]) < 1e-5f);
+            assert(w->grad_shards[0].data[i] == 0.0f);
+        }
+        allocate_grad_shards(1);
+        assert(w->grad_shards.empty());
+        clear_parameters();
+    }
+
+    // Leaves hold no gradient until backward reaches them; leaves it never
+    // reaches stay unallocated
+    {
+        Tensor t(2, 2);
+        t.fill(1.5f);
+        auto used = make_ad(t);
+        auto unused = make_ad(t);
+        assert(used->grad.data.empty() && unused->grad.data.empty());
+        sum(mul(used, used))->backward();
+        assert(used->grad.data.size() == 4);
+        for (float g : used->grad.data) assert(fabs(g - 3.0f) < 1e-6f);
+        assert(unused->grad.data.empty());
+        clear_tape();
+    }
+
     std::cout << "All Autodiff tests passed." << std::endl;
     return 0;
 }
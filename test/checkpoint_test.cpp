@@ -0,0 +1,409 @@
+#include "checkpoint.hpp"
+#include "autodiff.hpp"
+#include "layers/ad_conv2d.hpp"
+#include "layers/ad_linear.hpp"
+#include "layers/ad_transformer.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const std::string PATH = "checkpoint_test.ckpt";
+
+static bool has_name(const std::string& name) {
+    const auto& names = parameter_names();
+    return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+static std::shared_ptr<ADTensor> param(const std::string& name) {
+    const auto& names = parameter_names();
+    auto it = std::find(names.begin(), names.end(), name);
+    assert(it != names.end());
+    return get_parameters()[it - names.begin()];
+}
+
+static void fill_pattern(float offset) {
+    for (auto& p : get_parameters())
+        for (size_t i = 0; i < p->val.data.size(); ++i)
+            p->val.data[i] = offset + 0.001f * static_cast<float>(i % 997);
+}
+
+static bool matches_pattern(const Tensor& t, float offset) {
+    for (size_t i = 0; i < t.data.size(); ++i)
+        if (t.data[i] != offset + 0.001f * static_cast<float>(i % 997)) return false;
+    return true;
+}
+
+int main() {
+    // Scopes prefix names; repeats and unnamed parameters stay unique
+    {
+        clear_parameters();
+        {
+            ParameterScope outer("encoder");
+            ParameterScope inner("proj");
+            ADLinear a(3, 2);
+        }
+        ADLinear b(3, 2);
+        ADLinear c(3, 2);
+        register_parameter(make_ad(Tensor(1, 1)));
+        const auto& names = parameter_names();
+        assert(names.size() == get_parameters().size());
+        assert(has_name("encoder.proj.W") && has_name("encoder.proj.b"));
+        assert(has_name("W") && has_name("W.1") && has_name("b.1"));
+        assert(names.back() == "param6");
+
+        clear_parameters();
+        TransformerConfig cfg;
+        cfg.embed_dim = 8;
+        cfg.hidden_dim = 16;
+        cfg.n_heads = 2;
+        cfg.num_layers = 2;
+        cfg.use_moe = true;
+        cfg.num_experts = 2;
+        ADTransformer transformer(cfg);
+        assert(has_name("block0.W_q") && has_name("block1.W_o"));
+        assert(has_name("block0.norm1.gamma") && has_name("block1.norm2.beta"));
+        assert(has_name("block1.gate_W") && has_name("block1.expert1.W2"));
+        std::cout << "  [PASS] parameter names\n";
+    }
+
+    // Round trip of 2-D and 4-D tensors, copied or mapped
+    {
+        clear_parameters();
+        ADConv2D conv(3, 4, 3);
+        ADLinear lin(5, 7);
+        fill_pattern(1.0f);
+        ckpt::save_parameters(PATH);
+
+        ckpt::MappedFile file(PATH);
+        assert(file.entries().size() == 4);
+        const ckpt::Entry* w = file.find("weight");
+        assert(w && w->shape == std::vector<int>({4, 3, 3, 3}));
+        for (const auto& e : file.entries()) assert(e.offset % 64 == 0);
+
+        fill_pattern(-5.0f);
+        assert(ckpt::load_parameters(PATH, false) == 4);
+        for (auto& p : get_parameters()) assert(matches_pattern(p->val, 1.0f));
+
+        fill_pattern(-5.0f);
+        const float* heap = param("weight")->val.data.data();
+        assert(ckpt::load_parameters(PATH, true) == 4);
+        for (auto& p : get_parameters()) {
+            assert(matches_pattern(p->val, 1.0f));
+            // The tensor is the mapped data itself, 64-byte aligned
+            assert(reinterpret_cast<std::uintptr_t>(p->val.data.data()) % 64 == 0);
+        }
+        assert(param("weight")->val.data.data() != heap);
+        assert(param("weight")->val.shape == std::vector<int>({4, 3, 3, 3}));
+
+        // MappedFile::tensor views the same bytes without a copy
+        Tensor view = file.tensor(*w);
+        assert(view.data.data() == file.data(*w) && matches_pattern(view, 1.0f));
+        std::cout << "  [PASS] round trip\n";
+    }
+
+    // Mapped tensors outlive the file object and are copy-on-write
+    {
+        clear_parameters();
+        ADLinear lin(4, 4);
+        fill_pattern(2.0f);
+        ckpt::save_parameters(PATH);
+        ckpt::load_parameters(PATH, true);
+        auto W = param("W");
+        clear_parameters();
+        W->val.data[0] = 100.0f;       // private to this process
+        Tensor copy = W->val;          // copies own fresh memory
+        assert(copy.data.data() != W->val.data.data() && copy.data[0] == 100.0f);
+        ckpt::MappedFile file(PATH);
+        assert(file.data(*file.find("W"))[0] == 2.0f);
+        std::cout << "  [PASS] mapped tensor lifetime\n";
+    }
+
+    // Parameters are matched by name, not registration order
+    {
+        clear_parameters();
+        {
+            ParameterScope s("first");
+            ADLinear a(2, 3);
+        }
+        {
+            ParameterScope s("second");
+            ADLinear b(3, 2);
+        }
+        fill_pattern(0.0f);
+        param("second.W")->val.data[0] = 42.0f;
+        ckpt::save_parameters(PATH);
+
+        clear_parameters();
+        {
+            ParameterScope s("second");
+            ADLinear b(3, 2);
+        }
+        {
+            ParameterScope s("first");
+            ADLinear a(2, 3);
+        }
+        {
+            ParameterScope s("third");
+            ADLinear c(2, 2);
+        }
+        Tensor third_before = param("third.W")->val;
+        assert(ckpt::load_parameters(PATH, false) == 4);
+        assert(param("second.W")->val.data[0] == 42.0f);
+        // Missing from the checkpoint: left alone
+        assert(param("third.W")->val.data == third_before.data);
+        std::cout << "  [PASS] matched by name\n";
+    }
+
+    // Shape mismatches keep the current value; too many abort the load
+    {
+        clear_parameters();
+        {
+            ParameterScope s("a");
+            ADLinear l(2, 3);
+        }
+        fill_pattern(1.0f);
+        ckpt::save_parameters(PATH);
+        clear_parameters();
+        {
+            ParameterScope s("a");
+            ADLinear l(4, 3);
+        }
+        Tensor before = param("a.W")->val;
+        assert(ckpt::load_parameters(PATH, true) == 1);
+        assert(param("a.W")->val.data == before.data);
+        assert(matches_pattern(param("a.b")->val, 1.0f));
+
+        clear_parameters();
+        for (int i = 0; i < 4; ++i) register_parameter(make_ad(Tensor(2, 2)), "t" + std::to_string(i));
+        ckpt::save_parameters(PATH);
+        clear_parameters();
+        for (int i = 0; i < 4; ++i) register_parameter(make_ad(Tensor(3, 2)), "t" + std::to_string(i));
+        bool threw = false;
+        try {
+            ckpt::load_parameters(PATH, false);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw);
+        std::cout << "  [PASS] shape mismatch\n";
+    }
+
+    // Files in the older positional layout still load
+    {
+        clear_parameters();
+        ADLinear lin(2, 3);
+        {
+            std::ofstream out(PATH, std::ios::binary);
+            uint32_t num = 2;
+            out.write(reinterpret_cast<const char*>(&num), sizeof(num));
+            for (auto& p : get_parameters()) {
+                uint32_t r = p->val.rows, c = p->val.cols;
+                out.write(reinterpret_cast<const char*>(&r), sizeof(r));
+                out.write(reinterpret_cast<const char*>(&c), sizeof(c));
+                std::vector<float> v(r * c, 7.5f);
+                out.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(float));
+            }
+        }
+        assert(ckpt::load_parameters(PATH, true) == 2);
+        for (auto& p : get_parameters())
+            for (float v : p->val.data) assert(v == 7.5f);
+        std::cout << "  [PASS] legacy layout\n";
+    }
+
+    // A truncated file is rejected rather than read past its end
+    {
+        clear_parameters();
+        ADLinear lin(8, 8);
+        ckpt::save_parameters(PATH);
+        std::ifstream in(PATH, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        std::ofstream(PATH, std::ios::binary).write(bytes.data(), bytes.size() - 16);
+        bool threw = false;
+        try {
+            ckpt::MappedFile file(PATH);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw);
+        std::cout << "  [PASS] truncated file\n";
+    }
+
+    // A failed write leaves the previous checkpoint in place
+    {
+        clear_parameters();
+        ADLinear lin(3, 3);
+        fill_pattern(4.0f);
+        ckpt::save_parameters(PATH);
+        fill_pattern(9.0f);
+        std::string tmp = PATH + ".tmp";
+        ::mkdir(tmp.c_str(), 0755);  // the temporary file cannot be created
+        bool threw = false;
+        try {
+            ckpt::save_parameters(PATH);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        ::rmdir(tmp.c_str());
+        assert(threw);
+        ckpt::MappedFile file(PATH);
+        assert(file.data(*file.find("W"))[0] == 4.0f);
+        std::cout << "  [PASS] atomic replace\n";
+    }
+
+    // The background writer saves a snapshot taken when save() returns
+    {
+        clear_parameters();
+        ADLinear lin(16, 16);
+        ckpt::AsyncWriter writer;
+        for (int i = 0; i < 5; ++i) {
+            fill_pattern(static_cast<float>(i));
+            writer.save_parameters(PATH);
+        }
+        fill_pattern(100.0f);  // after the last save: not in the file
+        writer.wait();
+        assert(writer.written() >= 1 && writer.written() + writer.skipped() == 5);
+        assert(ckpt::load_parameters(PATH, false) == 2);
+        for (auto& p : get_parameters()) assert(matches_pattern(p->val, 4.0f));
+        std::ifstream tmp(PATH + ".tmp");
+        assert(!tmp);
+
+        // A failing write surfaces from wait()
+        writer.save_parameters("no_such_dir/checkpoint.ckpt");
+        bool threw = false;
+        try {
+            writer.wait();
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw);
+        writer.save_parameters(PATH);
+        writer.wait();
+        std::cout << "  [PASS] async writer\n";
+    }
+
+    // Metadata round trip; version 1 files, which have none, still read
+    {
+        Tensor t(2, 2);
+        t.fill(3.0f);
+        ckpt::write(PATH, {"t"}, {&t}, {{"a", "1"}, {"empty", ""}});
+        ckpt::MappedFile file(PATH);
+        assert(file.metadata().size() == 2 && file.metadata().at("a") == "1");
+        assert(file.metadata().at("empty").empty());
+        assert(file.data(*file.find("t"))[3] == 3.0f);
+
+        {
+            std::ofstream out(PATH, std::ios::binary);
+            auto put = [&](auto v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+            out.write("DSCK", 4);
+            put(uint32_t(1));
+            put(uint32_t(1));  // tensors
+            put(uint32_t(1));
+            out.write("x", 1);
+            put(uint32_t(0));
+            put(uint32_t(1));
+            put(int64_t(2));
+            put(uint64_t(64));
+            put(uint64_t(8));
+            std::string pad(64 - static_cast<size_t>(out.tellp()), '\0');
+            out.write(pad.data(), pad.size());
+            put(1.5f);
+            put(2.5f);
+        }
+        ckpt::MappedFile v1(PATH);
+        assert(v1.metadata().empty() && v1.entries().size() == 1);
+        assert(v1.data(*v1.find("x"))[1] == 2.5f);
+        std::cout << "  [PASS] metadata\n";
+    }
+
+    // Training resumed from a checkpoint takes exactly the steps it would
+    // have taken uninterrupted
+    {
+        clear_parameters();
+        ADLinear lin(6, 5);
+        fill_pattern(0.5f);
+        auto set_grads = [](int step) {
+            for (auto& p : get_parameters()) {
+                Tensor& g = p->ensure_grad();
+                for (size_t i = 0; i < g.data.size(); ++i)
+                    g.data[i] = 0.01f * static_cast<float>((i * 7 + step * 3) % 11) - 0.05f;
+            }
+        };
+        AdamW opt(0.01f);
+        for (int s = 0; s < 3; ++s) {
+            set_grads(s);
+            opt.step();
+        }
+        ckpt::TrainingState state;
+        state.epoch = 2;
+        state.batches_done = 7;
+        state.global_step = 3;
+        state.scheduler_step = 3;
+        state.rng.discard(5);
+        state.loss_sum = 1.0f / 3.0f;
+        state.loss_count = 14;
+        state.best_val_loss = 2.25f;
+        state.no_improve = 1;
+        {
+            ckpt::AsyncWriter writer;
+            ckpt::save_training(writer, PATH, opt, state);
+        }
+        for (int s = 3; s < 5; ++s) {
+            set_grads(s);
+            opt.step();
+        }
+        std::vector<Tensor> expected;
+        for (auto& p : get_parameters()) expected.push_back(p->val);
+
+        // The parameters load as usual; the optimizer state is extra
+        fill_pattern(-1.0f);
+        assert(ckpt::load_parameters(PATH, false) == 2);
+        AdamW resumed(0.01f);
+        ckpt::TrainingState loaded;
+        assert(ckpt::load_training(PATH, resumed, loaded));
+        assert(resumed.step_count() == 3 && resumed.first_moments().size() == 2);
+        assert(loaded.epoch == 2 && loaded.batches_done == 7 && loaded.global_step == 3);
+        assert(loaded.scheduler_step == 3 && loaded.rng == state.rng);
+        assert(loaded.loss_sum == state.loss_sum && loaded.loss_count == 14);
+        assert(loaded.best_val_loss == 2.25f && loaded.no_improve == 1);
+        // An early-stopped run stays stopped on resume, unless validation is
+        // off or more patience is given
+        assert(!loaded.finished(5, 2, true));
+        assert(loaded.finished(5, 1, true) && !loaded.finished(5, 1, false));
+        assert(loaded.finished(1, 2, true));
+        for (int s = 3; s < 5; ++s) {
+            set_grads(s);
+            resumed.step();
+        }
+        for (size_t i = 0; i < expected.size(); ++i)
+            assert(get_parameters()[i]->val.data == expected[i].data);
+
+        // Before any step there are no moments; a weights-only file has no
+        // training state at all
+        {
+            ckpt::AsyncWriter writer;
+            ckpt::save_training(writer, PATH, AdamW(0.01f), ckpt::TrainingState());
+        }
+        AdamW fresh(0.01f);
+        assert(ckpt::load_training(PATH, fresh, loaded) && fresh.step_count() == 0);
+        assert(loaded.best_val_loss == std::numeric_limits<float>::infinity());
+        ckpt::save_parameters(PATH);
+        loaded.epoch = 9;
+        assert(!ckpt::load_training(PATH, fresh, loaded) && loaded.epoch == 9);
+        std::cout << "  [PASS] training state\n";
+    }
+
+    std::remove(PATH.c_str());
+    clear_parameters();
+    std::cout << "All checkpoint tests passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "gemm.hpp"
+#include "tensor.hpp"
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Naive reference: C = alpha * op(A) * op(B) + beta * C (row-major, explicit lds)
+static void ref_gemm(bool ta, bool tb, int M, int N, int K, float alpha,
+                     const std::vector<float>& A, int lda,
+                     const std::vector<float>& B, int ldb,
+                     float beta, std::vector<float>& C, int ldc) {
+    for (int i = 0; i < M; ++i) {
+        for (int j = 0; j < N; ++j) {
+            double s = 0.0;
+            for (int p = 0; p < K; ++p) {
+                float a = ta ? A[p * lda + i] : A[i * lda + p];
+                float b = tb ? B[j * ldb + p] : B[p * ldb + j];
+                s += (double)a * b;
+            }
+            C[i * ldc + j] = (float)(alpha * s + beta * C[i * ldc + j]);
+        }
+    }
+}
+
+static void check_case(bool ta, bool tb, int M, int N, int K, float alpha, float beta,
+                       int pad, std::mt19937& gen) {
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    // Stored shapes: A is [M x K] or [K x M], B is [K x N] or [N x K]
+    int a_rows = ta ? K : M, a_cols = ta ? M : K;
+    int b_rows = tb ? N : K, b_cols = tb ? K : N;
+    int lda = a_cols + pad, ldb = b_cols + pad, ldc = N + pad;
+    std::vector<float> A(a_rows * lda), B(b_rows * ldb), C(M * ldc);
+    for (auto& v : A) v = dist(gen);
+    for (auto& v : B) v = dist(gen);
+    for (auto& v : C) v = dist(gen);
+    std::vector<float> expected = C;
+    ref_gemm(ta, tb, M, N, K, alpha, A, lda, B, ldb, beta, expected, ldc);
+    gemm::sgemm(ta, tb, M, N, K, alpha, A.data(), lda, B.data(), ldb, beta, C.data(), ldc);
+    float tol = 1e-4f * std::sqrt((float)K + 1.0f) * 4.0f;
+    for (int i = 0; i < M; ++i) {
+        for (int j = 0; j < ldc; ++j) {
+            float got = C[i * ldc + j], want = expected[i * ldc + j];
+            assert(std::isfinite(got));
+            assert(std::fabs(got - want) <= tol * (1.0f + std::fabs(want)));
+        }
+    }
+}
+
+int main() {
+    std::mt19937 gen(42);
+    const int shapes[][3] = {
+        {1, 1, 1}, {2, 3, 4}, {7, 5, 3}, {8, 32, 16}, {9, 33, 17},
+        {6, 16, 300}, {64, 32, 64}, {65, 129, 257}, {150, 70, 40},
+        {1, 200, 50}, {200, 1, 50}, {33, 3100, 8}};
+
+    std::vector<std::string> kernels;
+    for (const char* name : {"avx512", "avx2", "generic"}) {
+        if (gemm::set_kernel(name)) kernels.push_back(name);
+    }
+    assert(!kernels.empty());
+    assert(!gemm::set_kernel("no_such_kernel"));
+
+    for (int threads : {1, 4}) {
+        gemm::set_num_threads(threads);
+        assert(gemm::num_threads() == threads);
+        for (auto& name : kernels) {
+            assert(gemm::set_kernel(name));
+            for (int variant = 0; variant < 4; ++variant) {
+                bool ta = variant & 1, tb = variant & 2;
+                for (auto& s : shapes) {
+                    check_case(ta, tb, s[0], s[1], s[2], 1.0f, 0.0f, 0, gen);
+                    check_case(ta, tb, s[0], s[1], s[2], 0.5f, 1.0f, 3, gen);
+                    check_case(ta, tb, s[0], s[1], s[2], -2.0f, 0.25f, 1, gen);
+                }
+            }
+        }
+    }
+
+    // K == 0 only scales C
+    {
+        std::vector<float> C = {1.0f, 2.0f, 3.0f, 4.0f};
+        gemm::sgemm(false, false, 2, 2, 0, 1.0f, nullptr, 1, nullptr, 2, 0.5f, C.data(), 2);
+        assert(C[0] == 0.5f && C[3] == 2.0f);
+    }
+
+    // Tensor::matmul goes through the engine and keeps exact integer results
+    {
+        Tensor a(37, 41), b(41, 19);
+        for (int i = 0; i < a.numel(); ++i) a.data[i] = (float)(i % 5) - 2.0f;
+        for (int i = 0; i < b.numel(); ++i) b.data[i] = (float)(i % 3) - 1.0f;
+        Tensor c = a.matmul(b);
+        for (int i = 0; i < 37; ++i) {
+            for (int j = 0; j < 19; ++j) {
+                float s = 0.0f;
+                for (int p = 0; p < 41; ++p) s += a(i, p) * b(p, j);
+                assert(c(i, j) == s);
+            }
+        }
+    }
+
+    std::cout << "GEMM kernels tested:";
+    for (auto& name : kernels) std::cout << " " << name;
+    std::cout << "\nAll GEMM tests passed." << std::endl;
+    return 0;
+}
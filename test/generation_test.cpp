@@ -0,0 +1,215 @@
+#include "generation.hpp"
+#include "test_model.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+static const int V = 20, D = 8, L = 2, H = 2, MAX_LEN = 32;
+
+static TransformerConfig make_cfg(int embed_dim, int hidden_dim, int n_heads, int num_layers) {
+    return make_test_cfg(embed_dim, hidden_dim, n_heads, num_layers, MAX_LEN);
+}
+
+// A randomly initialized training graph and the InferenceModel bound to its
+// parameters. Leaves the parameter registry empty for the next model.
+struct TestModel : TrainedModel {
+    std::unique_ptr<InferenceModel> model;
+
+    TestModel(const TransformerConfig& cfg, unsigned seed, float scale) : TrainedModel(cfg, V) {
+        // Large tied embeddings give peaked, well-separated scores
+        std::mt19937 wg(seed);
+        std::uniform_real_distribution<float> dist(-scale, scale);
+        for (auto& w : embed.get_weights()->val.data) w = dist(wg);
+        for (auto& w : b_lm->val.data) w = 0.1f * dist(wg);
+        model.reset(new InferenceModel(cfg, get_parameters()));
+        clear_parameters();
+    }
+};
+
+// Greedy decoding that re-runs the whole context every step, no cache
+static std::vector<int> reference_greedy(TestModel& m, std::vector<int> tokens, int n_new,
+                                         int eos) {
+    for (int step = 0; step < n_new; ++step) {
+        std::vector<float> logits = m.next_logits(tokens);
+        int best = std::max_element(logits.begin(), logits.end()) - logits.begin();
+        tokens.push_back(best);
+        if (best == eos) break;
+    }
+    return tokens;
+}
+
+// Beam search that re-runs every beam's full context each step
+static std::vector<int> reference_beam(TestModel& m, const std::vector<int>& prompt,
+                                       int width, int n_new, int eos) {
+    struct Beam {
+        std::vector<int> tokens;
+        float score;
+    };
+    std::vector<Beam> beams = {{prompt, 0.0f}};
+    for (int step = 0; step < n_new; ++step) {
+        std::vector<Beam> candidates;
+        for (auto& beam : beams) {
+            if (eos >= 0 && beam.tokens.back() == eos && beam.tokens.size() > prompt.size()) {
+                candidates.push_back(beam);
+                continue;
+            }
+            std::vector<float> logits = m.next_logits(beam.tokens);
+            float max_l = *std::max_element(logits.begin(), logits.end());
+            float sum_exp = 0.0f;
+            for (int i = 0; i < V; ++i) sum_exp += std::exp(logits[i] - max_l);
+            float log_sum = max_l + std::log(sum_exp);
+            std::vector<int> idxs(V);
+            std::iota(idxs.begin(), idxs.end(), 0);
+            std::partial_sort(idxs.begin(), idxs.begin() + width, idxs.end(),
+                              [&](int a, int b) { return logits[a] > logits[b]; });
+            for (int k = 0; k < width; ++k) {
+                Beam nb{beam.tokens, beam.score + logits[idxs[k]] - log_sum};
+                nb.tokens.push_back(idxs[k]);
+                candidates.push_back(nb);
+            }
+        }
+        std::partial_sort(candidates.begin(),
+                          candidates.begin() + std::min(width, (int)candidates.size()),
+                          candidates.end(),
+                          [](const Beam& a, const Beam& b) { return a.score > b.score; });
+        if ((int)candidates.size() > width) candidates.resize(width);
+        beams = std::move(candidates);
+    }
+    return beams[0].tokens;
+}
+
+static void test_sampling() {
+    std::mt19937 rng(1);
+    std::vector<float> logits = {0.1f, 2.0f, -1.0f, 0.5f};
+    assert(sample_next_token(logits, 0, 0.0f, 1.0f, rng) == 1);
+    assert(sample_next_token(logits, 1, 0.0f, 1.0f, rng) == 1);
+    for (int i = 0; i < 50; ++i) {
+        int t = sample_next_token(logits, 2, 0.0f, 1.0f, rng);
+        assert(t == 1 || t == 3);
+    }
+}
+
+// Requests of different lengths, some arriving mid-run, decode exactly as
+// they would alone
+static void test_continuous_batching() {
+    TestModel target(make_cfg(D, 16, H, L), 7, 1.0f);
+    const InferenceModel& model = *target.model;
+
+    std::vector<std::vector<int>> prompts = {
+        {1, 2, 3}, {4}, {5, 6, 7, 8, 9, 10, 11}, {12, 13}, {3, 3, 3, 3}};
+    GenerateConfig cfg{6, 0, 0, 0.0f, 1.0f, -1, 0};
+    std::vector<std::vector<int>> expected;
+    for (auto& p : prompts) expected.push_back(reference_greedy(target, p, 6, -1));
+
+    // Small blocks and batch so sequences queue and span several blocks
+    BatchScheduler sched(model, 2, 4);
+    std::vector<int> ids;
+    ids.push_back(sched.submit(prompts[0], cfg, 0));
+    ids.push_back(sched.submit(prompts[1], cfg, 0));
+    ids.push_back(sched.submit(prompts[2], cfg, 0));
+    assert(sched.step());
+    assert(sched.running() == 2);
+    assert(sched.step());
+    ids.push_back(sched.submit(prompts[3], cfg, 0));
+    ids.push_back(sched.submit(prompts[4], cfg, 0));
+    sched.run();
+    assert(sched.running() == 0);
+    for (size_t i = 0; i < prompts.size(); ++i) {
+        assert(sched.finished(ids[i]));
+        assert(sched.result(ids[i]) == expected[i]);
+    }
+
+    // EOS ends a request early; the pool is reusable afterwards
+    int eos = expected[2][prompts[2].size() + 1];
+    auto with_eos = reference_greedy(target, prompts[2], 6, eos);
+    GenerateConfig stop = cfg;
+    stop.eos_id = eos;
+    int id = sched.submit(prompts[2], stop, 0);
+    sched.run();
+    assert(sched.result(id) == with_eos);
+    assert(with_eos.size() < expected[2].size());
+
+    // Generation stops at max_len
+    GenerateConfig longer = cfg;
+    longer.max_new_tokens = 100;
+    id = sched.submit(prompts[2], longer, 0);
+    sched.run();
+    assert((int)sched.result(id).size() == MAX_LEN + 1);
+}
+
+// Cached, batched beam search picks the same hypothesis as recomputing
+// every beam from scratch
+static void test_beam_search() {
+    TestModel target(make_cfg(D, 16, H, L), 11, 2.0f);
+    const InferenceModel& model = *target.model;
+
+    std::vector<int> prompt = {2, 7, 1, 8, 2};
+    for (int width : {1, 3}) {
+        GenerateConfig cfg{9, 0, 0, 0.0f, 1.0f, -1, width};
+        auto expected = reference_beam(target, prompt, width, 9, -1);
+        // Block size 2 makes beams share and copy partial blocks constantly
+        assert(beam_search(model, prompt, cfg, 2) == expected);
+        assert(beam_search(model, prompt, cfg) == expected);
+        // An end token stops the beams that produce it
+        int eos = expected[prompt.size() + 2];
+        cfg.eos_id = eos;
+        assert(beam_search(model, prompt, cfg, 2) == reference_beam(target, prompt, width, 9, eos));
+    }
+}
+
+// Greedy speculative decoding reproduces the target's greedy output whatever
+// the draft proposes; sampled decoding follows the target's distribution
+static void test_speculative() {
+    TestModel big(make_cfg(D, 16, H, L), 5, 2.0f);
+    const InferenceModel& target = *big.model;
+    // A smaller, unrelated draft
+    TestModel small(make_cfg(4, 8, 1, 1), 6, 2.0f);
+    const InferenceModel& draft = *small.model;
+
+    std::vector<int> prompt = {3, 1, 4, 1, 5};
+    GenerateConfig cfg{12, 0, 0, 0.0f, 1.0f, -1, 0};
+    auto expected = reference_greedy(big, prompt, 12, -1);
+    std::mt19937 rng(0);
+    for (int k : {1, 3, 6}) {
+        SpeculativeStats stats;
+        assert(speculative_generate(target, draft, prompt, cfg, k, rng, &stats, 2) == expected);
+        assert(stats.accepted <= stats.proposed && stats.rounds > 0);
+        // The target as its own draft never has a proposal rejected
+        SpeculativeStats self;
+        assert(speculative_generate(target, target, prompt, cfg, k, rng, &self) == expected);
+        assert(self.accepted == self.proposed);
+    }
+    // Stops at an end token and at max_len
+    GenerateConfig stop = cfg;
+    stop.eos_id = expected[prompt.size() + 3];
+    assert(speculative_generate(target, draft, prompt, stop, 4, rng) ==
+           reference_greedy(big, prompt, 12, stop.eos_id));
+    GenerateConfig longer = cfg;
+    longer.max_new_tokens = 100;
+    assert((int)speculative_generate(target, draft, prompt, longer, 4, rng).size() == MAX_LEN + 1);
+
+    // Top-k sampling: the first generated token's frequencies match the
+    // target's own distribution
+    GenerateConfig sampled{2, 0, 4, 0.0f, 1.0f, -1, 0};
+    std::vector<float> logits = big.next_logits(prompt);
+    std::vector<float> p = token_distribution(logits, 4, 0.0f, 1.0f);
+    const int N = 4000;
+    std::vector<int> counts(V, 0);
+    for (int n = 0; n < N; ++n)
+        ++counts[speculative_generate(target, draft, prompt, sampled, 2, rng)[prompt.size()]];
+    for (int i = 0; i < V; ++i) assert(std::fabs(counts[i] / float(N) - p[i]) < 0.03f);
+}
+
+int main() {
+    test_sampling();
+    test_continuous_batching();
+    test_beam_search();
+    test_speculative();
+    std::cout << "generation tests passed\n";
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include "inference_model.hpp"
+#include "test_model.hpp"
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+static const int V = 24, MAX_LEN = 32;
+
+// Moves every norm and bias off its initial value so a wrong binding shows up
+static void perturb_parameters() {
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> dist(-0.2f, 0.2f);
+    for (auto& p : get_parameters())
+        for (auto& v : p->val.data) v += dist(gen);
+}
+
+static Tensor run(const InferenceModel& m, const std::vector<int>& ids, int pos0,
+                  PagedKVCache& cache) {
+    std::vector<int> positions(ids.size());
+    std::iota(positions.begin(), positions.end(), pos0);
+    return m.logits(m.forward(m.embed(ids, positions), cache));
+}
+
+static void check_variant(const char* name, const TransformerConfig& cfg) {
+    clear_parameters();
+    TrainedModel trained(cfg, V);
+    perturb_parameters();
+    InferenceModel model(cfg, get_parameters());
+    assert(model.num_layers() == cfg.num_layers && model.vocab_size() == V);
+    assert(model.max_length() == MAX_LEN);
+
+    std::vector<int> ids = {3, 17, 0, 9, 9, 21, 5, 12, 1, 7, 23};
+    int T = (int)ids.size();
+    Tensor ref = trained.logits(ids);
+    KVBlockPool pool(model.num_layers(), model.kv_dim(), 4, 16);
+
+    // Whole sequence in one cached pass
+    {
+        PagedKVCache cache(pool);
+        Tensor out = run(model, ids, 0, cache);
+        for (int i = 0; i < V; ++i)
+            for (int t = 0; t < T; ++t) assert(std::fabs(out(i, t) - ref(i, t)) < 1e-3f);
+    }
+    // Prefill, then one token at a time
+    {
+        PagedKVCache cache(pool);
+        run(model, std::vector<int>(ids.begin(), ids.begin() + 5), 0, cache);
+        for (int t = 5; t < T; ++t) {
+            Tensor out = run(model, {ids[t]}, t, cache);
+            for (int i = 0; i < V; ++i) assert(std::fabs(out.data[i] - ref(i, t)) < 1e-3f);
+        }
+    }
+    // Two sequences at different offsets in one batched call
+    {
+        std::vector<int> other = {4, 4, 8, 15, 16, 23, 2};
+        Tensor ref_other = trained.logits(other);
+        PagedKVCache a(pool), b(pool);
+        run(model, std::vector<int>(ids.begin(), ids.begin() + 6), 0, a);
+        run(model, {other[0], other[1]}, 0, b);
+        std::vector<int> batch_ids = {ids[6], ids[7], other[2]};
+        Tensor x = model.embed(batch_ids, {6, 7, 2});
+        Tensor out = model.logits(model.forward(x, {&a, &b}, {2, 1}));
+        for (int i = 0; i < V; ++i) {
+            assert(std::fabs(out(i, 0) - ref(i, 6)) < 1e-3f);
+            assert(std::fabs(out(i, 1) - ref(i, 7)) < 1e-3f);
+            assert(std::fabs(out(i, 2) - ref_other(i, 2)) < 1e-3f);
+        }
+    }
+    std::cout << "  [PASS] " << name << "\n";
+}
+
+static TransformerConfig base_cfg() {
+    return make_test_cfg(16, 24, 4, 2, MAX_LEN);
+}
+
+int main() {
+    TransformerConfig cfg = base_cfg();
+    check_variant("LayerNorm + GELU + ALiBi", cfg);
+
+    cfg = base_cfg();
+    cfg.use_rmsnorm = true;
+    cfg.use_swiglu = true;
+    check_variant("RMSNorm + SwiGLU", cfg);
+
+    cfg = base_cfg();
+    cfg.use_rope = true;
+    check_variant("RoPE", cfg);
+
+    cfg = base_cfg();
+    cfg.n_kv_heads = 2;
+    check_variant("grouped-query attention", cfg);
+
+    cfg = base_cfg();
+    cfg.use_moe = true;
+    cfg.num_experts = 4;
+    cfg.moe_top_k = 2;
+    check_variant("MoE", cfg);
+
+    cfg = base_cfg();
+    cfg.use_rmsnorm = true;
+    cfg.use_swiglu = true;
+    cfg.use_rope = true;
+    cfg.n_kv_heads = 1;
+    check_variant("RMSNorm + SwiGLU + RoPE + multi-query attention", cfg);
+
+    // GQA caches only the shared KV heads
+    {
+        clear_parameters();
+        cfg = base_cfg();
+        cfg.n_kv_heads = 2;
+        TrainedModel trained(cfg, V);
+        perturb_parameters();
+        InferenceModel model(cfg, get_parameters());
+        assert(model.kv_dim() == cfg.embed_dim / 2);
+    }
+
+    // Binding reads the trained tensors in place: later updates show up
+    {
+        clear_parameters();
+        cfg = base_cfg();
+        TrainedModel trained(cfg, V);
+        perturb_parameters();
+        InferenceModel model(cfg, get_parameters());
+        trained.b_lm->val.data[5] += 100.0f;
+        Tensor h(cfg.embed_dim, 1);
+        h.fill(0.0f);
+        assert(std::fabs(model.logits(h).data[5] - trained.b_lm->val.data[5]) < 1e-5f);
+    }
+
+    // Binding and decoding never allocate gradients: the weights are the
+    // only copy of the model in memory
+    {
+        clear_parameters();
+        cfg = base_cfg();
+        TrainedModel trained(cfg, V);
+        perturb_parameters();
+        InferenceModel model(cfg, get_parameters());
+        KVBlockPool pool(model.num_layers(), model.kv_dim(), 4, 4);
+        PagedKVCache cache(pool);
+        run(model, {1, 2, 3}, 0, cache);
+        for (auto& p : get_parameters()) assert(p->grad.data.empty());
+    }
+
+    // A config that does not match the checkpoint is rejected
+    {
+        clear_parameters();
+        cfg = base_cfg();
+        TrainedModel trained(cfg, V);
+        perturb_parameters();
+        TransformerConfig wrong = cfg;
+        wrong.use_swiglu = true;
+        bool threw = false;
+        try {
+            InferenceModel model(wrong, get_parameters());
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+    std::cout << "All InferenceModel tests passed." << std::endl;
+    return 0;
+}
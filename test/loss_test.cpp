@@ -1,4 +1,5 @@
 #include "loss.hpp"
+#include "autodiff.hpp"
 #include <vector>
 #include <cassert>
 #include <cmath>
@@ -72,6 +73,28 @@ int main() {
         assert(almost_eq(gsum, 0.0f, 1e-4f));
     }
 
+    // cross_entropy_ad: per-column sum matching softmax_cross_entropy, with
+    // softmax - onehot gradients; out-of-range targets skip their column
+    {
+        int V = 6, T = 4;
+        Tensor logits_t(V, T);
+        for (int i = 0; i < V * T; ++i) logits_t.data[i] = std::sin(0.37f * i) * 4.0f;
+        std::vector<int> targets = {2, 5, -1, 0};
+        auto logits = make_ad(logits_t);
+        auto loss = cross_entropy_ad(logits, targets);
+        loss->backward();
+        float expected = 0.0f;
+        for (int t = 0; t < T; ++t) {
+            std::vector<float> col(V), grad;
+            for (int v = 0; v < V; ++v) col[v] = logits_t(v, t);
+            expected += softmax_cross_entropy(col, targets[t], grad);
+            for (int v = 0; v < V; ++v)
+                assert(almost_eq(logits->grad(v, t), grad[v], 1e-5f));
+        }
+        assert(almost_eq(loss->val.data[0], expected, 1e-4f));
+        clear_tape();
+    }
+
     std::cout << "All loss tests passed." << std::endl;
     return 0;
 }
@@ -76,6 +76,28 @@ void test_rope_pos_offset() {
     std::cout << "  [PASS] RoPE position offset\n";
 }
 
+void test_rope_rotate_heads() {
+    // rotate treats each head like apply at the column's own position, and
+    // inverse undoes it
+    RoPE rope(4, 64);
+    Tensor x(8, 3);
+    for (int i = 0; i < x.numel(); ++i) x.data[i] = std::sin(0.7f * i);
+    std::vector<int> positions = {9, 0, 33};
+    Tensor y = x;
+    rope.rotate(y.data.data(), 8, 3, positions.data());
+    for (int h = 0; h < 2; ++h) {
+        for (int c = 0; c < 3; ++c) {
+            Tensor xh(4, 1);
+            for (int d = 0; d < 4; ++d) xh.data[d] = x(h * 4 + d, c);
+            Tensor ref = rope.apply(xh, positions[c]);
+            for (int d = 0; d < 4; ++d) assert(std::abs(y(h * 4 + d, c) - ref.data[d]) < 1e-5f);
+        }
+    }
+    rope.rotate(y.data.data(), 8, 3, positions.data(), true);
+    for (int i = 0; i < x.numel(); ++i) assert(std::abs(y.data[i] - x.data[i]) < 1e-5f);
+    std::cout << "  [PASS] RoPE multi-head rotate\n";
+}
+
 // ========================== SwiGLU Tests ==========================
 
 void test_swiglu_basic() {
@@ -169,6 +191,43 @@ void test_rmsnorm_gradient() {
     std::cout << "  [PASS] RMSNorm gradient flow\n";
 }
 
+void test_rmsnorm_finite_difference() {
+    clear_parameters();
+    ADRMSNorm rn(4);
+    auto gamma = get_parameters()[0];
+    gamma->val.data = {0.5f, 1.0f, 1.5f, -0.5f};
+    Tensor x_t(4, 3), w_t(4, 3);
+    for (int i = 0; i < 12; ++i) {
+        x_t.data[i] = std::sin(0.9f * i) + 0.2f;
+        w_t.data[i] = std::cos(1.1f * i);
+    }
+    auto w = make_const(w_t);
+    auto x = make_ad(x_t);
+    sum(mul(rn.forward(x), w))->backward();
+    clear_tape();
+    auto loss = [&](const Tensor& xv) {
+        return sum(mul(rn.forward(make_const(xv)), w))->val.data[0];
+    };
+    const float h = 1e-2f;
+    for (int i = 0; i < 12; ++i) {
+        Tensor xp = x_t, xm = x_t;
+        xp.data[i] += h;
+        xm.data[i] -= h;
+        float num = (loss(xp) - loss(xm)) / (2 * h);
+        assert(std::abs(x->grad.data[i] - num) < 2e-2f);
+    }
+    for (int i = 0; i < 4; ++i) {
+        float g0 = gamma->val.data[i];
+        gamma->val.data[i] = g0 + h;
+        float lp = loss(x_t);
+        gamma->val.data[i] = g0 - h;
+        float lm = loss(x_t);
+        gamma->val.data[i] = g0;
+        assert(std::abs(gamma->grad.data[i] - (lp - lm) / (2 * h)) < 2e-2f);
+    }
+    std::cout << "  [PASS] RMSNorm gradients match finite differences\n";
+}
+
 // ========================== LR Scheduler Tests ==========================
 
 void test_lr_scheduler_warmup() {
@@ -228,6 +287,7 @@ int main() {
     test_rope_identity_at_zero();
     test_rope_ad_gradient();
     test_rope_pos_offset();
+    test_rope_rotate_heads();
 
     std::cout << "\n=== SwiGLU Tests ===\n";
     test_swiglu_basic();
@@ -238,6 +298,7 @@ int main() {
     test_rmsnorm_basic();
     test_rmsnorm_unit_rms();
     test_rmsnorm_gradient();
+    test_rmsnorm_finite_difference();
 
     std::cout << "\n=== LR Scheduler Tests ===\n";
     test_lr_scheduler_warmup();
@@ -2,6 +2,8 @@
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 int main() {
     // constructor and dimensions
@@ -100,6 +102,36 @@ int main() {
         assert(t.rows == 1 && t.cols == 1 && t(0,0) == 42.0f);
     }
 
+    // Tensor over external storage: no copy while it is only read or written
+    // in place; copies and anything that grows it own fresh memory
+    {
+        auto buf = std::make_shared<std::vector<float>>(std::vector<float>{1, 2, 3, 4, 5, 6});
+        std::weak_ptr<std::vector<float>> alive = buf;
+        Tensor v = Tensor::adopt(buf->data(), {2, 3}, buf);
+        buf.reset();
+        assert(v.rows == 2 && v.cols == 3 && v.data.is_view());
+        assert(v(1, 2) == 6.0f);
+        v(0, 0) = 10.0f;
+        assert((*alive.lock())[0] == 10.0f);
+
+        Tensor copy = v;
+        assert(!copy.data.is_view() && copy.data == v.data);
+        assert(copy.data.data() != v.data.data());
+
+        Tensor moved = std::move(v);
+        assert(moved.data.is_view() && !alive.expired());
+        moved.data.resize(8);
+        assert(!moved.data.is_view() && alive.expired());
+        assert(moved.data[0] == 10.0f && moved.data[5] == 6.0f && moved.data[7] == 0.0f);
+    }
+
+    // Owned storage is value-initialized when it grows
+    {
+        Tensor t(1, 2);
+        t.data.resize(5);
+        for (float x : t.data) assert(x == 0.0f);
+    }
+
     std::cout << "All Tensor tests passed." << std::endl;
     return 0;
 }
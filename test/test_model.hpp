@@ -0,0 +1,56 @@
+#pragma once
+#include "autodiff.hpp"
+#include "layers/ad_embedding.hpp"
+#include "layers/ad_positional_encoding.hpp"
+#include "layers/ad_transformer.hpp"
+#include <memory>
+#include <vector>
+
+// Shared by the inference and generation tests: the training graph an
+// InferenceModel binds to, and the full-sequence forward both suites use as
+// their reference.
+
+inline TransformerConfig make_test_cfg(int embed_dim, int hidden_dim, int n_heads,
+                                       int num_layers, int max_len) {
+    TransformerConfig cfg;
+    cfg.embed_dim = embed_dim;
+    cfg.hidden_dim = hidden_dim;
+    cfg.n_heads = n_heads;
+    cfg.num_layers = num_layers;
+    cfg.max_len = max_len;
+    return cfg;
+}
+
+// Registers its parameters in the same order as main: embedding, positions,
+// blocks, LM bias
+struct TrainedModel {
+    int vocab;
+    ADEmbedding embed;
+    ADPositionalEncoding posenc;
+    ADTransformer transformer;
+    std::shared_ptr<ADTensor> b_lm;
+
+    TrainedModel(const TransformerConfig& cfg, int vocab_size)
+        : vocab(vocab_size), embed(vocab_size, cfg.embed_dim),
+          posenc(cfg.embed_dim, cfg.max_len), transformer(cfg) {
+        b_lm = make_ad(Tensor(vocab_size, 1));
+        register_parameter(b_lm);
+    }
+
+    // Full-sequence training forward: logits [vocab x T]
+    Tensor logits(const std::vector<int>& ids) {
+        NoGradGuard no_grad;
+        auto x = add(embed.forward(ids), posenc.forward((int)ids.size()));
+        auto h = transformer.forward(x);
+        return add_bias_broadcast(matmul(embed.get_weights(), h, true, false), b_lm)->val;
+    }
+
+    // Logits for the token after ids
+    std::vector<float> next_logits(const std::vector<int>& ids) {
+        Tensor all = logits(ids);
+        int T = (int)ids.size();
+        std::vector<float> last(vocab);
+        for (int i = 0; i < vocab; ++i) last[i] = all(i, T - 1);
+        return last;
+    }
+};
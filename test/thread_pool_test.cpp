@@ -0,0 +1,127 @@
+#include "thread_pool.hpp"
+#include "autodiff.hpp"
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+// Every index is visited exactly once, whatever the chunking
+static void test_parallel_for_coverage() {
+    for (int grain : {1, 3, 64, 1000}) {
+        std::vector<std::atomic<int>> hits(257);
+        for (auto& h : hits) h.store(0);
+        parallel::parallel_for(0, 257, grain, [&](int lo, int hi) {
+            assert(lo < hi);
+            for (int i = lo; i < hi; ++i) hits[i].fetch_add(1);
+        });
+        for (auto& h : hits) assert(h.load() == 1);
+    }
+    // Empty range never calls fn
+    parallel::parallel_for(5, 5, 1, [](int, int) { assert(false); });
+}
+
+// Nested regions share the pool instead of spawning more threads
+static void test_nested() {
+    std::atomic<long> total{0};
+    parallel::parallel_for(0, 16, 1, [&](int lo, int hi) {
+        for (int i = lo; i < hi; ++i) {
+            parallel::parallel_for(0, 100, 1, [&](int l2, int h2) {
+                for (int j = l2; j < h2; ++j) total.fetch_add(i * 100 + j);
+            });
+        }
+    });
+    long expected = 0;
+    for (int i = 0; i < 1600; ++i) expected += i;
+    assert(total.load() == expected);
+}
+
+static void test_task_group_error() {
+    parallel::TaskGroup group;
+    std::atomic<int> ran{0};
+    for (int i = 0; i < 8; ++i) {
+        group.run([&, i] {
+            ran.fetch_add(1);
+            if (i == 3) throw std::runtime_error("task failed");
+        });
+    }
+    bool caught = false;
+    try {
+        group.wait();
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    assert(caught);
+    assert(ran.load() == 8);
+    // The error is reported once
+    group.wait();
+}
+
+// Ops run inside pool tasks record onto the spawning thread's tape, so
+// gradients match a serial evaluation
+static void test_tape_propagation() {
+    clear_tape();
+    Tensor tx(4, 6), tw(4, 4);
+    for (int i = 0; i < 24; ++i) tx.data[i] = 0.1f * (i % 7) - 0.3f;
+    for (int i = 0; i < 16; ++i) tw.data[i] = 0.05f * (i % 5) - 0.1f;
+    auto x = make_ad(tx);
+    auto w = make_ad(tw);
+
+    auto evaluate = [&](bool in_pool) {
+        std::vector<std::shared_ptr<ADTensor>> parts(6);
+        auto body = [&](int lo, int hi) {
+            for (int c = lo; c < hi; ++c) {
+                parts[c] = sum(tanh_ad(matmul(w, slice_cols(x, c, 1))));
+            }
+        };
+        if (in_pool) parallel::parallel_for(0, 6, 1, body);
+        else body(0, 6);
+        auto loss = parts[0];
+        for (int c = 1; c < 6; ++c) loss = add(loss, parts[c]);
+        return loss;
+    };
+
+    x->grad.fill(0.0f);
+    w->grad.fill(0.0f);
+    auto ref = evaluate(false);
+    ref->backward();
+    Tensor ref_gx = x->grad, ref_gw = w->grad;
+    clear_tape();
+
+    x->grad.fill(0.0f);
+    w->grad.fill(0.0f);
+    auto loss = evaluate(true);
+    assert(tape_size() > 0);
+    assert(std::fabs(loss->val.data[0] - ref->val.data[0]) < 1e-6f);
+    loss->backward();
+    for (int i = 0; i < 24; ++i) assert(std::fabs(x->grad.data[i] - ref_gx.data[i]) < 1e-5f);
+    for (int i = 0; i < 16; ++i) assert(std::fabs(w->grad.data[i] - ref_gw.data[i]) < 1e-5f);
+    clear_tape();
+
+    // NoGradGuard carries over into tasks
+    {
+        NoGradGuard no_grad;
+        auto out = evaluate(true);
+        assert(!out->requires_grad);
+        assert(tape_size() == 0);
+    }
+}
+
+int main() {
+    for (int threads : {1, 4}) {
+        parallel::set_num_threads(threads);
+        assert(parallel::num_threads() == threads);
+        test_parallel_for_coverage();
+        test_nested();
+        test_task_group_error();
+        test_tape_propagation();
+    }
+    parallel::set_pinning(true);
+    assert(parallel::pinning());
+    test_parallel_for_coverage();
+    parallel::set_pinning(false);
+
+    std::cout << "thread_pool tests passed\n";
+    return 0;
+}
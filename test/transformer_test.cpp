@@ -1,13 +1,24 @@
 #include "transformer.hpp"
 #include "tensor.hpp"
 #include <cassert>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <stdexcept>
+#include <vector>
 
 static bool almost_eq(float a, float b, float eps = 1e-4f) {
     return std::fabs(a - b) <= eps;
 }
 
+static Tensor cols(const Tensor& t, int c0, int n) {
+    Tensor out(t.rows, n);
+    for (int r = 0; r < t.rows; ++r)
+        for (int c = 0; c < n; ++c)
+            out.data[r * n + c] = t.data[r * t.cols + c0 + c];
+    return out;
+}
+
 int main() {
     // single block: output shape matches input
     {
@@ -62,6 +73,172 @@ int main() {
             assert(almost_eq(out1.data[i], out2.data[i]));
     }
 
+    // cached prefill + decode matches a full forward, with a preallocated
+    // cache and with one that grows on demand
+    for (int capacity : {0, 16}) {
+        Transformer t(2, 8, 16, 2);
+        if (capacity > 0) t.reserve_cache(capacity);
+        Tensor input(8, 7);
+        for (int i = 0; i < (int)input.data.size(); ++i)
+            input.data[i] = std::sin(0.37f * i);
+        Tensor full = t.forward(input);
+        for (int round = 0; round < 2; ++round) {
+            t.clear_cache();
+            Tensor pre = t.forward(cols(input, 0, 3), false, true);
+            for (int r = 0; r < 8; ++r)
+                for (int c = 0; c < 3; ++c)
+                    assert(almost_eq(pre(r, c), full(r, c)));
+            for (int c = 3; c < 7; ++c) {
+                Tensor step = t.forward(cols(input, c, 1), false, true);
+                for (int r = 0; r < 8; ++r)
+                    assert(almost_eq(step.data[r], full(r, c)));
+            }
+            assert(t.blocks[0].mha.cache.length() == 7);
+        }
+    }
+
+    // sliding-window cache: each position attends to the last 3 positions,
+    // whether the sequence arrives in one call or one token at a time. One
+    // layer, so the reference is a plain forward over that window.
+    {
+        const int W = 3;
+        Transformer t(1, 8, 16, 2);
+        t.reserve_cache(W, true);
+        Tensor input(8, 8);
+        for (int i = 0; i < (int)input.data.size(); ++i)
+            input.data[i] = std::cos(0.23f * i);
+        std::vector<Tensor> ref;
+        for (int c = 0; c < 8; ++c) {
+            int c0 = std::max(0, c - W + 1);
+            Tensor out = t.forward(cols(input, c0, c - c0 + 1));
+            ref.push_back(cols(out, c - c0, 1));
+        }
+        t.clear_cache();
+        Tensor all = t.forward(input, false, true);
+        for (int c = 0; c < 8; ++c)
+            for (int r = 0; r < 8; ++r)
+                assert(almost_eq(all(r, c), ref[c].data[r]));
+        assert(t.blocks[0].mha.cache.size() == W);
+        t.clear_cache();
+        for (int c = 0; c < 8; ++c) {
+            Tensor step = t.forward(cols(input, c, 1), false, true);
+            for (int r = 0; r < 8; ++r)
+                assert(almost_eq(step.data[r], ref[c].data[r]));
+        }
+    }
+
+    // paged cache: prefill + decode matches a full forward, and forked
+    // sequences share the prompt blocks until they diverge
+    {
+        Transformer t(2, 8, 16, 2);
+        KVBlockPool pool(2, 8, 4, 8);
+        Tensor a(8, 10), b(8, 10);
+        for (int i = 0; i < (int)a.data.size(); ++i) {
+            a.data[i] = std::sin(0.41f * i);
+            b.data[i] = (i % 10) < 6 ? a.data[i] : std::cos(0.19f * i);
+        }
+        Tensor full_a = t.forward(a), full_b = t.forward(b);
+        {
+            PagedKVCache prompt(pool);
+            Tensor pre = t.forward(cols(a, 0, 6), prompt);
+            for (int r = 0; r < 8; ++r)
+                for (int c = 0; c < 6; ++c)
+                    assert(almost_eq(pre(r, c), full_a(r, c)));
+            assert(prompt.blocks().size() == 2 && pool.free_blocks() == 6);
+
+            PagedKVCache sa = prompt.fork(), sb = prompt.fork();
+            assert(pool.ref_count(prompt.blocks()[0]) == 3);
+            assert(pool.free_blocks() == 6);
+            for (int c = 6; c < 10; ++c) {
+                Tensor ya = t.forward(cols(a, c, 1), sa);
+                Tensor yb = t.forward(cols(b, c, 1), sb);
+                for (int r = 0; r < 8; ++r) {
+                    assert(almost_eq(ya.data[r], full_a(r, c)));
+                    assert(almost_eq(yb.data[r], full_b(r, c)));
+                }
+            }
+            // The full first block stays shared; the partial one was copied
+            assert(sa.blocks()[0] == prompt.blocks()[0]);
+            assert(sb.blocks()[0] == prompt.blocks()[0]);
+            assert(sa.blocks()[1] != prompt.blocks()[1]);
+            assert(sb.blocks()[1] != sa.blocks()[1]);
+            assert(sa.length() == 10 && prompt.length() == 6);
+
+            // The prompt is untouched by its forks
+            PagedKVCache again = prompt.fork();
+            Tensor y = t.forward(cols(a, 6, 1), again);
+            for (int r = 0; r < 8; ++r) assert(almost_eq(y.data[r], full_a(r, 6)));
+        }
+        assert(pool.free_blocks() == 8);
+
+        // An exhausted pool reports an error instead of overwriting
+        PagedKVCache big(pool);
+        bool threw = false;
+        try {
+            t.forward(Tensor(8, 40), big);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+    // paged sliding window: same per-position windows as the ring cache,
+    // and blocks that fall out of the window go back to the pool
+    {
+        const int W = 3;
+        Transformer t(1, 8, 16, 2);
+        KVBlockPool pool(1, 8, 2, 8);
+        Tensor input(8, 9);
+        for (int i = 0; i < (int)input.data.size(); ++i)
+            input.data[i] = std::cos(0.29f * i);
+        std::vector<Tensor> ref;
+        for (int c = 0; c < 9; ++c) {
+            int c0 = std::max(0, c - W + 1);
+            Tensor out = t.forward(cols(input, c0, c - c0 + 1));
+            ref.push_back(cols(out, c - c0, 1));
+        }
+        PagedKVCache whole(pool, W);
+        Tensor all = t.forward(input, whole);
+        for (int c = 0; c < 9; ++c)
+            for (int r = 0; r < 8; ++r)
+                assert(almost_eq(all(r, c), ref[c].data[r]));
+        PagedKVCache steps(pool, W);
+        for (int c = 0; c < 9; ++c) {
+            Tensor y = t.forward(cols(input, c, 1), steps);
+            for (int r = 0; r < 8; ++r) assert(almost_eq(y.data[r], ref[c].data[r]));
+        }
+        // Positions 6..8 are live: blocks 3 and 4 only
+        assert(steps.first_block() == 3 && steps.blocks()[0] == -1);
+    }
+
+    // truncate drops rejected positions: decoding resumes as if they had
+    // never been fed, and emptied blocks return to the pool
+    {
+        Transformer t(2, 8, 16, 2);
+        KVBlockPool pool(2, 8, 4, 8);
+        Tensor a(8, 10), junk(8, 5);
+        for (int i = 0; i < (int)a.data.size(); ++i) a.data[i] = std::sin(0.37f * i);
+        for (int i = 0; i < (int)junk.data.size(); ++i) junk.data[i] = std::cos(1.3f * i);
+        Tensor full = t.forward(a);
+        PagedKVCache cache(pool);
+        t.forward(cols(a, 0, 6), cache);
+        t.forward(junk, cache);
+        assert(cache.length() == 11 && cache.blocks().size() == 3);
+        cache.truncate(6);
+        assert(cache.length() == 6 && cache.blocks().size() == 2 && pool.free_blocks() == 6);
+        Tensor rest = t.forward(cols(a, 6, 4), cache);
+        for (int r = 0; r < 8; ++r)
+            for (int c = 0; c < 4; ++c)
+                assert(almost_eq(rest(r, c), full(r, 6 + c)));
+        bool threw = false;
+        try {
+            cache.truncate(11);
+        } catch (const std::out_of_range&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
     std::cout << "All Transformer tests passed." << std::endl;
     return 0;
 }
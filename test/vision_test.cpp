@@ -238,7 +238,7 @@ static void test_cnn_pipeline() {
     x = relu_ad(x);
     x = pool.forward(x);
     x = flat.forward(x);
-    x = linear.forward(x);
+    x = linear.forward_rows(x);
 
     assert(x->val.shape.size() == 2);
     assert(x->val.shape[0] == 1);